@@ -0,0 +1,120 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "BufferPool.h"
+
+#include <Urho3D/Math/MathDefs.h>
+
+BufferPool::BufferPool(unsigned maxPooledBytes) :
+    maxPooledBytes_(maxPooledBytes)
+{
+    buffers_.Reserve(32);
+}
+
+void BufferPool::Acquire(PODVector<unsigned char>& dest, unsigned capacity)
+{
+    ++numAcquired_;
+    Release(dest);
+
+    // Best fit keeps the large buffers for the large payloads
+    unsigned best = M_MAX_UNSIGNED;
+    for (unsigned i = 0; i < buffers_.Size(); ++i) {
+        if (buffers_[i].Capacity() >= capacity && (best == M_MAX_UNSIGNED || buffers_[i].Capacity() < buffers_[best].Capacity())) {
+            best = i;
+        }
+    }
+
+    if (best != M_MAX_UNSIGNED) {
+        Take(best, dest);
+        ++numReused_;
+    } else {
+        dest.Reserve(capacity);
+    }
+}
+
+void BufferPool::Release(PODVector<unsigned char>& buffer)
+{
+    unsigned capacity = buffer.Capacity();
+    if (!capacity) {
+        return;
+    }
+
+    // The smallest buffers make room for the new one, unless it is smaller than all of them
+    while (pooledBytes_ + capacity > maxPooledBytes_) {
+        unsigned smallest = 0;
+        for (unsigned i = 1; i < buffers_.Size(); ++i) {
+            if (buffers_[i].Capacity() < buffers_[smallest].Capacity()) {
+                smallest = i;
+            }
+        }
+        if (buffers_.Empty() || buffers_[smallest].Capacity() >= capacity) {
+            PODVector<unsigned char>().Swap(buffer);
+            return;
+        }
+        PODVector<unsigned char> freed;
+        Take(smallest, freed);
+    }
+
+    // An empty vector takes no storage, so pushing one within the capacity does not allocate
+    if (buffers_.Size() == buffers_.Capacity()) {
+        Grow();
+    }
+    buffer.Clear();
+    buffers_.Push(PODVector<unsigned char>());
+    buffers_.Back().Swap(buffer);
+    pooledBytes_ += capacity;
+}
+
+void BufferPool::Clear()
+{
+    buffers_.Clear();
+    pooledBytes_ = 0;
+}
+
+void BufferPool::SetMaxPooledBytes(unsigned bytes)
+{
+    maxPooledBytes_ = bytes;
+    while (pooledBytes_ > maxPooledBytes_) {
+        PODVector<unsigned char> freed;
+        Take(0, freed);
+    }
+}
+
+void BufferPool::Take(unsigned index, PODVector<unsigned char>& dest)
+{
+    // The last buffer fills the gap, then the emptied one at the back is popped
+    pooledBytes_ -= buffers_[index].Capacity();
+    dest.Swap(buffers_[index]);
+    buffers_[index].Swap(buffers_.Back());
+    buffers_.Pop();
+}
+
+void BufferPool::Grow()
+{
+    Vector<PODVector<unsigned char> > grown;
+    grown.Reserve(Max(buffers_.Capacity() * 2, 32U));
+    for (unsigned i = 0; i < buffers_.Size(); ++i) {
+        grown.Push(PODVector<unsigned char>());
+        grown.Back().Swap(buffers_[i]);
+    }
+    buffers_.Swap(grown);
+}
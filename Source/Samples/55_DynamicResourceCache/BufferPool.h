@@ -0,0 +1,74 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Container/Vector.h>
+
+using namespace Urho3D;
+
+/// Pool of byte buffers reused for transient payloads, so that a steady stream of payloads does not allocate once the
+/// pool holds buffers of the sizes in use. Not thread-safe, buffers are acquired and released on the main thread.
+class BufferPool
+{
+public:
+    /// Construct with the maximum number of bytes kept in the pool.
+    explicit BufferPool(unsigned maxPooledBytes = 64 * 1024 * 1024);
+
+    /// Move the smallest pooled buffer with at least the capacity into the destination, which is left empty. A buffer
+    /// the destination held before is returned to the pool.
+    void Acquire(PODVector<unsigned char>& dest, unsigned capacity);
+    /// Return buffer to the pool, leaving the vector without storage. The buffer is freed if the pool is full.
+    void Release(PODVector<unsigned char>& buffer);
+    /// Free all pooled buffers.
+    void Clear();
+
+    /// Set maximum number of bytes kept in the pool. Buffers above the limit are freed.
+    void SetMaxPooledBytes(unsigned bytes);
+    /// Return maximum number of bytes kept in the pool.
+    unsigned GetMaxPooledBytes() const { return maxPooledBytes_; }
+    /// Return number of bytes held by the pooled buffers.
+    unsigned GetPooledBytes() const { return pooledBytes_; }
+    /// Return number of pooled buffers.
+    unsigned GetNumBuffers() const { return buffers_.Size(); }
+    /// Return number of Acquire() calls.
+    unsigned GetNumAcquired() const { return numAcquired_; }
+    /// Return number of Acquire() calls served without allocating.
+    unsigned GetNumReused() const { return numReused_; }
+
+private:
+    /// Remove pooled buffer into the destination.
+    void Take(unsigned index, PODVector<unsigned char>& dest);
+    /// Double the capacity of the pooled buffer vector, swapping the buffers over instead of copying them.
+    void Grow();
+
+    /// Pooled buffers, empty with their storage kept. Only grows when more buffers are pooled than ever before.
+    Vector<PODVector<unsigned char> > buffers_;
+    /// Bytes held by the pooled buffers.
+    unsigned pooledBytes_{};
+    /// Maximum number of bytes kept in the pool.
+    unsigned maxPooledBytes_;
+    /// Number of Acquire() calls.
+    unsigned numAcquired_{};
+    /// Number of Acquire() calls served without allocating.
+    unsigned numReused_{};
+};
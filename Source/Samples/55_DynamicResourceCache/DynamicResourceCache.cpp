@@ -22,19 +22,29 @@
 
 #include <Urho3D/Core/Context.h>
 #include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Graphics/Graphics.h>
 #include <Urho3D/Graphics/GraphicsDefs.h>
 #include <Urho3D/Graphics/Material.h>
 #include <Urho3D/Graphics/Shader.h>
+#include <Urho3D/Graphics/ShaderVariation.h>
 #include <Urho3D/Graphics/Model.h>
 #include <Urho3D/Graphics/Technique.h>
 #include <Urho3D/Graphics/Texture2D.h>
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
 #include <Urho3D/IO/Log.h>
 #include <Urho3D/IO/MemoryBuffer.h>
 #include <Urho3D/IO/PackageFile.h>
+#include <Urho3D/Resource/Image.h>
 #include <Urho3D/Resource/JSONFile.h>
 #include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/ResourceEvents.h>
 #include <Urho3D/Resource/XMLFile.h>
 #include <Urho3D/Resource/XMLElement.h>
+#include <Urho3D/Scene/Component.h>
+#include <Urho3D/Scene/Node.h>
 #include <Urho3D/IO/VectorBuffer.h>
 #include <Urho3D/Network/HttpRequest.h>
 #include <Urho3D/Network/Network.h>
@@ -43,10 +53,310 @@
 #include <Urho3D/AngelScript/ScriptFile.h>
 #endif
 
+#ifdef URHO3D_LUA
+#include <Urho3D/LuaScript/LuaFile.h>
+#include <Urho3D/LuaScript/LuaScript.h>
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+}
+#endif
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
 #include "DynamicResourceCache.h"
+#include "MappedPackageFile.h"
+#include "PersistentResourceStore.h"
+#include "ShaderPreprocessor.h"
 
 static DynamicResourceCache* resourceCacheObject = nullptr;
 
+/// Number of session stores opened by this process.
+static unsigned numSessionStores = 0;
+
+/// Size limit of each script bytecode cache in bytes.
+static const unsigned MAX_SCRIPT_BYTECODE_SIZE = 16 * 1024 * 1024;
+
+/// Info logging of a single resource, can be switched off with SetResourceLogging().
+#define LOGRESOURCEINFOF(format, ...) do { if (resourceLogging_) { URHO3D_LOGINFOF(format, ##__VA_ARGS__); } } while (false)
+
+/// Return host part of the url, used to limit concurrent downloads per host.
+static String GetUrlHost(const String& url)
+{
+    unsigned start = url.Find("://");
+    start = start == String::NPOS ? 0 : start + 3;
+    unsigned end = url.Find('/', start);
+    return (end == String::NPOS ? url.Substring(start) : url.Substring(start, end - start)).ToLower();
+}
+
+/// Return download priority class for the resource, scripts and shaders are needed before anything else can run.
+static DownloadPriority GetDownloadPriority(const String& filename)
+{
+    if (filename.EndsWith(".as") || filename.EndsWith(".lua") || filename.EndsWith(".js") || filename.EndsWith(".glsl")) {
+        return DOWNLOAD_PRIORITY_HIGH;
+    } else if (filename.EndsWith(".xml") || filename.EndsWith(".json")) {
+        return DOWNLOAD_PRIORITY_NORMAL;
+    }
+    return DOWNLOAD_PRIORITY_LOW;
+}
+
+/// Return ingest order rank, resources which others refer to are added first.
+static unsigned GetIngestOrder(const String& filename)
+{
+    if (filename.EndsWith(".as") || filename.EndsWith(".lua") || filename.EndsWith(".js")) {
+        return 2;
+    } else if (filename.EndsWith(".xml") || filename.EndsWith(".json")) {
+        return 1;
+    }
+    return 0;
+}
+
+/// Sort resource names by ingest order, then by name.
+static bool CompareIngestOrder(const String& lhs, const String& rhs)
+{
+    unsigned lhsOrder = GetIngestOrder(lhs);
+    unsigned rhsOrder = GetIngestOrder(rhs);
+    return lhsOrder != rhsOrder ? lhsOrder < rhsOrder : lhs < rhs;
+}
+
+/// Sort resources by use timer, least recently used first.
+static bool CompareLeastRecentlyUsed(const Pair<unsigned, Resource*>& lhs, const Pair<unsigned, Resource*>& rhs)
+{
+    return lhs.first_ > rhs.first_;
+}
+
+/// Return whether character is XML whitespace.
+static inline bool IsXMLSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/// Return hash of the XML root element name by scanning past the declaration, comments and doctype, without
+/// allocating. Return zero hash if not found.
+static StringHash GetXMLRootHash(const char* content, int size)
+{
+    const char* ptr = content;
+    const char* end = content + size;
+    // UTF-8 byte order mark
+    if (size >= 3 && !memcmp(ptr, "\xEF\xBB\xBF", 3)) {
+        ptr += 3;
+    }
+
+    while (ptr < end) {
+        if (IsXMLSpace(*ptr)) {
+            ++ptr;
+        } else if (*ptr != '<' || ptr + 1 >= end) {
+            return StringHash::ZERO;
+        } else if (ptr[1] == '?' || ptr[1] == '!') {
+            // Declaration, doctype or comment, comments may contain '>' so look for their own terminator
+            const char* terminator = end - ptr >= 4 && !memcmp(ptr, "<!--", 4) ? "-->" : ">";
+            unsigned terminatorLength = strlen(terminator);
+            const char* next = ptr + 2;
+            while (next + terminatorLength <= end && memcmp(next, terminator, terminatorLength)) {
+                ++next;
+            }
+            ptr = next + terminatorLength;
+        } else {
+            // Same hash as StringHash of the name, which ignores case
+            unsigned hash = 0;
+            ++ptr;
+            while (ptr < end && !IsXMLSpace(*ptr) && *ptr != '>' && *ptr != '/') {
+                hash = SDBMHash(hash, (unsigned char)tolower(*ptr++));
+            }
+            return StringHash(hash);
+        }
+    }
+
+    return StringHash::ZERO;
+}
+
+/// Return hash of the lowercase file extension including the dot, the same as StringHash(GetExtension(filename)) but
+/// without allocating. Return zero hash if there is no extension.
+static StringHash GetExtensionHash(const String& filename)
+{
+    const char* name = filename.CString();
+    int dot = -1;
+    for (int i = (int)filename.Length() - 1; i >= 0; --i) {
+        if (name[i] == '.') {
+            dot = i;
+            break;
+        } else if (name[i] == '/' || name[i] == '\\') {
+            break;
+        }
+    }
+    if (dot < 0) {
+        return StringHash::ZERO;
+    }
+
+    unsigned hash = 0;
+    for (const char* ptr = name + dot; *ptr; ++ptr) {
+        hash = SDBMHash(hash, (unsigned char)tolower(*ptr));
+    }
+    return StringHash(hash);
+}
+
+/// Base64 value lookup for both the standard and the URL-safe alphabet, 0xFF for other characters.
+static const unsigned char BASE64_VALUES[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0x3E, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0x3F,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+/// Return value of a hex digit, -1 if not a hex digit.
+static int GetHexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/// Append entry data to a package being written, updating the entry and package checksums.
+static void WritePackageData(Serializer& dest, const unsigned char* data, unsigned size, PackageEntry& entry, unsigned& checksum)
+{
+    for (unsigned i = 0; i < size; ++i) {
+        checksum = SDBMHash(checksum, data[i]);
+        entry.checksum_ = SDBMHash(entry.checksum_, data[i]);
+    }
+    dest.Write(data, size);
+    entry.size_ += size;
+}
+
+#ifdef URHO3D_LUA
+/// lua_dump() writer appending the precompiled chunk to a buffer.
+static int WriteLuaChunk(lua_State* state, const void* data, size_t size, void* userData)
+{
+    auto* dest = static_cast<PODVector<unsigned char>*>(userData);
+    unsigned offset = dest->Size();
+    dest->Resize(offset + size);
+    memcpy(dest->Buffer() + offset, data, size);
+    return 0;
+}
+#endif
+
+/// Return whether a payload contains a string, without copying the payload.
+static bool ContainsText(const char* content, unsigned size, const char* text)
+{
+    unsigned length = (unsigned)strlen(text);
+    if (!length || size < length) {
+        return false;
+    }
+    const char* last = content + size - length;
+    for (const char* it = content; it <= last; ++it) {
+        it = (const char*)memchr(it, text[0], last - it + 1);
+        if (!it) {
+            return false;
+        }
+        if (!memcmp(it, text, length)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Return texture format of an uncompressed image, 0 if not supported.
+static unsigned GetImageFormat(unsigned components)
+{
+    switch (components) {
+    case 1:
+        return Graphics::GetLuminanceFormat();
+    case 2:
+        return Graphics::GetLuminanceAlphaFormat();
+    case 3:
+        return Graphics::GetRGBFormat();
+    case 4:
+        return Graphics::GetRGBAFormat();
+    default:
+        return 0;
+    }
+}
+
+/// Remove work item from the work queue. One a worker thread has already started is abandoned instead: it keeps the owner
+/// of its data alive until it completes, and its result is dropped. Return true if the item is not running anymore, so its
+/// buffers can go back to the pool.
+static bool CancelWorkItem(WorkQueue* queue, SharedPtr<OwnedWorkItem>& workItem, RefCounted* owner)
+{
+    bool stopped = true;
+    // Without the work queue there are no worker threads left to complete the item
+    if (queue && workItem && !workItem->completed_ && !queue->RemoveWorkItem(SharedPtr<WorkItem>(workItem))) {
+        workItem->owner_ = owner;
+        stopped = false;
+    }
+    // The owner doesn't refer to the work item anymore, the two would keep each other alive
+    workItem.Reset();
+    return stopped;
+}
+
+/// Worker thread part of the decompression of a compressed payload.
+static void DecompressPayloadWork(const WorkItem* workItem, unsigned threadIndex)
+{
+    auto* item = static_cast<CompressedPayloadItem*>(workItem->aux_);
+    HiresTimer timer;
+    item->success_ = DecompressPayload(item->compression_, item->compressed_.Buffer(), item->compressed_.Size(), item->data_, item->error_);
+    if (item->success_ && !item->hash_.Empty() && PersistentResourceStore::ComputeHash(item->data_.Buffer(), item->data_.Size()) != item->hash_) {
+        item->success_ = false;
+        item->error_ = "content hash mismatch";
+    }
+    item->time_ = timer.GetUSec(false);
+}
+
+/// Worker thread part of the asynchronous ingest, runs the CPU-heavy BeginLoad() on the staging resource.
+static void IngestResourceWork(const WorkItem* workItem, unsigned threadIndex)
+{
+    auto* item = static_cast<AsyncIngestItem*>(workItem->aux_);
+    const unsigned char* payload = item->payload_;
+    unsigned size = item->size_;
+    // A model which can't be optimised is loaded as it is
+    if (item->optimizeModel_) {
+        HiresTimer optimizeTimer;
+        if (OptimizeModel(payload, size, item->modelSettings_, item->optimized_, item->modelResult_, item->optimizeError_)) {
+            payload = item->optimized_.Buffer();
+            size = item->optimized_.Size();
+        }
+        item->optimizeTime_ = optimizeTimer.GetUSec(false);
+    }
+    MemoryBuffer buffer(payload, size);
+    buffer.SetName(item->filename_);
+    HiresTimer timer;
+    if (item->image_) {
+        item->success_ = item->image_->BeginLoad(buffer);
+        // Mip levels of progressive textures are generated here instead of on the main thread, compressed images come with their own.
+        if (item->success_ && item->progressive_ && !item->image_->IsCompressed()) {
+            SharedPtr<Image> level = item->image_;
+            item->mipLevels_.Push(level);
+            while ((level->GetWidth() > 1 || level->GetHeight() > 1) && (level = level->GetNextLevel())) {
+                item->mipLevels_.Push(level);
+            }
+        }
+    } else {
+        item->success_ = item->resource_->BeginLoad(buffer);
+    }
+    item->parseTime_ = timer.GetUSec(false);
+}
+
 #ifdef __EMSCRIPTEN__
 #include <emscripten/emscripten.h>
 #include <emscripten/bind.h>
@@ -57,7 +367,8 @@ using namespace emscripten;
 static size_t AddTextResource(std::string filename, std::string content)
 {
     if (resourceCacheObject) {
-        resourceCacheObject->ProcessResource(String(filename.c_str()), content.c_str(), content.length());
+        String name;
+        resourceCacheObject->ProcessResource(resourceCacheObject->InternName(filename.c_str(), name), content.c_str(), content.length());
     }
 
     return 0;
@@ -73,38 +384,26 @@ void LoadResourceFromUrl(std::string url, std::string filename)
 void AddBinaryFile(std::string filename, intptr_t data, int length)
 {
     if (resourceCacheObject) {
-        resourceCacheObject->ProcessResource(String(filename.c_str()), reinterpret_cast<const char*>(data), length);
+        String name;
+        resourceCacheObject->ProcessResource(resourceCacheObject->InternName(filename.c_str(), name), reinterpret_cast<const char*>(data), length);
     }
 }
 
-void AddResourceFromBase64(std::string filename, std::string content)
+unsigned AddResourceBatch(std::string manifest, intptr_t data, int length)
 {
-    EM_ASM({
-        let filename = UTF8ToString($0);
-        let content = UTF8ToString($1);
-        function convertDataURIToBinary(dataURI) {
-            var BASE64_MARKER = ';base64,';
-            var base64Index = dataURI.indexOf(BASE64_MARKER) + BASE64_MARKER.length;
-            var base64 = dataURI.substring(base64Index);
-            var raw = window.atob(base64);
-            var rawLength = raw.length;
-            var array = new Uint8Array(new ArrayBuffer(rawLength));
-
-            for(i = 0; i < rawLength; i++) {
-            array[i] = raw.charCodeAt(i);
-            }
-            return array;
-        }
+    if (resourceCacheObject) {
+        return resourceCacheObject->ProcessResourceBatch(String(manifest.c_str()), reinterpret_cast<const void*>(data), length);
+    }
 
-        data = convertDataURIToBinary(content);
+    return 0;
+}
 
-        const nDataBytes = data.byteLength;
-        const dataPtr = Module._malloc(nDataBytes);
-        const dataHeap = new Uint8Array(Module.HEAPU8.buffer, dataPtr, nDataBytes);
-        dataHeap.set(new Uint8Array(data));
-        Module.AddBinaryFile(filename, dataHeap.byteOffset, nDataBytes);
-        Module._free(dataHeap.byteOffset);
-    }, filename.c_str(), content.c_str());
+void AddResourceFromBase64(std::string filename, std::string content)
+{
+    if (resourceCacheObject) {
+        String name;
+        resourceCacheObject->ProcessResourceBase64(resourceCacheObject->InternName(filename.c_str(), name), content.c_str(), content.length());
+    }
 }
 
 static void LoadResourceList()
@@ -118,14 +417,56 @@ static void LoadResourceList()
                 module.call<void>("ListResource", val((*it2).CString()));
             }
         }
+
+        const auto& dynamicResources = resourceCacheObject->GetDynamicResources();
+        for (auto it = dynamicResources.Begin(); it != dynamicResources.End(); ++it) {
+            module.call<void>("ListResource", val(it->first_.CString()));
+        }
+
+        if (auto* store = resourceCacheObject->GetPersistentStore()) {
+            const auto& entries = store->GetEntries();
+            for (auto it = entries.Begin(); it != entries.End(); ++it) {
+                if (!dynamicResources.Contains(it->first_)) {
+                    module.call<void>("ListResource", val(it->first_.CString()));
+                }
+            }
+        }
+    }
+}
+
+bool ExportPackage(std::string filename)
+{
+    if (resourceCacheObject) {
+        return resourceCacheObject->ExportPackage(String(filename.c_str()));
+    }
+
+    return false;
+}
+
+bool MountPackage(std::string filename)
+{
+    if (resourceCacheObject) {
+        return resourceCacheObject->MountPackage(String(filename.c_str()));
+    }
+
+    return false;
+}
+
+bool UnmountPackage(std::string filename)
+{
+    if (resourceCacheObject) {
+        return resourceCacheObject->UnmountPackage(String(filename.c_str()));
     }
+
+    return false;
 }
 
 std::string GetResource(std::string filename)
 {
     if (resourceCacheObject) {
-        String content = resourceCacheObject->GetResourceContent(String(filename.c_str()));
-        return content.CString();
+        String name;
+        const String& content = resourceCacheObject->GetResourceContent(resourceCacheObject->InternName(filename.c_str(), name));
+        return std::string(content.CString(), content.Length());
     }
 
     return std::string("");
@@ -134,7 +475,18 @@ std::string GetResource(std::string filename)
 void GetResourceBinary(std::string filename)
 {
     if (resourceCacheObject) {
-        resourceCacheObject->GetResourceContentBinary(String(filename.c_str()));
+        String name;
+        unsigned size;
+        resourceCacheObject->GetResourceContentBinary(resourceCacheObject->InternName(filename.c_str(), name), size);
+    }
+}
+
+void GetResourceBinaryRange(std::string filename, unsigned offset, unsigned length)
+{
+    if (resourceCacheObject) {
+        String name;
+        unsigned size;
+        resourceCacheObject->GetResourceContentBinary(resourceCacheObject->InternName(filename.c_str(), name), size, offset, length);
     }
 }
 
@@ -152,16 +504,88 @@ void StartSingleScript(std::string filename)
     }
 }
 
+bool SetPersistentCacheDir(std::string directory)
+{
+    if (resourceCacheObject) {
+        return resourceCacheObject->SetPersistentCacheDir(String(directory.c_str()));
+    }
+
+    return false;
+}
+
+bool CancelResourceDownload(std::string filename)
+{
+    if (resourceCacheObject) {
+        return resourceCacheObject->CancelResourceDownload(String(filename.c_str()));
+    }
+
+    return false;
+}
+
+bool RemoveResource(std::string filename)
+{
+    if (resourceCacheObject) {
+        return resourceCacheObject->RemoveResource(String(filename.c_str()));
+    }
+
+    return false;
+}
+
+unsigned RemoveResourcesByPrefix(std::string prefix)
+{
+    if (resourceCacheObject) {
+        return resourceCacheObject->RemoveResourcesByPrefix(String(prefix.c_str()));
+    }
+
+    return 0;
+}
+
+void SetMemoryBudget(double budget)
+{
+    if (resourceCacheObject) {
+        resourceCacheObject->SetMemoryBudget((unsigned long long)budget);
+    }
+}
+
+std::string GetStats()
+{
+    if (resourceCacheObject) {
+        String stats = resourceCacheObject->GetStatsJSON();
+        return std::string(stats.CString(), stats.Length());
+    }
+
+    return std::string("");
+}
+
+void SetResourceLogging(bool enable)
+{
+    if (resourceCacheObject) {
+        resourceCacheObject->SetResourceLogging(enable);
+    }
+}
+
 EMSCRIPTEN_BINDINGS(ResourceModule) {
     function("AddTextResource", &AddTextResource);
     function("AddBinaryFile", &AddBinaryFile);
+    function("AddResourceBatch", &AddResourceBatch);
     function("AddResourceFromBase64", &AddResourceFromBase64);
     function("LoadResourceFromUrl", &LoadResourceFromUrl);
     function("LoadResourceList", &LoadResourceList);
     function("StartScripts", &StartScripts);
     function("StartSingleScript", &StartSingleScript);
+    function("CancelResourceDownload", &CancelResourceDownload);
+    function("SetPersistentCacheDir", &SetPersistentCacheDir);
+    function("ExportPackage", &ExportPackage);
+    function("MountPackage", &MountPackage);
+    function("UnmountPackage", &UnmountPackage);
     function("GetResource", &GetResource);
     function("GetResourceBinary", &GetResourceBinary);
+    function("GetResourceBinaryRange", &GetResourceBinaryRange);
+    function("RemoveResource", &RemoveResource);
+    function("RemoveResourcesByPrefix", &RemoveResourcesByPrefix);
+    function("SetMemoryBudget", &SetMemoryBudget);
+    function("GetStats", &GetStats);
+    function("SetResourceLogging", &SetResourceLogging);
 }
 #endif
 
@@ -170,111 +594,2616 @@ Object(context)
         {
                 resourceCacheObject = this;
         SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(DynamicResourceCache, HandleUpdate));
+        shaderVariantDefines_.Push(String::EMPTY);
+
+        RegisterHandler(".as", StringHash("ScriptFile"), &DynamicResourceCache::AddAngelScriptFile, false);
+        RegisterHandler(".lua", StringHash("LuaFile"), &DynamicResourceCache::AddLuaScriptFile, false);
+        RegisterHandler(".js", StringHash(), &DynamicResourceCache::AddJavaScriptFile, false);
+        RegisterHandler(".xml", XMLFile::GetTypeStatic(), &DynamicResourceCache::AddXMLFile, true);
+        RegisterHandler(".json", JSONFile::GetTypeStatic(), &DynamicResourceCache::AddJSONFile, true);
+        RegisterHandler(".glsl", Shader::GetTypeStatic(), &DynamicResourceCache::AddGLSLShader, true);
+        RegisterHandler(".mdl", Model::GetTypeStatic(), &DynamicResourceCache::AddModel, true);
+        RegisterHandler(".dds", Texture2D::GetTypeStatic(), &DynamicResourceCache::AddImageFile, true);
+        RegisterHandler(".jpg", Texture2D::GetTypeStatic(), &DynamicResourceCache::AddImageFile, true);
+        RegisterHandler(".jpeg", Texture2D::GetTypeStatic(), &DynamicResourceCache::AddImageFile, true);
+        RegisterHandler(".png", Texture2D::GetTypeStatic(), &DynamicResourceCache::AddImageFile, true);
+        RegisterHandler(".icns", Texture2D::GetTypeStatic(), &DynamicResourceCache::AddImageFile, true);
+
+        RegisterResourceMagic("\x89PNG", Texture2D::GetTypeStatic());
+        RegisterResourceMagic("\xFF\xD8\xFF", Texture2D::GetTypeStatic());
+        RegisterResourceMagic("DDS ", Texture2D::GetTypeStatic());
+        RegisterResourceMagic("UMDL", Model::GetTypeStatic());
+        RegisterResourceMagic("UMD2", Model::GetTypeStatic());
+
+        RegisterResourceExtension(".ani", StringHash("Animation"));
+        RegisterResourceExtension(".ogg", StringHash("Sound"));
+        RegisterResourceExtension(".wav", StringHash("Sound"));
+        RegisterResourceExtension(".ttf", StringHash("Font"));
+        RegisterResourceExtension(".otf", StringHash("Font"));
+        RegisterXMLRootType("particleeffect", StringHash("ParticleEffect"));
         }
 
 DynamicResourceCache::~DynamicResourceCache()
 {
+    // Work items point to the pending items and their payloads. Running ones keep these alive until they complete, batch
+    // items the whole batch whose data they read
+    auto* queue = GetSubsystem<WorkQueue>();
+    for (auto it = pendingIngests_.Begin(); it != pendingIngests_.End(); ++it) {
+        CancelWorkItem(queue, (*it)->workItem_, *it);
+    }
+    for (auto it = pendingBatches_.Begin(); it != pendingBatches_.End(); ++it) {
+        for (auto resource = (*it)->resources_.Begin(); resource != (*it)->resources_.End(); ++resource) {
+            if (resource->decompression_) {
+                CancelWorkItem(queue, resource->decompression_->workItem_, *it);
+            }
+            if (resource->item_) {
+                CancelWorkItem(queue, resource->item_->workItem_, *it);
+            }
+        }
+    }
+    for (auto it = pendingDecompressions_.Begin(); it != pendingDecompressions_.End(); ++it) {
+        CancelWorkItem(queue, (*it)->workItem_, *it);
+    }
+
+    if (store_) {
+        store_->SaveIndex();
+    }
+    CloseLazyStore();
+#ifdef URHO3D_LUA
+    while (!luaStartRefs_.Empty()) {
+        String filename = luaStartRefs_.Begin()->first_;
+        ReleaseLuaStart(filename);
+    }
+#endif
+}
+
+void DynamicResourceCache::HandleUpdate(StringHash eventType, VariantMap& eventData)
+{
+    FlushCoalescedIngests();
+    FinishDecompressions();
+    FinishAsyncIngests();
+    CommitBatches();
+    UploadProgressiveTextures();
+    CompileScripts();
+    PropagateReloads();
+    BuildShaderVariants();
+    CheckMemoryBudget();
+
+    if (lazyStore_) {
+        lazyStore_->FinishWrites(false);
+    }
+    if (store_) {
+        store_->FinishWrites(false);
+        store_->SaveIndex();
+    }
+
+#ifdef URHO3D_NETWORK
+    if (!httpRequests_.Empty()) {
+        using namespace Update;
+        stats_.downloadActiveTime_ += eventData[P_TIMESTEP].GetFloat();
+    }
+
+    // Every request that finished during the frame is completed, freed slots are reused right away
+    for (auto it = httpRequests_.Begin(); it != httpRequests_.End();) {
+        if (UpdateDownload(*it)) {
+            if (--downloadsPerHost_[it->host_] == 0) {
+                downloadsPerHost_.Erase(it->host_);
+            }
+            bufferPool_.Release(it->data_);
+            it = httpRequests_.Erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    StartDownloads();
+#endif
+}
+
+#ifdef URHO3D_NETWORK
+void DynamicResourceCache::StartDownloads()
+{
+    auto* network = GetSubsystem<Network>();
+    unsigned now = Time::GetSystemTime();
+    for (auto it = remoteResources_.Begin(); it != remoteResources_.End() && httpRequests_.Size() < maxConcurrentDownloads_;) {
+        // Chunks of a ranged download which has failed or completed meanwhile are not needed anymore
+        RangedDownload* ranged = it->ranged_;
+        if (ranged && it->generation_ != ranged->generation_) {
+            it = remoteResources_.Erase(it);
+            continue;
+        }
+        if (it->retryTime_ > now) {
+            ++it;
+            continue;
+        }
+
+        String host = GetUrlHost(it->url_);
+        unsigned& hostDownloads = downloadsPerHost_[host];
+        if (hostDownloads >= maxDownloadsPerHost_) {
+            ++it;
+            continue;
+        }
+        ++hostDownloads;
+
+        Vector<String> headers;
+        unsigned size = it->sizeHint_;
+        if (ranged) {
+            unsigned received = ranged->received_[it->chunk_];
+            unsigned offset = ranged->chunkOffsets_[it->chunk_] + received;
+            size = ranged->chunkOffsets_[it->chunk_ + 1] - offset;
+            headers.Push(ToString("Range: bytes=%u-%u", offset, offset + size - 1));
+            ++stats_.numRangeRequests_;
+            if (received) {
+                ++stats_.numResumedRequests_;
+                stats_.bytesResumed_ += received;
+            }
+        }
+
+        NetworkResourceRequest download;
+        download.request_ = network->MakeHttpRequest(it->url_, "GET", headers);
+        download.resource_ = *it;
+        download.host_ = host;
+        httpRequests_.Push(download);
+        if (size) {
+            bufferPool_.Acquire(httpRequests_.Back().data_, size);
+        }
+        LOGRESOURCEINFOF("Loading remote resource %s from %s", it->filename_.CString(), it->url_.CString());
+        it = remoteResources_.Erase(it);
+    }
+}
+
+bool DynamicResourceCache::UpdateDownload(NetworkResourceRequest& download)
+{
+    HttpRequest* request = download.request_;
+    if (!request) {
+        return true;
+    }
+    RangedDownload* ranged = download.resource_.ranged_;
+    if (ranged && download.resource_.generation_ != ranged->generation_) {
+        return true;
+    }
+
+    HttpRequestState state = request->GetState();
+    if (state == HTTP_INITIALIZING) {
+        return false;
+    }
+
+    // Drain everything the connection thread has received so far, no data arrives after the state is closed. Data
+    // received before an error is kept, a range request can continue from it
+    unsigned available;
+    while ((available = request->GetAvailableSize()) > 0) {
+        unsigned offset = download.data_.Size();
+        download.data_.Resize(offset + available);
+        unsigned read = request->Read(&download.data_[offset], available);
+        download.data_.Resize(offset + read);
+        if (!read) {
+            break;
+        }
+    }
+
+    if (state == HTTP_OPEN) {
+        return false;
+    }
+
+    stats_.bytesDownloaded_ += download.data_.Size();
+    stats_.downloadTime_ += download.timer_.GetUSec(false);
+    if (ranged) {
+        UpdateRangedDownload(download, state == HTTP_ERROR);
+        return true;
+    }
+    if (state == HTTP_ERROR) {
+        RetryDownload(download.resource_, request->GetError());
+        return true;
+    }
+    if (!VerifyDownload(download.resource_, download.data_)) {
+        FailDownload(download.resource_, "content hash mismatch", false);
+        return true;
+    }
+
+    ++stats_.numDownloaded_;
+    ProcessDownload(download.resource_.filename_, request->GetURL(), download.data_, download.resource_.hash_);
+    return true;
+}
+
+void DynamicResourceCache::UpdateRangedDownload(NetworkResourceRequest& download, bool failed)
+{
+    // HttpRequest exposes neither the status code nor Content-Range. A server ignoring the range is recognized by a
+    // response of the whole resource size, a dropped connection by a response shorter than the range
+    RemoteResource& resource = download.resource_;
+    RangedDownload* ranged = resource.ranged_;
+    unsigned chunk = resource.chunk_;
+    unsigned size = ranged->data_.Size();
+    unsigned chunkSize = ranged->chunkOffsets_[chunk + 1] - ranged->chunkOffsets_[chunk];
+    unsigned offset = ranged->chunkOffsets_[chunk] + ranged->received_[chunk];
+    unsigned expected = ranged->chunkOffsets_[chunk + 1] - offset;
+    unsigned received = download.data_.Size();
+
+    if (!failed && received == size && expected != size) {
+        URHO3D_LOGWARNINGF("Server of %s does not support range requests, using the whole response", ranged->url_.CString());
+        memcpy(ranged->data_.Buffer(), download.data_.Buffer(), size);
+        for (unsigned i = 0; i < ranged->received_.Size(); ++i) {
+            ranged->received_[i] = ranged->chunkOffsets_[i + 1] - ranged->chunkOffsets_[i];
+        }
+    } else if (received > expected) {
+        // Either the resource does not have the expected size or the server sends more than asked for, retrying
+        // would give the same response
+        FailDownload(resource, ToString("response of %u bytes to a range of %u bytes of a %u byte resource", received, expected,
+            size), false);
+        return;
+    } else if (received) {
+        // Until the server has proven to honour ranges, a cut off response may be the start of the whole resource,
+        // which only fits at offset 0. The first chunk either proves the ranges or runs out of retries
+        if (offset && !ranged->rangesVerified_ && received < expected) {
+            URHO3D_LOGWARNINGF("Discarding %u bytes of an interrupted range request for %s", received, ranged->url_.CString());
+        } else {
+            memcpy(&ranged->data_[offset], download.data_.Buffer(), received);
+            ranged->received_[chunk] += received;
+            if (received == expected && expected != size) {
+                ranged->rangesVerified_ = true;
+            }
+        }
+        // A connection delivering data does not use up the retries
+        resource.attempts_ = 0;
+    }
+
+    if (ranged->received_[chunk] < chunkSize) {
+        RetryDownload(resource, failed ? download.request_->GetError() : ToString("connection closed after %u of %u bytes", received, expected));
+        return;
+    }
+    for (unsigned i = 0; i < ranged->received_.Size(); ++i) {
+        if (ranged->received_[i] < ranged->chunkOffsets_[i + 1] - ranged->chunkOffsets_[i]) {
+            return;
+        }
+    }
+
+    if (!VerifyDownload(resource, ranged->data_)) {
+        FailDownload(resource, "content hash mismatch", false);
+        return;
+    }
+
+    // Chunks still queued or running are dropped
+    ++ranged->generation_;
+    ++stats_.numDownloaded_;
+    partialDownloads_.Erase(ranged->url_);
+    ProcessDownload(ranged->filename_, ranged->url_, ranged->data_, ranged->hash_);
+    bufferPool_.Release(ranged->data_);
+}
+
+void DynamicResourceCache::RetryDownload(RemoteResource resource, const String& error)
+{
+    const String& filename = resource.filename_;
+    if (resource.attempts_ < maxDownloadRetries_) {
+        unsigned delay = downloadRetryDelay_ << resource.attempts_;
+        ++resource.attempts_;
+        resource.retryTime_ = Time::GetSystemTime() + delay;
+        ++stats_.numDownloadRetries_;
+        URHO3D_LOGWARNINGF("Failed to load resource %s from url due to error: %s, retrying in %d ms", filename.CString(),
+            error.CString(), delay);
+        QueueDownload(resource);
+        return;
+    }
+
+    // What has been received is kept for the next LoadResourceFromUrl() call
+    FailDownload(resource, error, true);
+}
+
+void DynamicResourceCache::FailDownload(const RemoteResource& resource, const String& error, bool keepPartial)
+{
+    const String& filename = resource.filename_;
+    URHO3D_LOGERRORF("Failed to load resource %s from url due to error: %s", filename.CString(), error.CString());
+    ++stats_.numDownloadsFailed_;
+    auto waiters = downloadWaiters_.Find(resource.url_);
+    if (waiters != downloadWaiters_.End()) {
+#ifdef __EMSCRIPTEN__
+        val module = val::global("Module");
+        for (auto it = waiters->second_.Begin(); it != waiters->second_.End(); ++it) {
+            module.call<void>("FileLoadFailed", val(it->CString()));
+        }
+#endif
+        downloadWaiters_.Erase(waiters);
+    }
+    // The other chunks are dropped
+    if (RangedDownload* ranged = resource.ranged_) {
+        ++ranged->generation_;
+        if (keepPartial) {
+            partialDownloads_[ranged->url_] = ranged;
+        } else {
+            partialDownloads_.Erase(ranged->url_);
+            bufferPool_.Release(ranged->data_);
+        }
+    }
+#ifdef __EMSCRIPTEN__
+    val module = val::global("Module");
+    module.call<void>("FileLoadFailed", val(filename.CString()));
+#endif
+}
+
+void DynamicResourceCache::QueueRangedDownload(const String& url, const String& filename, unsigned size, const String& hash)
+{
+    SharedPtr<RangedDownload> ranged;
+    auto partial = partialDownloads_.Find(url);
+    if (partial != partialDownloads_.End() && partial->second_->data_.Size() == size && partial->second_->hash_ == hash) {
+        ranged = partial->second_;
+        LOGRESOURCEINFOF("Resuming partial download of %s", url.CString());
+    } else {
+        // A partial download of other content can't be continued
+        if (partial != partialDownloads_.End()) {
+            bufferPool_.Release(partial->second_->data_);
+        }
+        ranged = new RangedDownload();
+        ranged->url_ = url;
+        bufferPool_.Acquire(ranged->data_, size);
+        ranged->data_.Resize(size);
+        for (unsigned offset = 0; offset < size; offset += Min(downloadChunkSize_, size - offset)) {
+            ranged->chunkOffsets_.Push(offset);
+            ranged->received_.Push(0);
+        }
+        ranged->chunkOffsets_.Push(size);
+    }
+    partialDownloads_.Erase(url);
+    ranged->filename_ = filename;
+    ranged->hash_ = hash;
+
+    DownloadPriority priority = GetDownloadPriority(filename);
+    for (unsigned i = 0; i < ranged->received_.Size(); ++i) {
+        if (ranged->received_[i] < ranged->chunkOffsets_[i + 1] - ranged->chunkOffsets_[i]) {
+            RemoteResource resource;
+            resource.url_ = url;
+            resource.filename_ = filename;
+            resource.hash_ = hash;
+            resource.sizeHint_ = size;
+            resource.priority_ = priority;
+            resource.ranged_ = ranged;
+            resource.chunk_ = i;
+            resource.generation_ = ranged->generation_;
+            QueueDownload(resource);
+        }
+    }
+}
+
+bool DynamicResourceCache::VerifyDownload(const RemoteResource& resource, const PODVector<unsigned char>& data) const
+{
+    if (resource.hash_.Empty() || GetPayloadCompression(resource.filename_, data.Buffer(), data.Size()) != COMPRESSION_NONE) {
+        return true;
+    }
+    return PersistentResourceStore::ComputeHash(data.Buffer(), data.Size()) == resource.hash_;
+}
+
+void DynamicResourceCache::ProcessDownload(const String& filename, const String& url, const PODVector<unsigned char>& data,
+    const String& hash)
+{
+    // Loads of the url made while the download was running get the payload as well, each under its own name
+    StringVector names;
+    names.Push(filename);
+    auto waiters = downloadWaiters_.Find(url);
+    if (waiters != downloadWaiters_.End()) {
+        for (auto it = waiters->second_.Begin(); it != waiters->second_.End(); ++it) {
+            if (names.Contains(*it)) {
+                // Compressed payloads are loaded and reported under the decompressed name
+                ++ingestWaiters_[GetDecompressedName(*it)];
+            } else {
+                names.Push(*it);
+            }
+        }
+        downloadWaiters_.Erase(waiters);
+    }
+
+    for (auto it = names.Begin(); it != names.End(); ++it) {
+        const String& name = *it;
+        if (data.Empty()) {
+            URHO3D_LOGERRORF("Remote resource %s from %s is empty", name.CString(), url.CString());
+#ifdef __EMSCRIPTEN__
+            val module = val::global("Module");
+            module.call<void>("FileLoadFailed", val(name.CString()));
+#endif
+            NotifyIngestWaiters(GetDecompressedName(name), false);
+            continue;
+        }
+
+        LOGRESOURCEINFOF("Remote resource %s downloaded from %s, size = %d", name.CString(), url.CString(), data.Size());
+        // Content-Encoding is not exposed by HttpRequest, the encoded body is recognized by its magic bytes instead
+        PayloadCompression compression = GetPayloadCompression(name, data.Buffer(), data.Size());
+        String decompressedName = GetDecompressedName(name);
+        bool startScript = decompressedName.EndsWith(".as") || (decompressedName.EndsWith(".lua") && !luaRunOnLoad_);
+        if (compression != COMPRESSION_NONE) {
+            QueueDecompression(name, (const char*)data.Buffer(), data.Size(), compression, startScript, hash);
+        } else {
+            IngestResource(name, (const char*)data.Buffer(), data.Size());
+            if (startScript) {
+                StartSingleScript(name);
+            }
+        }
+    }
+}
+
+bool DynamicResourceCache::CoalesceDownload(const String& url, const String& filename)
+{
+    bool pending = false;
+    for (auto it = remoteResources_.Begin(); it != remoteResources_.End() && !pending; ++it) {
+        pending = it->url_ == url && (!it->ranged_ || it->generation_ == it->ranged_->generation_);
+    }
+    for (auto it = httpRequests_.Begin(); it != httpRequests_.End() && !pending; ++it) {
+        const RemoteResource& resource = it->resource_;
+        pending = resource.url_ == url && (!resource.ranged_ || resource.generation_ == resource.ranged_->generation_);
+    }
+    if (!pending) {
+        return false;
+    }
+
+    downloadWaiters_[url].Push(filename);
+    ++stats_.numCoalescedDownloads_;
+    LOGRESOURCEINFOF("Remote resource %s shares the running download of %s", filename.CString(), url.CString());
+    return true;
+}
+#endif
+
+void DynamicResourceCache::QueueDownload(const RemoteResource& resource)
+{
+    auto it = remoteResources_.Begin();
+    while (it != remoteResources_.End() && it->priority_ <= resource.priority_) {
+        ++it;
+    }
+    remoteResources_.Insert(it, resource);
+}
+
+void DynamicResourceCache::ProcessResource(const String& filename, const char* content, int size)
+{
+    // Bursts of the same resource, e.g. from an editor saving a file repeatedly, are loaded once with the latest payload
+    if (ingestCoalescing_) {
+        CoalesceIngest(filename, content, size);
+        return;
+    }
+    IngestResource(filename, content, size);
+}
+
+void DynamicResourceCache::IngestResource(const String& filename, const char* content, int size)
+{
+    // Compressed payloads come back here once they have been decompressed on a worker thread
+    PayloadCompression compression = GetPayloadCompression(filename, content, size);
+    if (compression != COMPRESSION_NONE) {
+        QueueDecompression(filename, content, size, compression, false);
+        return;
+    }
+    for (auto it = pendingDecompressions_.Begin(); it != pendingDecompressions_.End(); ++it) {
+        if ((*it)->filename_ == filename) {
+            (*it)->superseded_ = true;
+        }
+    }
+
+    LOGRESOURCEINFOF("Processing resource with legnth %d", size);
+    String hash = PersistentResourceStore::ComputeHash(content, size);
+    DynamicResourceInfo& info = RecordIngest(filename, content, size, hash);
+
+    ResourceHandler handler;
+    if (!GetResourceHandler(filename, content, size, handler)) {
+        URHO3D_LOGERRORF("Unable to process file %s, no handler implemented", filename.CString());
+        ++stats_.numUnhandled_;
+        NotifyIngestWaiters(filename, false);
+        return;
+    }
+
+    if (handler.type_ == XMLFile::GetTypeStatic()) {
+        handler.type_ = GetXMLResourceType(content, size);
+    }
+
+    // Identical payload of a resource which is still in the cache needs no reload. Scripts are run again on every call
+    auto* cache = GetSubsystem<ResourceCache>();
+    Resource* existing = handler.type_ != StringHash() ? cache->GetExistingResource(handler.type_, filename) : nullptr;
+    if (existing && !IsIngestPending(filename) && info.type_ == handler.type_ && info.hash_ == hash) {
+        ReportUnchanged(filename);
+#ifdef URHO3D_LUA
+        // Sending a Lua file runs it, whether it has changed or not
+        auto luaScript = luaScripts_.Find(filename);
+        if (luaRunOnLoad_ && luaScript != luaScripts_.End()) {
+            RunLuaScriptFile(luaScript->second_);
+        }
+#endif
+        return;
+    }
+
+    // The ResourceCache loads lazily registered payloads as they are, so models to optimise are loaded right away
+    bool optimizeModel = modelOptimization_ && handler.type_ == Model::GetTypeStatic();
+    if (lazyLoading_ && handler.async_ && handler.type_ != StringHash() && !existing && !optimizeModel &&
+        !IsIngestPending(filename) && DeferResource(filename, content, size, handler.type_, hash)) {
+        return;
+    }
+    // Loaded payload takes precedence over an earlier lazily registered one
+    info.lazy_ = false;
+    if (lazyStore_) {
+        lazyStore_->Remove(filename);
+    }
+
+    // Progressive textures need the worker thread for their mip levels, optimised models for the optimisation
+    bool progressive = progressiveTextures_ && handler.type_ == Texture2D::GetTypeStatic() && GetSubsystem<Graphics>();
+    if ((asyncIngest_ || progressive || optimizeModel) && handler.async_ &&
+        QueueAsyncIngest(filename, content, size, handler.type_, hash, false)) {
+        return;
+    }
+
+    LoadResource(filename, content, size, handler, hash);
+}
+
+DynamicResourceInfo& DynamicResourceCache::RecordIngest(const String& filename, const char* content, int size, const String& hash)
+{
+    ++stats_.numProcessed_;
+    stats_.bytesProcessed_ += size;
+    DynamicResourceInfo& info = RegisterResourceInfo(filename);
+    if (filename == contentName_) {
+        contentValid_ = false;
+    }
+    if (mountingPackage_) {
+        packageResources_[filename] = mountingPackage_;
+    } else {
+        packageResources_.Erase(filename);
+    }
+    if (store_) {
+        store_->Store(filename, content, size, hash);
+    }
+    return info;
+}
+
+void DynamicResourceCache::ReportUnchanged(const String& filename)
+{
+    LOGRESOURCEINFOF("Resource %s has not changed, skipping reload", filename.CString());
+    ++stats_.numSkipped_;
+#ifdef __EMSCRIPTEN__
+    val module = val::global("Module");
+    module.call<void>("FileLoaded", val(filename.CString()));
+#endif
+    NotifyIngestWaiters(filename, true);
+}
+
+void DynamicResourceCache::RemovePendingIngest(const String& filename)
+{
+    auto it = pendingIngestCounts_.Find(filename);
+    if (it != pendingIngestCounts_.End() && --it->second_ == 0) {
+        pendingIngestCounts_.Erase(it);
+    }
+}
+
+bool DynamicResourceCache::ProcessResourceBase64(const String& filename, const char* content, unsigned length)
+{
+    if (!DecodeDataURI(content, length, decodeBuffer_)) {
+        URHO3D_LOGERRORF("Unable to process file %s, invalid base64 content", filename.CString());
+#ifdef __EMSCRIPTEN__
+        val module = val::global("Module");
+        module.call<void>("FileLoadFailed", val(filename.CString()));
+#endif
+        return false;
+    }
+
+    ProcessResource(filename, (const char*)decodeBuffer_.Buffer(), decodeBuffer_.Size());
+    return true;
+}
+
+bool DynamicResourceCache::DecodeBase64(const char* content, unsigned length, PODVector<unsigned char>& dest)
+{
+    const unsigned char* table = BASE64_VALUES;
+    const unsigned char* in = (const unsigned char*)content;
+    const unsigned char* end = in + length;
+    dest.Resize(length / 4 * 3 + 3);
+    unsigned char* out = dest.Buffer();
+    unsigned bits = 0;
+    unsigned numChars = 0;
+
+    while (in < end) {
+        // Whole groups of four characters are decoded at once until whitespace or padding is hit
+        if (!numChars) {
+            while (end - in >= 4) {
+                unsigned a = table[in[0]];
+                unsigned b = table[in[1]];
+                unsigned c = table[in[2]];
+                unsigned d = table[in[3]];
+                if ((a | b | c | d) & 0x80) {
+                    break;
+                }
+                unsigned value = a << 18 | b << 12 | c << 6 | d;
+                out[0] = (unsigned char)(value >> 16);
+                out[1] = (unsigned char)(value >> 8);
+                out[2] = (unsigned char)value;
+                out += 3;
+                in += 4;
+            }
+            if (in == end) {
+                break;
+            }
+        }
+
+        unsigned char value = table[*in];
+        if (value == 0xFF) {
+            if (*in == '=') {
+                break;
+            } else if (!IsXMLSpace(*in)) {
+                return false;
+            }
+        } else {
+            bits = bits << 6 | value;
+            if (++numChars == 4) {
+                out[0] = (unsigned char)(bits >> 16);
+                out[1] = (unsigned char)(bits >> 8);
+                out[2] = (unsigned char)bits;
+                out += 3;
+                bits = 0;
+                numChars = 0;
+            }
+        }
+        ++in;
+    }
+
+    // Only padding and whitespace may follow the padding
+    for (; in < end; ++in) {
+        if (*in != '=' && !IsXMLSpace(*in)) {
+            return false;
+        }
+    }
+
+    if (numChars == 1) {
+        return false;
+    } else if (numChars == 2) {
+        *out++ = (unsigned char)(bits >> 4);
+    } else if (numChars == 3) {
+        *out++ = (unsigned char)(bits >> 10);
+        *out++ = (unsigned char)(bits >> 2);
+    }
+
+    dest.Resize((unsigned)(out - dest.Buffer()));
+    return true;
+}
+
+bool DynamicResourceCache::DecodeDataURI(const char* content, unsigned length, PODVector<unsigned char>& dest)
+{
+    if (length < 5 || memcmp(content, "data:", 5)) {
+        return DecodeBase64(content, length, dest);
+    }
+
+    const char* comma = (const char*)memchr(content, ',', length);
+    if (!comma) {
+        return false;
+    }
+    const char* data = comma + 1;
+    unsigned dataLength = length - (unsigned)(data - content);
+
+    // Media type parameters end with ";base64" for base64 payloads
+    if (comma - content >= 12 && !memcmp(comma - 7, ";base64", 7)) {
+        return DecodeBase64(data, dataLength, dest);
+    }
+
+    dest.Resize(dataLength);
+    unsigned char* out = dest.Buffer();
+    for (unsigned i = 0; i < dataLength; ++i) {
+        if (data[i] == '%') {
+            int high = i + 2 < dataLength ? GetHexValue(data[i + 1]) : -1;
+            int low = i + 2 < dataLength ? GetHexValue(data[i + 2]) : -1;
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            *out++ = (unsigned char)(high << 4 | low);
+            i += 2;
+        } else {
+            *out++ = (unsigned char)data[i];
+        }
+    }
+    dest.Resize((unsigned)(out - dest.Buffer()));
+    return true;
+}
+
+bool DynamicResourceCache::LoadResource(const String& filename, const char* content, int size, const ResourceHandler& handler, const String& hash)
+{
+    auto* cache = GetSubsystem<ResourceCache>();
+    Resource* existing = handler.type_ != StringHash() ? cache->GetExistingResource(handler.type_, filename) : nullptr;
+    if (existing) {
+        existing->SendEvent(E_RELOADSTARTED);
+    }
+
+    HiresTimer timer;
+    bool loaded;
+    if (handler.function_) {
+        loaded = (this->*handler.function_)(filename, content, size);
+    } else {
+        loaded = AddResource(handler.type_, filename, content, size);
+    }
+    RecordLoad(handler.type_, size, loaded, 0, timer.GetUSec(false));
+    UpdateResourceGraph(filename, handler.type_, hash, loaded, existing != nullptr);
+    NotifyIngestWaiters(filename, loaded);
+    return loaded;
+}
+
+void DynamicResourceCache::CoalesceIngest(const String& filename, const char* content, int size)
+{
+    CoalescedIngest* ingest;
+    auto index = coalescedIngestIndex_.Find(filename);
+    if (index == coalescedIngestIndex_.End()) {
+        coalescedIngestIndex_[filename] = coalescedIngests_.Size();
+        coalescedIngests_.Resize(coalescedIngests_.Size() + 1);
+        ingest = &coalescedIngests_.Back();
+        ingest->filename_ = filename;
+    } else {
+        ingest = &coalescedIngests_[index->second_];
+        ++stats_.numCoalescedIngests_;
+        LOGRESOURCEINFOF("Payload of %s replaced by a newer one before loading", filename.CString());
+    }
+
+    // The caller's buffer is not valid anymore by the next update
+    if (ingest->data_.Capacity() < (unsigned)size) {
+        bufferPool_.Acquire(ingest->data_, (unsigned)size);
+    }
+    ingest->data_.Resize((unsigned)size);
+    if (size) {
+        memcpy(ingest->data_.Buffer(), content, (size_t)size);
+    }
+    ++ingest->calls_;
+}
+
+void DynamicResourceCache::FlushCoalescedIngests()
+{
+    if (coalescedIngests_.Empty()) {
+        return;
+    }
+
+    // Resources processed while flushing wait for the next update. Both vectors keep their capacity between updates
+    flushedIngests_.Swap(coalescedIngests_);
+    coalescedIngestIndex_.Clear();
+    for (auto it = flushedIngests_.Begin(); it != flushedIngests_.End(); ++it) {
+        if (!it->filename_.Empty()) {
+            // The latest call gets its callback from the load itself
+            if (it->calls_ > 1) {
+                ingestWaiters_[it->filename_] += it->calls_ - 1;
+            }
+            IngestResource(it->filename_, (const char*)it->data_.Buffer(), it->data_.Size());
+        }
+        bufferPool_.Release(it->data_);
+    }
+    flushedIngests_.Clear();
+}
+
+void DynamicResourceCache::NotifyIngestWaiters(const String& filename, bool success)
+{
+    auto waiters = ingestWaiters_.Find(filename);
+    if (waiters == ingestWaiters_.End()) {
+        return;
+    }
+
+#ifdef __EMSCRIPTEN__
+    val module = val::global("Module");
+    for (unsigned i = 0; i < waiters->second_; ++i) {
+        module.call<void>(success ? "FileLoaded" : "FileLoadFailed", val(filename.CString()));
+    }
+#endif
+    ingestWaiters_.Erase(waiters);
+}
+
+const String& DynamicResourceCache::InternName(const char* name, String& storage) const
+{
+    // Only registered resources are interned, unknown names and hash collisions are copied into the caller's storage
+    auto it = internedNames_.Find(StringHash(name));
+    if (it != internedNames_.End() && it->second_ == name) {
+        return it->second_;
+    }
+    storage = name;
+    return storage;
+}
+
+DynamicResourceInfo& DynamicResourceCache::RegisterResourceInfo(const String& filename)
+{
+    auto it = dynamicResources_.Find(filename);
+    if (it == dynamicResources_.End()) {
+        it = dynamicResources_.Insert(MakePair(filename, DynamicResourceInfo()));
+        // On a hash collision the first name keeps the slot
+        StringHash hash(filename);
+        if (!internedNames_.Contains(hash)) {
+            internedNames_[hash] = filename;
+        }
+    }
+    return it->second_;
+}
+
+unsigned DynamicResourceCache::ProcessResourceBatch(const String& manifest, const void* data, unsigned size)
+{
+    SharedPtr<JSONFile> json(new JSONFile(context_));
+    if (!json->FromString(manifest) || !json->GetRoot().IsArray()) {
+        URHO3D_LOGERROR("Resource batch manifest is not a JSON array");
+        return 0;
+    }
+
+    // The whole manifest is validated before anything is processed
+    const JSONArray& entries = json->GetRoot().GetArray();
+    StringVector names;
+    HashMap<String, Pair<unsigned, unsigned> > ranges;
+    for (auto it = entries.Begin(); it != entries.End(); ++it) {
+        const String& name = it->Get("name").GetString();
+        unsigned offset = it->Get("offset").GetUInt();
+        unsigned length = it->Get("size").GetUInt();
+        if (name.Empty() || offset > size || length > size - offset) {
+            URHO3D_LOGERRORF("Invalid resource batch manifest entry %s", name.CString());
+            return 0;
+        }
+        if (!ranges.Contains(name)) {
+            names.Push(name);
+        }
+        ranges[name] = MakePair(offset, length);
+    }
+
+    // Compressed entries are added under their decompressed name, which must not collide with another entry
+    HashMap<String, String> sources;
+    for (auto it = names.Begin(); it != names.End(); ++it) {
+        String name = GetDecompressedName(*it);
+        if (sources.Contains(name)) {
+            URHO3D_LOGERRORF("Resource batch entries %s and %s both add %s, resource batch is discarded", sources[name].CString(),
+                it->CString(), name.CString());
+            return 0;
+        }
+        sources[name] = *it;
+        *it = name;
+    }
+    Sort(names.Begin(), names.End(), CompareIngestOrder);
+
+    SharedPtr<ResourceBatch> batch(new ResourceBatch());
+    batch->id_ = nextBatchId_++;
+    bufferPool_.Acquire(batch->data_, size);
+    batch->data_.Resize(size);
+    memcpy(batch->data_.Buffer(), data, size);
+
+    // Every uncompressed resource needs a handler before anything is queued, compressed ones are checked once decompressed
+    for (auto it = names.Begin(); it != names.End(); ++it) {
+        const String& source = sources[*it];
+        const Pair<unsigned, unsigned>& range = ranges[source];
+        BatchResource resource;
+        resource.filename_ = *it;
+        resource.content_ = (const char*)batch->data_.Buffer() + range.first_;
+        resource.size_ = range.second_;
+        resource.compression_ = GetPayloadCompression(source, resource.content_, resource.size_);
+        if (resource.compression_ != COMPRESSION_NONE) {
+            batch->resources_.Push(resource);
+            continue;
+        }
+        if (!GetResourceHandler(resource.filename_, resource.content_, resource.size_, resource.handler_)) {
+            URHO3D_LOGERRORF("Unable to process file %s, no handler implemented, resource batch is discarded", it->CString());
+            ++stats_.numUnhandled_;
+            bufferPool_.Release(batch->data_);
+            return 0;
+        }
+        if (resource.handler_.type_ == XMLFile::GetTypeStatic()) {
+            resource.handler_.type_ = GetXMLResourceType(resource.content_, resource.size_);
+        }
+        resource.hash_ = PersistentResourceStore::ComputeHash(resource.content_, resource.size_);
+        resource.staged_ = true;
+        batch->resources_.Push(resource);
+    }
+
+    // Nothing is registered or stored until the batch is committed, so a discarded batch leaves no trace. Compressed
+    // entries are decompressed on the worker threads and staged in CommitBatches() when they are ready
+    for (auto it = batch->resources_.Begin(); it != batch->resources_.End(); ++it) {
+        if (!it->staged_) {
+            it->decompression_ = StartDecompression(it->filename_, it->content_, it->size_, it->compression_, String::EMPTY, false);
+        } else if (it->handler_.async_) {
+            it->item_ = QueueAsyncIngest(it->filename_, it->content_, it->size_, it->handler_.type_, it->hash_, true);
+        }
+        ++pendingIngestCounts_[it->filename_];
+    }
+
+    pendingBatches_.Push(batch);
+    URHO3D_LOGINFOF("Processing resource batch %d with %d resources and %d bytes", batch->id_, names.Size(), size);
+    return batch->id_;
+}
+
+void DynamicResourceCache::CommitBatches()
+{
+    // Entries of every pending batch are staged as soon as they are decompressed, so that they are decoded meanwhile
+    for (auto it = pendingBatches_.Begin(); it != pendingBatches_.End(); ++it) {
+        for (auto resource = (*it)->resources_.Begin(); resource != (*it)->resources_.End(); ++resource) {
+            if (!resource->staged_ && resource->decompression_->workItem_->completed_) {
+                StageDecompressedResource(*it, *resource);
+            }
+        }
+    }
+
+    while (!pendingBatches_.Empty()) {
+        SharedPtr<ResourceBatch> batch = pendingBatches_.Front();
+        for (auto it = batch->resources_.Begin(); it != batch->resources_.End(); ++it) {
+            if (!it->staged_ || (it->item_ && !it->item_->workItem_->completed_)) {
+                return;
+            }
+        }
+
+        pendingBatches_.PopFront();
+        CommitBatch(batch);
+        for (auto it = batch->resources_.Begin(); it != batch->resources_.End(); ++it) {
+            if (it->decompression_) {
+                bufferPool_.Release(it->decompression_->data_);
+            }
+        }
+        bufferPool_.Release(batch->data_);
+    }
+}
+
+void DynamicResourceCache::StageDecompressedResource(ResourceBatch* batch, BatchResource& resource)
+{
+    CompressedPayloadItem* item = resource.decompression_;
+    resource.staged_ = true;
+    stats_.decompressTime_ += item->time_;
+    unsigned compressedSize = item->compressed_.Size();
+    bufferPool_.Release(item->compressed_);
+    if (!item->success_) {
+        URHO3D_LOGERRORF("Failed to decompress %s, resource batch %d is discarded: %s", resource.filename_.CString(), batch->id_,
+            item->error_.CString());
+        ++stats_.numDecompressFailed_;
+        resource.failed_ = true;
+        return;
+    }
+    ++stats_.numDecompressed_;
+    stats_.bytesCompressed_ += compressedSize;
+
+    resource.content_ = (const char*)item->data_.Buffer();
+    resource.size_ = item->data_.Size();
+    if (!GetResourceHandler(resource.filename_, resource.content_, resource.size_, resource.handler_)) {
+        URHO3D_LOGERRORF("Unable to process file %s, no handler implemented, resource batch %d is discarded", resource.filename_.CString(),
+            batch->id_);
+        ++stats_.numUnhandled_;
+        resource.failed_ = true;
+        return;
+    }
+    if (resource.handler_.type_ == XMLFile::GetTypeStatic()) {
+        resource.handler_.type_ = GetXMLResourceType(resource.content_, resource.size_);
+    }
+    resource.hash_ = PersistentResourceStore::ComputeHash(resource.content_, resource.size_);
+    if (resource.handler_.async_) {
+        resource.item_ = QueueAsyncIngest(resource.filename_, resource.content_, resource.size_, resource.handler_.type_, resource.hash_, true);
+    }
+}
+
+bool DynamicResourceCache::CommitBatchResource(const BatchResource& resource)
+{
+    const String& filename = resource.filename_;
+    StringHash type = resource.handler_.type_;
+    DynamicResourceInfo& info = RecordIngest(filename, resource.content_, resource.size_, resource.hash_);
+
+    Resource* existing = type != StringHash() ? GetSubsystem<ResourceCache>()->GetExistingResource(type, filename) : nullptr;
+    if (existing && !IsIngestPending(filename) && info.type_ == type && info.hash_ == resource.hash_) {
+        if (resource.item_) {
+            bufferPool_.Release(resource.item_->optimized_);
+        }
+        ReportUnchanged(filename);
+        return true;
+    }
+
+    info.lazy_ = false;
+    if (lazyStore_) {
+        lazyStore_->Remove(filename);
+    }
+    if (resource.item_) {
+        return FinishAsyncIngest(resource.item_);
+    }
+    return LoadResource(filename, resource.content_, resource.size_, resource.handler_, resource.hash_);
+}
+
+void DynamicResourceCache::CommitBatch(ResourceBatch* batch)
+{
+    unsigned numResources = batch->resources_.Size();
+    unsigned numFailed = 0;
+    for (auto it = batch->resources_.Begin(); it != batch->resources_.End(); ++it) {
+        if (it->removed_) {
+            if (it->item_) {
+                bufferPool_.Release(it->item_->optimized_);
+            }
+            --numResources;
+        } else {
+            RemovePendingIngest(it->filename_);
+        }
+    }
+
+    // Everything that can fail without side effects is done first, decoding on the worker threads and EndLoad() of the
+    // staged resources, so that a failure discards the batch before anything is registered, stored or replaced
+    for (auto it = batch->resources_.Begin(); it != batch->resources_.End(); ++it) {
+        if (it->removed_) {
+            continue;
+        }
+        if (it->failed_) {
+            ++numFailed;
+            continue;
+        }
+        AsyncIngestItem* item = it->item_;
+        if (!item) {
+            continue;
+        }
+        if (item->success_ && item->resource_) {
+            item->success_ = item->resource_->EndLoad();
+            item->resource_->SetAsyncLoadState(ASYNC_DONE);
+            item->loadEnded_ = true;
+        }
+        if (!item->success_) {
+            URHO3D_LOGERRORF("Failed to decode %s, resource batch %d is discarded", item->filename_.CString(), batch->id_);
+            ++numFailed;
+        }
+    }
+
+    if (numFailed) {
+        for (auto it = batch->resources_.Begin(); it != batch->resources_.End(); ++it) {
+            if (it->item_) {
+                bufferPool_.Release(it->item_->optimized_);
+            }
+        }
+    } else {
+        // Staged resources go first, the synchronous ones are scripts and other resources without an asynchronous handler
+        // that may use them. Texture uploads and synchronous loads can still fail, these are counted but can't be undone
+        for (auto it = batch->resources_.Begin(); it != batch->resources_.End(); ++it) {
+            if (!it->removed_ && it->item_ && !CommitBatchResource(*it)) {
+                ++numFailed;
+            }
+        }
+        for (auto it = batch->resources_.Begin(); it != batch->resources_.End(); ++it) {
+            if (!it->removed_ && !it->item_ && !CommitBatchResource(*it)) {
+                ++numFailed;
+            }
+        }
+    }
+
+    URHO3D_LOGINFOF("Committed resource batch %d with %d resources, %d failed", batch->id_, numResources, numFailed);
+
+    using namespace DynamicResourceBatchLoaded;
+    VariantMap& data = GetEventDataMap();
+    data[P_BATCHID] = batch->id_;
+    data[P_SUCCESS] = numFailed == 0;
+    data[P_NUMRESOURCES] = numResources;
+    data[P_NUMFAILED] = numFailed;
+    data[P_TOTALTIME] = batch->timer_.GetUSec(false) / 1000.0f;
+    SendEvent(E_DYNAMICRESOURCEBATCHLOADED, data);
+
+#ifdef __EMSCRIPTEN__
+    val module = val::global("Module");
+    module.call<void>("BatchLoaded", val(batch->id_), val(numFailed == 0));
+#endif
+}
+
+void DynamicResourceCache::RegisterResourceExtension(const String& extension, StringHash type)
+{
+    // Types with a built-in handler keep using it
+    ResourceHandler handler;
+    handler.type_ = type;
+    handler.async_ = true;
+    for (auto it = handlers_.Begin(); it != handlers_.End(); ++it) {
+        if (it->second_.type_ == type) {
+            handler = it->second_;
+            break;
+        }
+    }
+    handlers_[StringHash(extension.ToLower())] = handler;
+}
+
+void DynamicResourceCache::RegisterResourceMagic(const String& magic, StringHash type)
+{
+    ResourceHandler handler;
+    handler.type_ = type;
+    handler.async_ = true;
+    for (auto it = handlers_.Begin(); it != handlers_.End(); ++it) {
+        if (it->second_.type_ == type) {
+            handler = it->second_;
+            break;
+        }
+    }
+
+    for (auto it = magicHandlers_.Begin(); it != magicHandlers_.End(); ++it) {
+        if (it->first_ == magic) {
+            it->second_ = handler;
+            return;
+        }
+    }
+    magicHandlers_.Push(MakePair(magic, handler));
+}
+
+void DynamicResourceCache::RegisterXMLRootType(const String& rootName, StringHash type)
+{
+    xmlRootTypes_[StringHash(rootName)] = type;
+}
+
+void DynamicResourceCache::UnregisterResourceExtension(const String& extension)
+{
+    handlers_.Erase(StringHash(extension.ToLower()));
+}
+
+void DynamicResourceCache::RegisterHandler(const String& extension, StringHash type, ResourceHandlerFunction function, bool async)
+{
+    ResourceHandler& handler = handlers_[StringHash(extension)];
+    handler.type_ = type;
+    handler.function_ = function;
+    handler.async_ = async;
+}
+
+bool DynamicResourceCache::GetResourceHandler(const String& filename, const char* content, int size, ResourceHandler& handler) const
+{
+    auto it = handlers_.Find(GetExtensionHash(filename));
+    if (it != handlers_.End()) {
+        handler = it->second_;
+        return true;
+    }
+
+    for (auto it = magicHandlers_.Begin(); it != magicHandlers_.End(); ++it) {
+        const String& magic = it->first_;
+        if ((unsigned)size >= magic.Length() && !memcmp(content, magic.CString(), magic.Length())) {
+            handler = it->second_;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+StringHash DynamicResourceCache::GetXMLResourceType(const char* content, int size) const
+{
+    static const StringHash materialRoot("material");
+    static const StringHash techniqueRoot("technique");
+    StringHash rootName = GetXMLRootHash(content, size);
+    if (rootName == materialRoot) {
+        return Material::GetTypeStatic();
+    } else if (rootName == techniqueRoot) {
+        return Technique::GetTypeStatic();
+    }
+
+    auto it = xmlRootTypes_.Find(rootName);
+    return it != xmlRootTypes_.End() ? it->second_ : XMLFile::GetTypeStatic();
+}
+
+bool DynamicResourceCache::AddResource(StringHash type, const String& filename, const char* content, int size)
+{
+    auto* cache = GetSubsystem<ResourceCache>();
+    SharedPtr<Resource> file(cache->GetExistingResource(type, filename));
+    if (!file) {
+        file = DynamicCast<Resource>(context_->CreateObject(type));
+        if (!file) {
+            URHO3D_LOGERRORF("Unable to process file %s, resource type is not registered", filename.CString());
+#ifdef __EMSCRIPTEN__
+            val module = val::global("Module");
+            module.call<void>("FileLoadFailed", val(filename.CString()));
+#endif
+            return false;
+        }
+        file->SetName(filename);
+        cache->AddManualResource(file);
+        LOGRESOURCEINFOF("Creating new manual %s resource %s", file->GetTypeName().CString(), filename.CString());
+    }
+
+    MemoryBuffer buffer(content, size);
+    buffer.SetName(filename);
+    bool loaded = file->Load(buffer);
+
+#ifdef __EMSCRIPTEN__
+    if (loaded) {
+        val module = val::global("Module");
+        module.call<void>("FileLoaded", val(filename.CString()));
+    } else {
+        val module = val::global("Module");
+        module.call<void>("FileLoadFailed", val(filename.CString()));
+    }
+#endif
+
+    return loaded;
+}
+
+bool DynamicResourceCache::AddJavaScriptFile(const String& filename, const char* content, int size)
+{
+#ifdef __EMSCRIPTEN__
+    emscripten_run_script(std::string(content, size).c_str());
+    val module = val::global("Module");
+    module.call<void>("FileLoaded", val(filename.CString()));
+    return true;
+#else
+    URHO3D_LOGERRORF("Unable to run %s, JavaScript is only supported in web builds", filename.CString());
+    return false;
+#endif
+}
+
+bool DynamicResourceCache::DeferResource(const String& filename, const char* content, int size, StringHash type, const String& hash)
+{
+    // The ResourceCache reads the payload through the router of the persistent store or of the session store
+    if (store_) {
+        if (store_->GetHash(filename) != hash) {
+            return false;
+        }
+    } else if ((!lazyStore_ && !OpenLazyStore()) || lazyStore_->Store(filename, content, size, hash).Empty()) {
+        return false;
+    }
+
+    DynamicResourceInfo& info = RegisterResourceInfo(filename);
+    info.type_ = type;
+    info.hash_ = hash;
+    info.lazy_ = true;
+    ++stats_.numDeferred_;
+    LOGRESOURCEINFOF("Registered resource %s for loading on first request", filename.CString());
+
+#ifdef __EMSCRIPTEN__
+    val module = val::global("Module");
+    module.call<void>("FileLoaded", val(filename.CString()));
+#endif
+    NotifyIngestWaiters(filename, true);
+
+    return true;
+}
+
+bool DynamicResourceCache::OpenLazyStore()
+{
+    // Every instance has its own directory, other processes and instances may be using theirs. A directory left behind
+    // by a process that has exited is reused when its process id comes up again
+#ifdef _WIN32
+    int processId = _getpid();
+#else
+    int processId = getpid();
+#endif
+    auto* fileSystem = GetSubsystem<FileSystem>();
+    String directory = fileSystem->GetAppPreferencesDir("urho3d", "DynamicResourceCacheSession") +
+        ToString("%d_%u/", processId, numSessionStores++);
+
+    // Payloads registered in a previous session are not valid anymore
+    StringVector files;
+    fileSystem->ScanDir(files, directory, "*", SCAN_FILES, false);
+    for (auto it = files.Begin(); it != files.End(); ++it) {
+        fileSystem->Delete(directory + *it);
+    }
+
+    SharedPtr<PersistentResourceStore> store(new PersistentResourceStore(context_));
+    if (!store->Open(directory)) {
+        return false;
+    }
+
+    auto* cache = GetSubsystem<ResourceCache>();
+    cache->AddResourceDir(store->GetDirectory());
+    cache->AddResourceRouter(store);
+    lazyStore_ = store;
+    return true;
+}
+
+void DynamicResourceCache::CloseLazyStore()
+{
+    if (!lazyStore_) {
+        return;
+    }
+
+    // Payloads still being written would be left behind
+    lazyStore_->FinishWrites(true);
+    // Either subsystem may be gone already when the context is being destroyed
+    if (auto* cache = GetSubsystem<ResourceCache>()) {
+        cache->RemoveResourceRouter(lazyStore_);
+        cache->RemoveResourceDir(lazyStore_->GetDirectory());
+    }
+    if (auto* fileSystem = GetSubsystem<FileSystem>()) {
+        StringVector files;
+        fileSystem->ScanDir(files, lazyStore_->GetDirectory(), "*", SCAN_FILES, false);
+        for (auto it = files.Begin(); it != files.End(); ++it) {
+            fileSystem->Delete(lazyStore_->GetDirectory() + *it);
+        }
+    }
+    lazyStore_.Reset();
+}
+
+unsigned DynamicResourceCache::PrefetchResources(const StringVector& names)
+{
+    auto* cache = GetSubsystem<ResourceCache>();
+    unsigned count = 0;
+    for (auto it = names.Begin(); it != names.End(); ++it) {
+        auto info = dynamicResources_.Find(*it);
+        if (info != dynamicResources_.End() && info->second_.lazy_ && !cache->GetExistingResource(info->second_.type_, *it) &&
+            cache->BackgroundLoadResource(info->second_.type_, *it)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+unsigned DynamicResourceCache::PrefetchNodeResources(Node* node)
+{
+    if (!node) {
+        return 0;
+    }
+
+    // Resources are referred to through resource reference attributes
+    StringVector names;
+    PODVector<Node*> nodes;
+    node->GetChildren(nodes, true);
+    nodes.Push(node);
+    for (auto it = nodes.Begin(); it != nodes.End(); ++it) {
+        const Vector<SharedPtr<Component> >& components = (*it)->GetComponents();
+        for (auto it2 = components.Begin(); it2 != components.End(); ++it2) {
+            Component* component = *it2;
+            unsigned numAttributes = component->GetNumAttributes();
+            for (unsigned i = 0; i < numAttributes; ++i) {
+                Variant value = component->GetAttribute(i);
+                if (value.GetType() == VAR_RESOURCEREF) {
+                    names.Push(value.GetResourceRef().name_);
+                } else if (value.GetType() == VAR_RESOURCEREFLIST) {
+                    const StringVector& listNames = value.GetResourceRefList().names_;
+                    names.Push(listNames);
+                }
+            }
+        }
+    }
+
+    return PrefetchResources(names);
+}
+
+void DynamicResourceCache::QueueDecompression(const String& filename, const char* content, int size, PayloadCompression compression, bool startScript,
+    const String& hash)
+{
+    SharedPtr<CompressedPayloadItem> item = StartDecompression(GetDecompressedName(filename), content, size, compression, hash, startScript);
+    pendingDecompressions_.Push(item);
+}
+
+SharedPtr<CompressedPayloadItem> DynamicResourceCache::StartDecompression(const String& filename, const char* content, int size,
+    PayloadCompression compression, const String& hash, bool startScript)
+{
+    SharedPtr<CompressedPayloadItem> item(new CompressedPayloadItem());
+    item->filename_ = filename;
+    // The pool is not thread-safe, the output is taken here when the payload stores its size
+    bufferPool_.Acquire(item->compressed_, size);
+    bufferPool_.Acquire(item->data_, GetDecompressedSize(compression, content, size));
+    item->compressed_.Resize(size);
+    memcpy(item->compressed_.Buffer(), content, size);
+    item->compression_ = compression;
+    item->startScript_ = startScript;
+    item->hash_ = hash;
+
+    SharedPtr<OwnedWorkItem> workItem(new OwnedWorkItem());
+    workItem->workFunction_ = DecompressPayloadWork;
+    workItem->aux_ = item.Get();
+    item->workItem_ = workItem;
+    GetSubsystem<WorkQueue>()->AddWorkItem(workItem);
+    return item;
+}
+
+void DynamicResourceCache::FinishDecompressions()
+{
+    // Processed in queue order so that the latest payload of the same resource is the one that stays
+    while (!pendingDecompressions_.Empty() && pendingDecompressions_.Front()->workItem_->completed_) {
+        SharedPtr<CompressedPayloadItem> item = pendingDecompressions_.Front();
+        pendingDecompressions_.PopFront();
+        stats_.decompressTime_ += item->time_;
+        ProcessDecompressed(item);
+        bufferPool_.Release(item->compressed_);
+        bufferPool_.Release(item->data_);
+    }
+}
+
+void DynamicResourceCache::ProcessDecompressed(CompressedPayloadItem* item)
+{
+    if (item->superseded_) {
+        return;
+    }
+
+    if (!item->success_) {
+        URHO3D_LOGERRORF("Unable to process file %s, %s decompression failed: %s", item->filename_.CString(),
+            GetPayloadCompressionName(item->compression_), item->error_.CString());
+        ++stats_.numDecompressFailed_;
+#ifdef __EMSCRIPTEN__
+        val module = val::global("Module");
+        module.call<void>("FileLoadFailed", val(item->filename_.CString()));
+#endif
+        NotifyIngestWaiters(item->filename_, false);
+        return;
+    }
+
+    ++stats_.numDecompressed_;
+    stats_.bytesCompressed_ += item->compressed_.Size();
+    LOGRESOURCEINFOF("Decompressed %s resource %s, %d -> %d bytes", GetPayloadCompressionName(item->compression_),
+        item->filename_.CString(), item->compressed_.Size(), item->data_.Size());
+    IngestResource(item->filename_, (const char*)item->data_.Buffer(), item->data_.Size());
+    if (item->startScript_) {
+        StartSingleScript(item->filename_);
+    }
+}
+
+SharedPtr<AsyncIngestItem> DynamicResourceCache::QueueAsyncIngest(const String& filename, const char* content, int size,
+    StringHash type, const String& hash, bool batched)
+{
+    // Resources which are already in use are decoded into a new instance too, which replaces the cached one when it is
+    // finished. Only textures are updated in place, their image is uploaded into the existing texture
+    SharedPtr<AsyncIngestItem> item(new AsyncIngestItem());
+    item->filename_ = filename;
+    if (batched) {
+        // Payloads of a batch stay in the batch data or its decompressed entries, which outlive the items as the batch is
+        // committed after all of them
+        item->payload_ = (const unsigned char*)content;
+    } else {
+        bufferPool_.Acquire(item->copy_, size);
+        item->copy_.Resize(size);
+        memcpy(item->copy_.Buffer(), content, size);
+        item->payload_ = item->copy_.Buffer();
+    }
+    item->size_ = size;
+    item->type_ = type;
+    item->hash_ = hash;
+    if (type == Texture2D::GetTypeStatic()) {
+        item->image_ = new Image(context_);
+        item->image_->SetName(filename);
+        item->progressive_ = progressiveTextures_ && GetSubsystem<Graphics>();
+    } else {
+        item->resource_ = DynamicCast<Resource>(context_->CreateObject(type));
+        if (!item->resource_) {
+            bufferPool_.Release(item->copy_);
+            return SharedPtr<AsyncIngestItem>();
+        }
+        item->resource_->SetName(filename);
+        item->resource_->SetAsyncLoadState(ASYNC_LOADING);
+    }
+    if (modelOptimization_ && type == Model::GetTypeStatic()) {
+        item->optimizeModel_ = true;
+        item->modelSettings_ = modelSettings_;
+        // The pool is not thread-safe, generated LOD levels may still grow the buffer on the worker
+        bufferPool_.Acquire(item->optimized_, size);
+    }
+
+    SharedPtr<OwnedWorkItem> workItem(new OwnedWorkItem());
+    workItem->workFunction_ = IngestResourceWork;
+    workItem->aux_ = item.Get();
+    item->workItem_ = workItem;
+    if (!batched) {
+        pendingIngests_.Push(item);
+        ++pendingIngestCounts_[filename];
+    }
+    GetSubsystem<WorkQueue>()->AddWorkItem(workItem);
+
+    item->mainThreadTime_ = item->timer_.GetUSec(false);
+    return item;
+}
+
+void DynamicResourceCache::FinishAsyncIngests()
+{
+    HiresTimer frameTimer;
+    long long budget = (long long)finishLoadTimeBudget_ * 1000;
+
+    // Finish in queue order so that the latest payload of the same resource is the one that stays
+    while (!pendingIngests_.Empty() && pendingIngests_.Front()->workItem_->completed_) {
+        SharedPtr<AsyncIngestItem> item = pendingIngests_.Front();
+        pendingIngests_.PopFront();
+        RemovePendingIngest(item->filename_);
+
+        HiresTimer timer;
+        bool success = FinishAsyncIngest(item);
+        bufferPool_.Release(item->copy_);
+        item->mainThreadTime_ += timer.GetUSec(false);
+
+        using namespace DynamicResourceLoaded;
+        VariantMap& data = GetEventDataMap();
+        data[P_RESOURCENAME] = item->filename_;
+        data[P_SUCCESS] = success;
+        data[P_TOTALTIME] = item->timer_.GetUSec(false) / 1000.0f;
+        data[P_MAINTHREADTIME] = item->mainThreadTime_ / 1000.0f;
+        SendEvent(E_DYNAMICRESOURCELOADED, data);
+
+        // At least one resource is finished every frame regardless of the budget
+        if (frameTimer.GetUSec(false) >= budget) {
+            break;
+        }
+    }
+}
+
+bool DynamicResourceCache::FinishAsyncIngest(AsyncIngestItem* item)
+{
+    HiresTimer timer;
+    auto* cache = GetSubsystem<ResourceCache>();
+    const String& filename = item->filename_;
+    bool loaded = item->success_;
+    bool reloaded = false;
+
+    if (item->optimizeModel_) {
+        RecordModelOptimization(filename, item->modelResult_, item->optimizeError_, item->optimizeTime_);
+        bufferPool_.Release(item->optimized_);
+    }
+
+    if (loaded && item->image_) {
+        SharedPtr<Texture2D> file = SharedPtr<Texture2D>(cache->GetExistingResource<Texture2D>(filename));
+        if (file) {
+            reloaded = true;
+            file->SendEvent(E_RELOADSTARTED);
+        } else {
+            file = SharedPtr<Texture2D>(new Texture2D(context_));
+            file->SetName(filename);
+            cache->AddManualResource(file);
+            LOGRESOURCEINFOF("Creating new manual Texture2D resource %s", filename.CString());
+        }
+        // In headless mode there is nothing to upload
+        if (GetSubsystem<Graphics>()) {
+            loaded = item->progressive_ ? StartProgressiveTexture(file, item) : file->SetData(item->image_);
+        }
+    } else if (loaded) {
+        if (!item->loadEnded_) {
+            loaded = item->resource_->EndLoad();
+            item->resource_->SetAsyncLoadState(ASYNC_DONE);
+        }
+
+        // A resource in use is swapped for the new instance. Dependents are refreshed to pick it up, like the full texture
+        // of a progressive upload
+        if (loaded) {
+            reloaded = cache->GetExistingResource(item->type_, filename) != nullptr;
+            cache->AddManualResource(item->resource_);
+            LOGRESOURCEINFOF("%s manual %s resource %s", reloaded ? "Replacing" : "Creating new", item->resource_->GetTypeName().CString(),
+                filename.CString());
+        }
+    }
+
+    if (!loaded) {
+        URHO3D_LOGERRORF("Failed to load resource %s asynchronously", filename.CString());
+    }
+    RecordLoad(item->type_, item->size_, loaded, item->parseTime_, timer.GetUSec(false));
+    UpdateResourceGraph(filename, item->type_, item->hash_, loaded, reloaded);
+
+#ifdef __EMSCRIPTEN__
+    if (loaded) {
+        val module = val::global("Module");
+        module.call<void>("FileLoaded", val(filename.CString()));
+    } else {
+        val module = val::global("Module");
+        module.call<void>("FileLoadFailed", val(filename.CString()));
+    }
+#endif
+    NotifyIngestWaiters(filename, loaded);
+
+    return loaded;
+}
+
+bool DynamicResourceCache::StartProgressiveTexture(Texture2D* texture, AsyncIngestItem* item)
+{
+    // A newer payload replaces the one still uploading
+    CancelProgressiveTexture(item->filename_);
+
+    Image* image = item->image_;
+    bool compressed = image->IsCompressed();
+    unsigned format = compressed ? GetSubsystem<Graphics>()->GetFormat(image->GetCompressedFormat()) : GetImageFormat(image->GetComponents());
+    unsigned numLevels = compressed ? image->GetNumCompressedLevels() : item->mipLevels_.Size();
+
+    // The first level that fits the tail size becomes the placeholder together with the levels below it
+    unsigned tail = 0;
+    for (; tail + 1 < numLevels; ++tail) {
+        int width = compressed ? image->GetCompressedLevel(tail).width_ : item->mipLevels_[tail]->GetWidth();
+        int height = compressed ? image->GetCompressedLevel(tail).height_ : item->mipLevels_[tail]->GetHeight();
+        if (Max(width, height) <= progressiveTextureTailSize_) {
+            break;
+        }
+    }
+    // Small textures and formats the GPU can't take directly are uploaded at once
+    if (!format || !tail) {
+        return texture->SetData(image);
+    }
+
+    SharedPtr<ProgressiveTexture> upload(new ProgressiveTexture());
+    upload->filename_ = item->filename_;
+    upload->hash_ = item->hash_;
+    upload->placeholder_ = texture;
+    upload->image_ = image;
+    upload->levels_ = item->mipLevels_;
+    upload->level_ = tail - 1;
+    upload->texture_ = new Texture2D(context_);
+    upload->texture_->SetName(item->filename_);
+    upload->texture_->SetNumLevels(numLevels);
+    texture->SetNumLevels(numLevels - tail);
+    if (compressed) {
+        CompressedLevel level = image->GetCompressedLevel(tail);
+        if (!texture->SetSize(level.width_, level.height_, format) || !upload->texture_->SetSize(image->GetWidth(), image->GetHeight(), format)) {
+            return false;
+        }
+        for (unsigned i = tail; i < numLevels; ++i) {
+            level = image->GetCompressedLevel(i);
+            texture->SetData(i - tail, 0, 0, level.width_, level.height_, level.data_);
+        }
+    } else {
+        Image* level = item->mipLevels_[tail];
+        if (!texture->SetSize(level->GetWidth(), level->GetHeight(), format) || !upload->texture_->SetSize(image->GetWidth(), image->GetHeight(), format)) {
+            return false;
+        }
+        for (unsigned i = tail; i < numLevels; ++i) {
+            level = item->mipLevels_[i];
+            texture->SetData(i - tail, 0, 0, level->GetWidth(), level->GetHeight(), level->GetData());
+        }
+    }
+
+    progressiveUploads_.Push(upload);
+    ++stats_.numProgressiveTextures_;
+    LOGRESOURCEINFOF("Uploading texture %s progressively, %d of %d levels added", item->filename_.CString(), numLevels - tail, numLevels);
+    return true;
+}
+
+void DynamicResourceCache::UploadProgressiveTextures()
+{
+    // At least one upload is done per frame even if it alone exceeds the budget
+    unsigned uploaded = 0;
+    while (!progressiveUploads_.Empty() && uploaded < textureUploadBudget_) {
+        SharedPtr<ProgressiveTexture> upload = progressiveUploads_.Front();
+        if (!IsProgressiveTextureCurrent(upload)) {
+            progressiveUploads_.PopFront();
+            continue;
+        }
+        Image* image = upload->image_;
+        unsigned level = upload->level_;
+        int height;
+        bool success;
+        if (image->IsCompressed()) {
+            // Compressed levels are allocated by the upload, so they can't be split
+            CompressedLevel compressed = image->GetCompressedLevel(level);
+            height = compressed.height_;
+            success = upload->texture_->SetData(level, 0, 0, compressed.width_, height, compressed.data_);
+            uploaded += compressed.dataSize_;
+            upload->row_ = height;
+        } else {
+            // Level 0 is allocated when the texture is created and is the only one uploaded in parts
+            Image* levelImage = upload->levels_[level];
+            int width = levelImage->GetWidth();
+            height = levelImage->GetHeight();
+            unsigned rowSize = (unsigned)width * levelImage->GetComponents();
+            int rows = level ? height : Clamp((int)((textureUploadBudget_ - uploaded) / rowSize), 1, height - upload->row_);
+            success = upload->texture_->SetData(level, 0, upload->row_, width, rows, levelImage->GetData() + upload->row_ * rowSize);
+            uploaded += rows * rowSize;
+            upload->row_ += rows;
+        }
+
+        if (!success) {
+            URHO3D_LOGERRORF("Failed to upload level %d of texture %s, keeping the low levels", level, upload->filename_.CString());
+            progressiveUploads_.PopFront();
+            continue;
+        }
+        if (upload->row_ < height) {
+            continue;
+        }
+        upload->row_ = 0;
+        if (level) {
+            --upload->level_;
+            continue;
+        }
+
+        progressiveUploads_.PopFront();
+        FinishProgressiveTexture(upload);
+    }
+    stats_.progressiveUploadBytes_ += uploaded;
+}
+
+void DynamicResourceCache::FinishProgressiveTexture(ProgressiveTexture* upload)
+{
+    auto* cache = GetSubsystem<ResourceCache>();
+    Texture2D* placeholder = upload->placeholder_;
+    Texture2D* texture = upload->texture_;
+    if (cache->GetExistingResource<Texture2D>(upload->filename_) != placeholder || !IsProgressiveTextureCurrent(upload)) {
+        return;
+    }
+
+    // Sampler state may have been set on the placeholder meanwhile
+    texture->SetFilterMode(placeholder->GetFilterMode());
+    texture->SetAnisotropy(placeholder->GetAnisotropy());
+    texture->SetAddressMode(COORD_U, placeholder->GetAddressMode(COORD_U));
+    texture->SetAddressMode(COORD_V, placeholder->GetAddressMode(COORD_V));
+    texture->SetBorderColor(placeholder->GetBorderColor());
+    cache->ReleaseResource(Texture2D::GetTypeStatic(), upload->filename_, true);
+    cache->AddManualResource(texture);
+
+    // Every material still using the placeholder switches to the full texture, also those not added dynamically
+    PODVector<Resource*> materials;
+    cache->GetResources(materials, Material::GetTypeStatic());
+    for (auto it = materials.Begin(); it != materials.End(); ++it) {
+        auto* material = static_cast<Material*>(*it);
+        HashMap<TextureUnit, SharedPtr<Texture> > textures = material->GetTextures();
+        for (auto it2 = textures.Begin(); it2 != textures.End(); ++it2) {
+            if (it2->second_ == placeholder) {
+                material->SetTexture(it2->first_, texture);
+            }
+        }
+    }
+
+    LOGRESOURCEINFOF("Texture %s uploaded completely", upload->filename_.CString());
+    texture->SendEvent(E_RELOADFINISHED);
+}
+
+bool DynamicResourceCache::IsProgressiveTextureCurrent(const ProgressiveTexture* upload) const
+{
+    // Synchronous reloads such as a batch commit, a package mount or a store restore replace the placeholder's content
+    // in place, so only the hash tells that the upload is older
+    auto info = dynamicResources_.Find(upload->filename_);
+    return info != dynamicResources_.End() && info->second_.hash_ == upload->hash_;
+}
+
+void DynamicResourceCache::CancelProgressiveTexture(const String& filename)
+{
+    for (auto it = progressiveUploads_.Begin(); it != progressiveUploads_.End();) {
+        if ((*it)->filename_ == filename) {
+            it = progressiveUploads_.Erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+StringVector DynamicResourceCache::GetResourceDependents(const String& filename) const
+{
+    StringVector result;
+    auto it = dependents_.Find(filename);
+    if (it != dependents_.End()) {
+        for (auto it2 = it->second_.Begin(); it2 != it->second_.End(); ++it2) {
+            result.Push(*it2);
+        }
+    }
+    return result;
+}
+
+void DynamicResourceCache::UpdateResourceGraph(const String& filename, StringHash type, const String& hash, bool loaded, bool reloaded)
+{
+    DynamicResourceInfo& info = RegisterResourceInfo(filename);
+    info.type_ = type;
+    if (!loaded) {
+        // Resource is in an unknown state after a failed load, so the next payload is never skipped
+        info.hash_.Clear();
+        return;
+    }
+    info.hash_ = hash;
+
+    for (auto it = info.dependencies_.Begin(); it != info.dependencies_.End(); ++it) {
+        auto dependents = dependents_.Find(*it);
+        if (dependents != dependents_.End()) {
+            dependents->second_.Erase(filename);
+            if (dependents->second_.Empty()) {
+                dependents_.Erase(dependents);
+            }
+        }
+    }
+    info.dependencies_ = CollectDependencies(filename, type);
+    for (auto it = info.dependencies_.Begin(); it != info.dependencies_.End(); ++it) {
+        dependents_[*it].Insert(filename);
+    }
+    memoryBudgetDirty_ = true;
+    if (shaderPrecompile_) {
+        QueueShaderVariants(filename, type);
+    }
+
+    if (reloaded) {
+        if (Resource* resource = GetSubsystem<ResourceCache>()->GetExistingResource(type, filename)) {
+            resource->SendEvent(E_RELOADFINISHED);
+        }
+    }
+
+    // Reverse postorder puts every dependent after all the changed resources it refers to.
+    // A dependent queued earlier is moved back so that it is refreshed once, after this change
+    HashSet<String> visited;
+    StringVector order;
+    CollectDependents(filename, visited, order);
+    for (unsigned i = order.Size() - 1; i-- > 0;) {
+        pendingReloads_.Remove(order[i]);
+        pendingReloads_.Push(order[i]);
+    }
+}
+
+StringVector DynamicResourceCache::CollectDependencies(const String& filename, StringHash type) const
+{
+    auto* cache = GetSubsystem<ResourceCache>();
+    StringVector dependencies;
+
+    if (type == Material::GetTypeStatic()) {
+        auto* material = cache->GetExistingResource<Material>(filename);
+        if (material) {
+            for (unsigned i = 0; i < material->GetNumTechniques(); ++i) {
+                Technique* technique = material->GetTechnique(i);
+                if (technique && !dependencies.Contains(technique->GetName())) {
+                    dependencies.Push(technique->GetName());
+                }
+            }
+            const auto& textures = material->GetTextures();
+            for (auto it = textures.Begin(); it != textures.End(); ++it) {
+                if (it->second_ && !dependencies.Contains(it->second_->GetName())) {
+                    dependencies.Push(it->second_->GetName());
+                }
+            }
+        }
+    } else if (type == Technique::GetTypeStatic()) {
+        // Only GLSL shaders can be added dynamically
+        auto* technique = cache->GetExistingResource<Technique>(filename);
+        if (technique) {
+            PODVector<Pass*> passes = technique->GetPasses();
+            for (auto it = passes.Begin(); it != passes.End(); ++it) {
+                String vertexShader = "Shaders/GLSL/" + (*it)->GetVertexShader() + ".glsl";
+                String pixelShader = "Shaders/GLSL/" + (*it)->GetPixelShader() + ".glsl";
+                if (!dependencies.Contains(vertexShader)) {
+                    dependencies.Push(vertexShader);
+                }
+                if (!dependencies.Contains(pixelShader)) {
+                    dependencies.Push(pixelShader);
+                }
+            }
+        }
+    }
+
+    return dependencies;
+}
+
+void DynamicResourceCache::CollectDependents(const String& filename, HashSet<String>& visited, StringVector& order) const
+{
+    visited.Insert(filename);
+    auto it = dependents_.Find(filename);
+    if (it != dependents_.End()) {
+        for (auto it2 = it->second_.Begin(); it2 != it->second_.End(); ++it2) {
+            if (!visited.Contains(*it2)) {
+                CollectDependents(*it2, visited, order);
+            }
+        }
+    }
+    order.Push(filename);
+}
+
+void DynamicResourceCache::RecordLoad(StringHash type, unsigned size, bool loaded, long long parseTime, long long mainThreadTime)
+{
+    DynamicResourceTypeStats& typeStats = stats_.types_[type];
+    if (loaded) {
+        ++typeStats.numLoaded_;
+        typeStats.bytes_ += size;
+    } else {
+        ++typeStats.numFailed_;
+    }
+    typeStats.parseTime_ += parseTime;
+    typeStats.mainThreadTime_ += mainThreadTime;
+}
+
+float DynamicResourceCache::GetDownloadThroughput() const
+{
+    return stats_.downloadActiveTime_ > 0.0f ? (float)(stats_.bytesDownloaded_ / stats_.downloadActiveTime_) : 0.0f;
+}
+
+String DynamicResourceCache::GetStatsJSON() const
+{
+    JSONValue root;
+    root.Set("processed", stats_.numProcessed_);
+    root.Set("bytesProcessed", (double)stats_.bytesProcessed_);
+    root.Set("skipped", stats_.numSkipped_);
+    root.Set("coalesced", stats_.numCoalescedIngests_);
+    root.Set("unhandled", stats_.numUnhandled_);
+    root.Set("evicted", stats_.numEvicted_);
+    root.Set("memoryUse", (double)GetMemoryUse());
+
+    JSONValue downloads;
+    downloads.Set("completed", stats_.numDownloaded_);
+    downloads.Set("retries", stats_.numDownloadRetries_);
+    downloads.Set("failed", stats_.numDownloadsFailed_);
+    downloads.Set("coalesced", stats_.numCoalescedDownloads_);
+    downloads.Set("bytes", (double)stats_.bytesDownloaded_);
+    downloads.Set("rangeRequests", stats_.numRangeRequests_);
+    downloads.Set("resumedRequests", stats_.numResumedRequests_);
+    downloads.Set("bytesResumed", (double)stats_.bytesResumed_);
+    downloads.Set("totalTimeMs", stats_.downloadTime_ / 1000.0);
+    downloads.Set("throughput", GetDownloadThroughput());
+    root.Set("downloads", downloads);
+
+    JSONValue shaders;
+    shaders.Set("variants", stats_.numShaderVariants_);
+    shaders.Set("failed", stats_.numShaderVariantsFailed_);
+    shaders.Set("totalTimeMs", stats_.shaderVariantTime_ / 1000.0);
+    root.Set("shaders", shaders);
+
+    JSONValue decompression;
+    decompression.Set("completed", stats_.numDecompressed_);
+    decompression.Set("failed", stats_.numDecompressFailed_);
+    decompression.Set("bytesCompressed", (double)stats_.bytesCompressed_);
+    decompression.Set("totalTimeMs", stats_.decompressTime_ / 1000.0);
+    root.Set("decompression", decompression);
+
+    JSONValue textures;
+    textures.Set("progressive", stats_.numProgressiveTextures_);
+    textures.Set("uploadedBytes", (double)stats_.progressiveUploadBytes_);
+    root.Set("textures", textures);
+
+    JSONValue models;
+    models.Set("optimized", stats_.numOptimizedModels_);
+    models.Set("failed", stats_.numModelOptimizeFailed_);
+    models.Set("verticesRemoved", (double)stats_.modelVerticesRemoved_);
+    models.Set("acmrBefore", stats_.modelTriangles_ ? (double)stats_.modelCacheMissesBefore_ / stats_.modelTriangles_ : 0.0);
+    models.Set("acmrAfter", stats_.modelTriangles_ ? (double)stats_.modelCacheMissesAfter_ / stats_.modelTriangles_ : 0.0);
+    models.Set("lodLevels", stats_.numModelLodLevels_);
+    models.Set("totalTimeMs", stats_.modelOptimizeTime_ / 1000.0);
+    root.Set("models", models);
+
+    JSONValue buffers;
+    buffers.Set("acquired", bufferPool_.GetNumAcquired());
+    buffers.Set("reused", bufferPool_.GetNumReused());
+    buffers.Set("pooled", bufferPool_.GetNumBuffers());
+    buffers.Set("pooledBytes", (double)bufferPool_.GetPooledBytes());
+    buffers.Set("internedNames", internedNames_.Size());
+    root.Set("buffers", buffers);
+
+    JSONValue queues;
+    queues.Set("queuedDownloads", GetNumQueuedDownloads());
+    queues.Set("activeDownloads", GetNumActiveDownloads());
+    queues.Set("partialDownloads", GetNumPartialDownloads());
+    queues.Set("pendingDecompressions", GetNumPendingDecompressions());
+    queues.Set("pendingIngests", GetNumPendingIngests());
+    queues.Set("coalescedIngests", GetNumCoalescedIngests());
+    queues.Set("progressiveTextures", GetNumProgressiveTextures());
+    queues.Set("pendingBatches", GetNumPendingBatches());
+    queues.Set("pendingReloads", GetNumPendingReloads());
+    queues.Set("pendingShaderVariants", GetNumPendingShaderVariants());
+    root.Set("queues", queues);
+
+    // JavaScript files have no resource type
+    JSONValue types;
+    for (auto it = stats_.types_.Begin(); it != stats_.types_.End(); ++it) {
+        String typeName = it->first_ == StringHash() ? "None" : context_->GetTypeName(it->first_);
+        if (typeName.Empty()) {
+            typeName = it->first_.ToString();
+        }
+        JSONValue type;
+        type.Set("loaded", it->second_.numLoaded_);
+        type.Set("failed", it->second_.numFailed_);
+        type.Set("bytes", (double)it->second_.bytes_);
+        type.Set("parseTimeMs", it->second_.parseTime_ / 1000.0);
+        type.Set("mainThreadTimeMs", it->second_.mainThreadTime_ / 1000.0);
+        types.Set(typeName, type);
+    }
+    root.Set("types", types);
+
+    JSONFile file(context_);
+    file.GetRoot() = root;
+    return file.ToString();
+}
+
+bool DynamicResourceCache::RemoveResource(const String& filename)
+{
+    // Every call collapsed into a coalesced payload which is not loaded anymore fails
+    auto coalesced = coalescedIngestIndex_.Find(filename);
+    if (coalesced != coalescedIngestIndex_.End()) {
+        CoalescedIngest& ingest = coalescedIngests_[coalesced->second_];
+        ingestWaiters_[filename] += ingest.calls_;
+        NotifyIngestWaiters(filename, false);
+        ingest.filename_.Clear();
+        bufferPool_.Release(ingest.data_);
+        coalescedIngestIndex_.Erase(coalesced);
+    }
+    CancelProgressiveTexture(filename);
+    for (auto it = pendingDecompressions_.Begin(); it != pendingDecompressions_.End(); ++it) {
+        if ((*it)->filename_ == filename) {
+            (*it)->superseded_ = true;
+        }
+    }
+    // A pending asynchronous ingest would add the resource again when it finishes
+    for (auto it = pendingIngests_.Begin(); it != pendingIngests_.End();) {
+        AsyncIngestItem* item = *it;
+        if (item->filename_ != filename) {
+            ++it;
+            continue;
+        }
+        // A running item still reads its copy and may write the optimised model, these are freed with the item then
+        if (CancelWorkItem(GetSubsystem<WorkQueue>(), item->workItem_, item)) {
+            bufferPool_.Release(item->copy_);
+            if (item->optimizeModel_) {
+                bufferPool_.Release(item->optimized_);
+            }
+        }
+        RemovePendingIngest(filename);
+        it = pendingIngests_.Erase(it);
+        NotifyIngestWaiters(filename, false);
+    }
+    // Batches are still committed as a whole, only without the removed resource
+    for (auto it = pendingBatches_.Begin(); it != pendingBatches_.End(); ++it) {
+        for (auto resource = (*it)->resources_.Begin(); resource != (*it)->resources_.End(); ++resource) {
+            if (resource->filename_ == filename && !resource->removed_) {
+                resource->removed_ = true;
+                RemovePendingIngest(filename);
+            }
+        }
+    }
+    CancelResourceDownload(filename);
+
+    auto info = dynamicResources_.Find(filename);
+    if (info == dynamicResources_.End()) {
+        return false;
+    }
+
+    if (info->second_.type_ != StringHash()) {
+        GetSubsystem<ResourceCache>()->ReleaseResource(info->second_.type_, filename, true);
+    }
+    #ifdef URHO3D_ANGELSCRIPT
+    asScripts_.Erase(filename);
+    asStartFunctions_.Erase(filename);
+    pendingScripts_.Erase(filename);
+    #endif
+    #ifdef URHO3D_LUA
+    luaScripts_.Erase(filename);
+    ReleaseLuaStart(filename);
+    #endif
+
+    // Resources referring to this one keep their edges, they are refreshed if it is added again
+    for (auto it = info->second_.dependencies_.Begin(); it != info->second_.dependencies_.End(); ++it) {
+        auto dependents = dependents_.Find(*it);
+        if (dependents != dependents_.End()) {
+            dependents->second_.Erase(filename);
+            if (dependents->second_.Empty()) {
+                dependents_.Erase(dependents);
+            }
+        }
+    }
+    pendingReloads_.Remove(filename);
+    packageResources_.Erase(filename);
+    if (store_) {
+        store_->Remove(filename);
+    }
+    if (lazyStore_) {
+        lazyStore_->Remove(filename);
+    }
+    if (filename == contentName_) {
+        contentValid_ = false;
+    }
+    dynamicResources_.Erase(info);
+
+    LOGRESOURCEINFOF("Removed resource %s", filename.CString());
+    // Last, the name may be the interned copy
+    auto interned = internedNames_.Find(StringHash(filename));
+    if (interned != internedNames_.End() && interned->second_ == filename) {
+        internedNames_.Erase(interned);
+    }
+    return true;
+}
+
+unsigned DynamicResourceCache::RemoveResourcesByPrefix(const String& prefix)
+{
+    StringVector names;
+    for (auto it = dynamicResources_.Begin(); it != dynamicResources_.End(); ++it) {
+        if (it->first_.StartsWith(prefix)) {
+            names.Push(it->first_);
+        }
+    }
+    for (auto it = names.Begin(); it != names.End(); ++it) {
+        RemoveResource(*it);
+    }
+    return names.Size();
+}
+
+unsigned DynamicResourceCache::RemoveResourcesByType(StringHash type)
+{
+    StringVector names;
+    for (auto it = dynamicResources_.Begin(); it != dynamicResources_.End(); ++it) {
+        if (it->second_.type_ == type) {
+            names.Push(it->first_);
+        }
+    }
+    for (auto it = names.Begin(); it != names.End(); ++it) {
+        RemoveResource(*it);
+    }
+    return names.Size();
+}
+
+void DynamicResourceCache::SetMemoryBudget(unsigned long long budget)
+{
+    memoryBudget_ = budget;
+    memoryBudgetDirty_ = true;
+    memoryBudgetWarned_ = false;
+}
+
+unsigned long long DynamicResourceCache::GetMemoryUse() const
+{
+    auto* cache = GetSubsystem<ResourceCache>();
+    unsigned long long total = 0;
+    for (auto it = dynamicResources_.Begin(); it != dynamicResources_.End(); ++it) {
+        if (it->second_.type_ != StringHash()) {
+            if (Resource* resource = cache->GetExistingResource(it->second_.type_, it->first_)) {
+                total += resource->GetMemoryUse();
+            }
+        }
+    }
+    return total;
+}
+
+void DynamicResourceCache::CheckMemoryBudget()
+{
+    // Only loads grow the memory use, so the budget is checked after them
+    if (!memoryBudgetDirty_) {
+        return;
+    }
+    memoryBudgetDirty_ = false;
+    if (!memoryBudget_) {
+        return;
+    }
+
+    unsigned long long total = GetMemoryUse();
+    if (total <= memoryBudget_) {
+        memoryBudgetWarned_ = false;
+        return;
+    }
+
+    // Use timer of a resource is the time since it was last requested, and stays zero while something else refers to it
+    auto* cache = GetSubsystem<ResourceCache>();
+    Vector<Pair<unsigned, Resource*> > candidates;
+    for (auto it = dynamicResources_.Begin(); it != dynamicResources_.End(); ++it) {
+        if (it->second_.type_ == StringHash() || pendingReloads_.Contains(it->first_)) {
+            continue;
+        }
+        Resource* resource = cache->GetExistingResource(it->second_.type_, it->first_);
+        if (resource && resource->Refs() == 1 && CanReloadResource(it->first_)) {
+            candidates.Push(MakePair(resource->GetUseTimer(), resource));
+        }
+    }
+    Sort(candidates.Begin(), candidates.End(), CompareLeastRecentlyUsed);
+
+    // Evicted resources stay registered, the ResourceCache loads them again on demand from a store or a package it has
+    unsigned numEvicted = 0;
+    for (auto it = candidates.Begin(); it != candidates.End() && total > memoryBudget_; ++it) {
+        Resource* resource = it->second_;
+        String name = resource->GetName();
+        total -= resource->GetMemoryUse();
+        dynamicResources_[name].hash_.Clear();
+        cache->ReleaseResource(resource->GetType(), name, true);
+        ++numEvicted;
+        ++stats_.numEvicted_;
+    }
+
+    if (numEvicted) {
+        URHO3D_LOGINFOF("Evicted %d resources to meet the memory budget, %llu bytes in use", numEvicted, total);
+    }
+    if (total > memoryBudget_ && !memoryBudgetWarned_) {
+        URHO3D_LOGWARNINGF("Memory budget of %llu bytes is exceeded with %llu bytes in use, only unused resources kept in a "
+            "store or in a package of the ResourceCache can be released", memoryBudget_, total);
+        memoryBudgetWarned_ = true;
+    }
+}
+
+bool DynamicResourceCache::IsStored(const String& filename) const
+{
+    return (store_ && !store_->GetHash(filename).Empty()) || (lazyStore_ && !lazyStore_->GetHash(filename).Empty());
+}
+
+bool DynamicResourceCache::CanReloadResource(const String& filename) const
+{
+    // Both stores route the name to their copy of the latest payload
+    if (IsStored(filename)) {
+        return true;
+    }
+
+    // A package mounted without lazy loading is only read by this class, the ResourceCache doesn't know it
+    auto package = packageResources_.Find(filename);
+    if (package == packageResources_.End()) {
+        return false;
+    }
+    const auto& packageFiles = GetSubsystem<ResourceCache>()->GetPackageFiles();
+    for (auto it = packageFiles.Begin(); it != packageFiles.End(); ++it) {
+        if ((*it)->GetName() == package->second_->GetName()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void DynamicResourceCache::PropagateReloads()
+{
+    // Refreshing may add resources, so the batch is taken off the queue first
+    unsigned count = Min(pendingReloads_.Size(), maxReloadPropagationsPerFrame_);
+    StringVector batch(pendingReloads_.Buffer(), count);
+    pendingReloads_.Erase(0, count);
+
+    for (auto it = batch.Begin(); it != batch.End(); ++it) {
+        RefreshDependent(*it);
+    }
+}
+
+void DynamicResourceCache::RefreshDependent(const String& filename)
+{
+    auto info = dynamicResources_.Find(filename);
+    if (info == dynamicResources_.End()) {
+        return;
+    }
+    auto* cache = GetSubsystem<ResourceCache>();
+    Resource* resource = cache->GetExistingResource(info->second_.type_, filename);
+    if (!resource) {
+        return;
+    }
+
+    if (info->second_.type_ == Technique::GetTypeStatic()) {
+        // Passes fetch the shader variations again on next use
+        static_cast<Technique*>(resource)->ReleaseShaders();
+    } else if (info->second_.type_ == Material::GetTypeStatic()) {
+        // Resources added under the same name may have replaced the instances the material holds
+        auto* material = static_cast<Material*>(resource);
+        for (unsigned i = 0; i < material->GetNumTechniques(); ++i) {
+            const TechniqueEntry& entry = material->GetTechniqueEntry(i);
+            if (entry.technique_) {
+                auto* technique = cache->GetExistingResource<Technique>(entry.technique_->GetName());
+                if (technique && technique != entry.technique_) {
+                    MaterialQuality qualityLevel = entry.qualityLevel_;
+                    float lodDistance = entry.lodDistance_;
+                    material->SetTechnique(i, technique, qualityLevel, lodDistance);
+                }
+            }
+        }
+        HashMap<TextureUnit, SharedPtr<Texture> > textures = material->GetTextures();
+        for (auto it = textures.Begin(); it != textures.End(); ++it) {
+            if (it->second_) {
+                auto* texture = static_cast<Texture*>(cache->GetExistingResource(it->second_->GetType(), it->second_->GetName()));
+                if (texture && texture != it->second_) {
+                    material->SetTexture(it->first_, texture);
+                }
+            }
+        }
+    }
+
+    LOGRESOURCEINFOF("Refreshing %s after a change in its dependencies", filename.CString());
+    resource->SendEvent(E_RELOADFINISHED);
+}
+
+void DynamicResourceCache::PrecompileShaders()
+{
+    auto* cache = GetSubsystem<ResourceCache>();
+    HashSet<Technique*> techniques;
+    PODVector<Resource*> resources;
+    cache->GetResources(resources, Technique::GetTypeStatic());
+    for (auto it = resources.Begin(); it != resources.End(); ++it) {
+        techniques.Insert(static_cast<Technique*>(*it));
+    }
+    cache->GetResources(resources, Material::GetTypeStatic());
+    for (auto it = resources.Begin(); it != resources.End(); ++it) {
+        auto* material = static_cast<Material*>(*it);
+        for (unsigned i = 0; i < material->GetNumTechniques(); ++i) {
+            if (Technique* technique = material->GetTechnique(i)) {
+                techniques.Insert(technique);
+            }
+        }
+    }
+
+    for (auto it = techniques.Begin(); it != techniques.End(); ++it) {
+        QueueTechniqueVariants(*it, String::EMPTY);
+    }
+}
+
+void DynamicResourceCache::QueueShaderVariants(const String& filename, StringHash type)
+{
+    auto* cache = GetSubsystem<ResourceCache>();
+    if (type == Shader::GetTypeStatic()) {
+        // Every loaded technique using the shader needs its variations again
+        PODVector<Resource*> resources;
+        cache->GetResources(resources, Technique::GetTypeStatic());
+        for (auto it = resources.Begin(); it != resources.End(); ++it) {
+            QueueTechniqueVariants(static_cast<Technique*>(*it), filename);
+        }
+    } else if (type == Technique::GetTypeStatic()) {
+        QueueTechniqueVariants(cache->GetExistingResource<Technique>(filename), String::EMPTY);
+    } else if (type == Material::GetTypeStatic()) {
+        if (auto* material = cache->GetExistingResource<Material>(filename)) {
+            for (unsigned i = 0; i < material->GetNumTechniques(); ++i) {
+                QueueTechniqueVariants(material->GetTechnique(i), String::EMPTY);
+            }
+        }
+    }
+}
+
+void DynamicResourceCache::QueueTechniqueVariants(Technique* technique, const String& shader)
+{
+    if (!technique) {
+        return;
+    }
+
+    PODVector<Pass*> passes = technique->GetPasses();
+    for (auto it = passes.Begin(); it != passes.End(); ++it) {
+        String vertexShader = "Shaders/GLSL/" + (*it)->GetVertexShader() + ".glsl";
+        String pixelShader = "Shaders/GLSL/" + (*it)->GetPixelShader() + ".glsl";
+        for (auto defines = shaderVariantDefines_.Begin(); defines != shaderVariantDefines_.End(); ++defines) {
+            if (shader.Empty() || shader == vertexShader) {
+                QueueShaderVariant(vertexShader, VS, (*it)->GetVertexShaderDefines() + " " + *defines);
+            }
+            if (shader.Empty() || shader == pixelShader) {
+                QueueShaderVariant(pixelShader, PS, (*it)->GetPixelShaderDefines() + " " + *defines);
+            }
+        }
+    }
+}
+
+void DynamicResourceCache::QueueShaderVariant(const String& shader, ShaderType type, const String& defines)
+{
+    ShaderVariantRequest request;
+    request.shader_ = shader;
+    request.type_ = type;
+    request.defines_ = ShaderPreprocessor::NormalizeDefines(defines);
+    String key = shader + (type == VS ? " VS " : " PS ") + request.defines_;
+    if (!queuedShaderVariants_.Contains(key)) {
+        queuedShaderVariants_.Insert(key);
+        pendingShaderVariants_.Push(request);
+    }
+}
+
+void DynamicResourceCache::BuildShaderVariants()
+{
+    if (pendingShaderVariants_.Empty()) {
+        return;
+    }
+
+    // At least one variation is built per frame even if it alone exceeds the budget
+    auto* cache = GetSubsystem<ResourceCache>();
+    auto* graphics = GetSubsystem<Graphics>();
+    HiresTimer timer;
+    do {
+        ShaderVariantRequest request = pendingShaderVariants_.Front();
+        pendingShaderVariants_.PopFront();
+        queuedShaderVariants_.Erase(request.shader_ + (request.type_ == VS ? " VS " : " PS ") + request.defines_);
+
+        // Shaders which are not dynamic are loaded the same way the renderer would do on first use
+        auto* shader = cache->GetExistingResource<Shader>(request.shader_);
+        if (!shader && cache->Exists(request.shader_)) {
+            shader = cache->GetResource<Shader>(request.shader_);
+        }
+        if (!shader) {
+            continue;
+        }
+
+        ++stats_.numShaderVariants_;
+        const PreprocessedShader& preprocessed = PreprocessShaderVariant(shader, request.type_, request.defines_);
+        if (!preprocessed.error_.Empty()) {
+            URHO3D_LOGERRORF("Shader variation %s (%s) is not valid: %s", request.shader_.CString(), request.defines_.CString(),
+                preprocessed.error_.CString());
+            ++stats_.numShaderVariantsFailed_;
+            continue;
+        }
+
+        if (graphics) {
+            ShaderVariation* variation = shader->GetVariation(request.type_, request.defines_);
+            if (variation && !variation->GetGPUObject() && !variation->Create()) {
+                URHO3D_LOGERRORF("Failed to compile shader variation %s (%s): %s", request.shader_.CString(), request.defines_.CString(),
+                    variation->GetCompilerOutput().CString());
+                ++stats_.numShaderVariantsFailed_;
+            }
+        }
+    } while (!pendingShaderVariants_.Empty() && timer.GetUSec(false) < shaderPrecompileTimeBudget_ * 1000LL);
+
+    stats_.shaderVariantTime_ += timer.GetUSec(false);
+}
+
+bool DynamicResourceCache::ValidateShaderVariant(const String& filename, ShaderType type, const String& defines)
+{
+    auto* shader = GetSubsystem<ResourceCache>()->GetResource<Shader>(filename);
+    if (!shader) {
+        return false;
+    }
+
+    const PreprocessedShader& preprocessed = PreprocessShaderVariant(shader, type, ShaderPreprocessor::NormalizeDefines(defines));
+    if (!preprocessed.error_.Empty()) {
+        URHO3D_LOGERRORF("Shader variation %s (%s) is not valid: %s", filename.CString(), defines.CString(), preprocessed.error_.CString());
+        return false;
+    }
+    return true;
+}
+
+const String& DynamicResourceCache::GetPreprocessedShader(const String& filename, ShaderType type, const String& defines)
+{
+    auto* shader = GetSubsystem<ResourceCache>()->GetResource<Shader>(filename);
+    if (!shader) {
+        return String::EMPTY;
+    }
+    return PreprocessShaderVariant(shader, type, ShaderPreprocessor::NormalizeDefines(defines)).source_;
+}
+
+const DynamicResourceCache::PreprocessedShader& DynamicResourceCache::PreprocessShaderVariant(Shader* shader, ShaderType type, const String& defines)
+{
+    // Shader source has includes resolved, so an edited include changes the hash too
+    const String& source = shader->GetSourceCode(type);
+    String key = PersistentResourceStore::ComputeHash(source.CString(), source.Length()) + (type == VS ? " VS " : " PS ") + defines;
+    auto cached = preprocessedShaders_.Find(key);
+    if (cached != preprocessedShaders_.End()) {
+        return cached->second_;
+    }
+
+    // Same defines as ShaderVariation::Create() adds on top of the requested ones
+    String variantDefines = (type == VS ? "COMPILEVS " : "COMPILEPS ") + defines;
+#ifdef URHO3D_OPENGL
+    if (Graphics::GetGL3Support()) {
+        variantDefines += " GL3";
+    }
+    const char* entryPoint = "void main(";
+#else
+    const char* entryPoint = type == VS ? "void VS(" : "void PS(";
+#endif
+#ifdef __EMSCRIPTEN__
+    variantDefines += " GL_ES";
+#endif
+
+    PreprocessedShader& entry = preprocessedShaders_[key];
+    ShaderPreprocessor preprocessor(variantDefines);
+    if (!preprocessor.Process(source, entry.source_)) {
+        entry.error_ = preprocessor.GetError();
+    } else if (!entry.source_.Contains(entryPoint)) {
+        entry.error_ = String("entry point ") + entryPoint + ") not found";
+    } else {
+        int depth = 0;
+        for (unsigned i = 0; i < entry.source_.Length() && depth >= 0; ++i) {
+            if (entry.source_[i] == '{') {
+                ++depth;
+            } else if (entry.source_[i] == '}') {
+                --depth;
+            }
+        }
+        if (depth) {
+            entry.error_ = "unbalanced braces";
+        }
+    }
+    if (!entry.error_.Empty()) {
+        entry.source_.Clear();
+    }
+    return entry;
+}
+
+bool DynamicResourceCache::AddAngelScriptFile(const String& filename, const char* content, int size)
+{
+#ifdef URHO3D_ANGELSCRIPT
+    if (scriptBatchCompile_) {
+        PODVector<unsigned char>& pending = pendingScripts_[filename];
+        pending.Resize(size);
+        memcpy(pending.Buffer(), content, size);
+        return true;
+    }
+
+    return CompileAngelScriptFile(filename, content, size);
+#else
+    URHO3D_LOGERROR("Engine built without AngelScript support!");
+    return false;
+#endif
+}
+
+bool DynamicResourceCache::CompileAngelScriptFile(const String& filename, const char* content, int size)
+{
+#ifdef URHO3D_ANGELSCRIPT
+    SharedPtr<ScriptFile> file = SharedPtr<ScriptFile>(resourceCacheObject->GetSubsystem<ResourceCache>()->GetResource<ScriptFile>(filename));
+    if (!file) {
+        file = SharedPtr<ScriptFile>(new ScriptFile(context_));
+        file->SetName(filename);
+        GetSubsystem<ResourceCache>()->AddManualResource(file);
+        LOGRESOURCEINFOF("Creating new manual AngelScript resource %s", filename.CString());
+    }
+
+    // Bytecode doesn't track included files, so only self-contained scripts are cached
+    bool cacheable = !ContainsText(content, size, "#include");
+    String hash = cacheable ? PersistentResourceStore::ComputeHash(content, size) : String::EMPTY;
+    const PODVector<unsigned char>* byteCode = cacheable ? scriptByteCode_.Find(filename, hash) : nullptr;
+    bool loaded;
+    if (byteCode) {
+        MemoryBuffer buffer(byteCode->Buffer(), byteCode->Size());
+        buffer.SetName(filename);
+        loaded = file->Load(buffer);
+    } else {
+        MemoryBuffer buffer(content, size);
+        buffer.SetName(filename);
+        loaded = file->Load(buffer);
+        if (loaded && cacheable) {
+            VectorBuffer compiled;
+            if (file->SaveByteCode(compiled)) {
+                scriptByteCode_.Insert(filename, hash, compiled.GetBuffer());
+            }
+        }
+    }
+    asScripts_[filename] = file.Get();
+
+    // Function pointers change whenever the ScriptFile is loaded, these scripts are only loaded here
+    asIScriptFunction* startFunction = loaded ? file->GetFunction("void Start()") : nullptr;
+    if (startFunction) {
+        asStartFunctions_[filename] = startFunction;
+    } else {
+        asStartFunctions_.Erase(filename);
+    }
+
+#ifdef __EMSCRIPTEN__
+    if (loaded) {
+        val module = val::global("Module");
+        module.call<void>("FileLoaded", val(filename.CString()));
+    } else {
+        val module = val::global("Module");
+        module.call<void>("FileLoadFailed", val(filename.CString()));
+    }
+#endif
+
+    return loaded;
+#else
+    URHO3D_LOGERROR("Engine built without AngelScript support!");
+    return false;
+#endif
+}
+
+void DynamicResourceCache::CompileScripts()
+{
+#ifdef URHO3D_ANGELSCRIPT
+    if (pendingScripts_.Empty()) {
+        return;
+    }
+
+    // Compiling may queue more scripts through events, they wait for the next batch
+    HashMap<String, PODVector<unsigned char>> scripts;
+    scripts.Swap(pendingScripts_);
+    HiresTimer timer;
+    unsigned numFailed = 0;
+    for (auto it = scripts.Begin(); it != scripts.End(); ++it) {
+        if (!CompileAngelScriptFile(it->first_, (const char*)it->second_.Buffer(), it->second_.Size())) {
+            // Failed script is compiled again when the same payload is sent
+            dynamicResources_[it->first_].hash_.Clear();
+            ++numFailed;
+        }
+    }
+    URHO3D_LOGINFOF("Compiled %d AngelScript files in %.2f ms, %d failed", scripts.Size(), timer.GetUSec(false) / 1000.0f, numFailed);
+#endif
+}
+
+unsigned DynamicResourceCache::GetNumPendingScripts() const
+{
+#ifdef URHO3D_ANGELSCRIPT
+    return pendingScripts_.Size();
+#else
+    return 0;
+#endif
 }
 
-void DynamicResourceCache::HandleUpdate(StringHash eventType, VariantMap& eventData)
+void DynamicResourceCache::ClearScriptByteCodeCache()
 {
-#ifdef URHO3D_NETWORK
-    while (!remoteResources_.Empty()) {
-        String url = remoteResources_.Front();
-        remoteResources_.PopFront();
-        String filename = remoteResources_.Front();
-        remoteResources_.PopFront();
-
-        NetworkResourceResponse response;
-        response.first_ = filename;
-        response.second_ = VectorBuffer();
-
-        auto* network = GetSubsystem<Network>();
-        httpRequests_.Push(NetworkResourceRequest(network->MakeHttpRequest(url), response));
-        URHO3D_LOGINFOF("Loading remote resource %s from %s", filename.CString(), url.CString());
-    }
-
-    for (auto it = httpRequests_.Begin(); it != httpRequests_.End(); ++it) {
-        if (it->first_) {
-            if (it->first_->GetState() == HTTP_INITIALIZING) {
-            } else if (it->first_->GetState() == HTTP_ERROR) {
-                URHO3D_LOGERRORF("Failed to load resource from url due to error: %s", it->first_->GetError().CString());
-                httpRequests_.Erase(it);
-                break;
-            } else if (it->first_->GetState() == HTTP_CLOSED){
-                if (it->first_->GetAvailableSize() > 0) {
-                    for (int i = 0; i < it->first_->GetAvailableSize(); i++) {
-                        it->second_.second_.WriteByte(it->first_->ReadByte());
-                    }
-                } else if (it->second_.second_.GetSize() > 0){
-                    String filename = it->second_.first_;
-                    URHO3D_LOGINFOF("Remote resource %s downloaded from %s, size = %d", filename.CString(), it->first_->GetURL().CString(), it->second_.second_.GetSize());
-                    ProcessResource(filename, (const char*)it->second_.second_.GetData(), it->second_.second_.GetSize());
-                    if (filename.EndsWith(".as")) {
-                        StartSingleScript(filename);
-                    }
-                    httpRequests_.Erase(it);
-                    break;
-                }
-            }
-        } else {
-            httpRequests_.Erase(it);
-        }
-    }
+#ifdef URHO3D_ANGELSCRIPT
+    scriptByteCode_.Clear();
+#endif
+#ifdef URHO3D_LUA
+    luaByteCode_.Clear();
 #endif
 }
 
-void DynamicResourceCache::ProcessResource(const String& filename, const char* content, int size)
+const PODVector<unsigned char>* DynamicResourceCache::ScriptByteCodeCache::Find(const String& filename, const String& hash) const
 {
-    URHO3D_LOGINFOF("Processing resource with legnth %d", size);
-    if (filename.EndsWith(".as")) {
-        AddAngelScriptFile(filename, content, size);
-    } else if (filename.EndsWith(".lua")) {
-        AddLuaScriptFile(filename, content, size);
-    } else if (filename.EndsWith(".xml")) {
-        AddXMLFile(filename, content, size);
-    } else if (filename.EndsWith(".json")) {
-        AddJSONFile(filename, content, size);
-    } else if (filename.EndsWith(".glsl")) {
-        AddGLSLShader(filename, content, size);
-    } else if (filename.EndsWith(".mdl")) {
-        AddModel(filename, content, size);
-    } else if (IsImage(filename)) {
-        AddImageFile(filename, content, size);
-    } else if(filename.EndsWith(".js")) {
-#ifdef __EMSCRIPTEN__
-    emscripten_run_script(std::string(content, size).c_str());
-    val module = val::global("Module");
-    module.call<void>("FileLoaded", val(filename.CString()));
-#endif
-    } else {
-        URHO3D_LOGERRORF("Unable to process file %s, no handler implemented", filename.CString());
+    auto it = entries_.Find(filename + " " + hash);
+    return it != entries_.End() ? &it->second_ : nullptr;
+}
+
+void DynamicResourceCache::ScriptByteCodeCache::Insert(const String& filename, const String& hash, const PODVector<unsigned char>& data)
+{
+    String key = filename + " " + hash;
+    if (entries_.Contains(key)) {
+        return;
+    }
+    entries_[key] = data;
+    order_.Push(key);
+    size_ += data.Size();
+    while (size_ > MAX_SCRIPT_BYTECODE_SIZE && order_.Size() > 1) {
+        auto oldest = entries_.Find(order_.Front());
+        size_ -= oldest->second_.Size();
+        entries_.Erase(oldest);
+        order_.PopFront();
     }
 }
 
-bool DynamicResourceCache::IsImage(const String& filename)
+void DynamicResourceCache::ScriptByteCodeCache::Clear()
 {
-    return filename.EndsWith(".dds")
-           || filename.EndsWith(".jpg")
-           || filename.EndsWith(".jpeg")
-           || filename.EndsWith(".png")
-           || filename.EndsWith(".icns");
+    entries_.Clear();
+    order_.Clear();
+    size_ = 0;
 }
 
-void DynamicResourceCache::AddAngelScriptFile(const String& filename, const char* content, int size)
+bool DynamicResourceCache::AddLuaScriptFile(const String& filename, const char* content, int size)
 {
-#ifdef URHO3D_ANGELSCRIPT
-    SharedPtr<ScriptFile> file = SharedPtr<ScriptFile>(resourceCacheObject->GetSubsystem<ResourceCache>()->GetResource<ScriptFile>(filename));
-    if (!file) {
-        file = SharedPtr<ScriptFile>(new ScriptFile(context_));
-        file->SetName(filename);
-        GetSubsystem<ResourceCache>()->AddManualResource(file);
-        URHO3D_LOGINFOF("Creating new manual AngelScript resource %s", filename.CString());
+#ifdef URHO3D_LUA
+    auto* luaScript = GetSubsystem<LuaScript>();
+    if (!luaScript) {
+        URHO3D_LOGERROR("LuaScript subsystem is not registered!");
+        return false;
     }
 
-    MemoryBuffer buffer(content, size);
-    bool loaded = file->Load(buffer);
-    asScripts_[filename] = file.Get();
+    // A source is parsed only the first time, LuaFile gets the precompiled chunk which loads without parsing
+    String hash = PersistentResourceStore::ComputeHash(content, size);
+    const PODVector<unsigned char>* byteCode = luaByteCode_.Find(filename, hash);
+    PODVector<unsigned char> compiled;
+    bool loaded = true;
+    if (!byteCode) {
+        lua_State* state = luaScript->GetState();
+        if (luaL_loadbuffer(state, content, size, filename.CString())) {
+            URHO3D_LOGERRORF("Failed to compile Lua script %s: %s", filename.CString(), lua_tostring(state, -1));
+            loaded = false;
+        } else {
+            lua_dump(state, WriteLuaChunk, &compiled);
+            luaByteCode_.Insert(filename, hash, compiled);
+            byteCode = &compiled;
+        }
+        lua_pop(state, 1);
+    }
+
+    if (loaded) {
+        // A LuaFile pushes its chunk only the first time it is run, even after it has been loaded again, so every load
+        // gets a new instance which replaces the previous one in the ResourceCache
+        SharedPtr<LuaFile> file(new LuaFile(context_));
+        file->SetName(filename);
+        MemoryBuffer buffer(byteCode->Buffer(), byteCode->Size());
+        buffer.SetName(filename);
+        loaded = file->Load(buffer);
+        if (loaded) {
+            GetSubsystem<ResourceCache>()->AddManualResource(file);
+            LOGRESOURCEINFOF("Creating new manual Lua resource %s", filename.CString());
+            // The new chunk is run again the next time the file is started
+            ReleaseLuaStart(filename);
+            luaScripts_[filename] = file;
+            if (luaRunOnLoad_) {
+                RunLuaScriptFile(file);
+            }
+        }
+    }
 
 #ifdef __EMSCRIPTEN__
     if (loaded) {
@@ -285,32 +3214,105 @@ void DynamicResourceCache::AddAngelScriptFile(const String& filename, const char
         module.call<void>("FileLoadFailed", val(filename.CString()));
     }
 #endif
+
+    return loaded;
 #else
-    URHO3D_LOGERROR("Engine built without AngelScript support!");
+    URHO3D_LOGERROR("Engine built without Lua support!");
+    return false;
 #endif
 }
 
-void DynamicResourceCache::AddLuaScriptFile(const String& filename, const char* content, int size)
+bool DynamicResourceCache::RunLuaScriptFile(LuaFile* file)
 {
-    URHO3D_LOGERROR("Lua script dynamic loading is not yet supported!");
+#ifdef URHO3D_LUA
+    lua_State* state = GetSubsystem<LuaScript>()->GetState();
+    const String& filename = file->GetName();
+
+    // The chunk runs once and the Start() it defines is kept in the registry. The global Start, which may belong to the
+    // host application or to another file, is restored afterwards
+    auto startRef = luaStartRefs_.Find(filename);
+    if (startRef == luaStartRefs_.End()) {
+        int top = lua_gettop(state);
+        lua_getglobal(state, "Start");
+        lua_pushnil(state);
+        lua_setglobal(state, "Start");
+        // LoadChunk() succeeds without pushing anything when the file has been run before
+        if (!file->LoadChunk(state) || lua_gettop(state) != top + 2) {
+            URHO3D_LOGERRORF("Failed to load the chunk of Lua script %s", filename.CString());
+            lua_settop(state, top + 1);
+            lua_setglobal(state, "Start");
+            return false;
+        }
+        if (lua_pcall(state, 0, 0, 0)) {
+            URHO3D_LOGERRORF("Failed to run Lua script %s: %s", filename.CString(), lua_tostring(state, -1));
+            lua_pop(state, 1);
+            lua_setglobal(state, "Start");
+            return false;
+        }
+
+        int ref = LUA_NOREF;
+        lua_getglobal(state, "Start");
+        if (lua_isfunction(state, -1)) {
+            ref = luaL_ref(state, LUA_REGISTRYINDEX);
+        } else {
+            lua_pop(state, 1);
+        }
+        lua_setglobal(state, "Start");
+        startRef = luaStartRefs_.Insert(MakePair(filename, ref));
+    }
+    if (startRef->second_ == LUA_NOREF) {
+        return true;
+    }
+
+    URHO3D_LOGINFOF("Starting script %s", filename.CString());
+    lua_rawgeti(state, LUA_REGISTRYINDEX, startRef->second_);
+    if (lua_pcall(state, 0, 0, 0)) {
+        URHO3D_LOGERRORF("Failed to start Lua script %s: %s", filename.CString(), lua_tostring(state, -1));
+        lua_pop(state, 1);
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
 }
 
-void DynamicResourceCache::AddXMLFile(const String& filename, const char* content, int size)
+void DynamicResourceCache::ReleaseLuaStart(const String& filename)
 {
-    SharedPtr<XMLFile> file = SharedPtr<XMLFile>(new XMLFile(context_));
-    MemoryBuffer buffer(content, size);
-    file->Load(buffer);
-    if (file->GetRoot().GetName() == "material") {
-        AddMaterialFile(filename, file->GetRoot());
-    } else if (file->GetRoot().GetName() == "technique") {
-        AddTechniqueFile(filename, content, size);
+#ifdef URHO3D_LUA
+    auto startRef = luaStartRefs_.Find(filename);
+    if (startRef == luaStartRefs_.End()) {
+        return;
+    }
+    // The Lua state is gone if the LuaScript subsystem has been removed
+    auto* luaScript = GetSubsystem<LuaScript>();
+    if (luaScript && startRef->second_ != LUA_NOREF) {
+        luaL_unref(luaScript->GetState(), LUA_REGISTRYINDEX, startRef->second_);
+    }
+    luaStartRefs_.Erase(startRef);
+#endif
+}
+
+bool DynamicResourceCache::AddXMLFile(const String& filename, const char* content, int size)
+{
+    // Every branch parses the payload exactly once
+    StringHash type = GetXMLResourceType(content, size);
+    if (type == Material::GetTypeStatic()) {
+        SharedPtr<XMLFile> file = SharedPtr<XMLFile>(new XMLFile(context_));
+        MemoryBuffer buffer(content, size);
+        file->Load(buffer);
+        return AddMaterialFile(filename, file->GetRoot());
+    } else if (type == Technique::GetTypeStatic()) {
+        return AddTechniqueFile(filename, content, size);
+    } else if (type != XMLFile::GetTypeStatic()) {
+        return AddResource(type, filename, content, size);
     } else {
         SharedPtr<XMLFile> file = SharedPtr<XMLFile>(resourceCacheObject->GetSubsystem<ResourceCache>()->GetResource<XMLFile>(filename));
         if (!file) {
             file = SharedPtr<XMLFile>(new XMLFile(context_));
             file->SetName(filename);
             GetSubsystem<ResourceCache>()->AddManualResource(file);
-            URHO3D_LOGINFOF("Creating new manual XML resource %s", filename.CString());
+            LOGRESOURCEINFOF("Creating new manual XML resource %s", filename.CString());
         }
 
         MemoryBuffer buffer(content, size);
@@ -325,17 +3327,19 @@ void DynamicResourceCache::AddXMLFile(const String& filename, const char* conten
             module.call<void>("FileLoadFailed", val(filename.CString()));
         }
 #endif
+
+        return loaded;
     }
 }
 
-void DynamicResourceCache::AddJSONFile(const String& filename, const char* content, int size)
+bool DynamicResourceCache::AddJSONFile(const String& filename, const char* content, int size)
 {
     SharedPtr<JSONFile> file = SharedPtr<JSONFile>(resourceCacheObject->GetSubsystem<ResourceCache>()->GetResource<JSONFile>(filename));
     if (!file) {
         file = SharedPtr<JSONFile>(new JSONFile(context_));
         file->SetName(filename);
         GetSubsystem<ResourceCache>()->AddManualResource(file);
-        URHO3D_LOGINFOF("Creating new manual AngelScript resource %s", filename.CString());
+        LOGRESOURCEINFOF("Creating new manual AngelScript resource %s", filename.CString());
     }
 
     MemoryBuffer buffer(content, size);
@@ -350,9 +3354,11 @@ void DynamicResourceCache::AddJSONFile(const String& filename, const char* conte
         module.call<void>("FileLoadFailed", val(filename.CString()));
     }
 #endif
+
+    return loaded;
 }
 
-void DynamicResourceCache::AddTechniqueFile(const String& filename, const char* content, int size)
+bool DynamicResourceCache::AddTechniqueFile(const String& filename, const char* content, int size)
 {
     MemoryBuffer buffer(content, size);
     SharedPtr<Technique> file = SharedPtr<Technique>(resourceCacheObject->GetSubsystem<ResourceCache>()->GetResource<Technique>(filename));
@@ -360,7 +3366,7 @@ void DynamicResourceCache::AddTechniqueFile(const String& filename, const char*
         file = SharedPtr<Technique>(new Technique(context_));
         file->SetName(filename);
         GetSubsystem<ResourceCache>()->AddManualResource(file);
-        URHO3D_LOGINFOF("Creating new manual Material resource %s", filename.CString());
+        LOGRESOURCEINFOF("Creating new manual Material resource %s", filename.CString());
     }
 
     bool loaded = file->Load(buffer);
@@ -374,16 +3380,18 @@ void DynamicResourceCache::AddTechniqueFile(const String& filename, const char*
         module.call<void>("FileLoadFailed", val(filename.CString()));
     }
 #endif
+
+    return loaded;
 }
 
-void DynamicResourceCache::AddMaterialFile(const String& filename, const XMLElement& source)
+bool DynamicResourceCache::AddMaterialFile(const String& filename, const XMLElement& source)
 {
     SharedPtr<Material> file = SharedPtr<Material>(resourceCacheObject->GetSubsystem<ResourceCache>()->GetResource<Material>(filename));
     if (!file) {
         file = SharedPtr<Material>(new Material(context_));
         file->SetName(filename);
         GetSubsystem<ResourceCache>()->AddManualResource(file);
-        URHO3D_LOGINFOF("Creating new manual Material resource %s", filename.CString());
+        LOGRESOURCEINFOF("Creating new manual Material resource %s", filename.CString());
     }
 
     bool loaded = file->Load(source);
@@ -397,9 +3405,11 @@ void DynamicResourceCache::AddMaterialFile(const String& filename, const XMLElem
         module.call<void>("FileLoadFailed", val(filename.CString()));
     }
 #endif
+
+    return loaded;
 }
 
-void DynamicResourceCache::AddGLSLShader(const String& filename, const char* content, int size)
+bool DynamicResourceCache::AddGLSLShader(const String& filename, const char* content, int size)
 {
     MemoryBuffer buffer(content, size);
     buffer.SetName(filename);
@@ -408,7 +3418,7 @@ void DynamicResourceCache::AddGLSLShader(const String& filename, const char* con
         file = SharedPtr<Shader>(new Shader(context_));
         file->SetName(filename);
         GetSubsystem<ResourceCache>()->AddManualResource(file);
-        URHO3D_LOGINFOF("Creating new manual GLSL resource %s", filename.CString());
+        LOGRESOURCEINFOF("Creating new manual GLSL resource %s", filename.CString());
     }
 
     bool loaded = file->Load(buffer);
@@ -422,9 +3432,11 @@ void DynamicResourceCache::AddGLSLShader(const String& filename, const char* con
         module.call<void>("FileLoadFailed", val(filename.CString()));
     }
 #endif
+
+    return loaded;
 }
 
-void DynamicResourceCache::AddImageFile(const String& filename, const char* content, int size)
+bool DynamicResourceCache::AddImageFile(const String& filename, const char* content, int size)
 {
     MemoryBuffer buffer((const void*) content, size);
     buffer.SetName(filename);
@@ -433,7 +3445,7 @@ void DynamicResourceCache::AddImageFile(const String& filename, const char* cont
         file = SharedPtr<Texture2D>(new Texture2D(context_));
         file->SetName(filename);
         GetSubsystem<ResourceCache>()->AddManualResource(file);
-        URHO3D_LOGINFOF("Creating new manual Material resource %s", filename.CString());
+        LOGRESOURCEINFOF("Creating new manual Material resource %s", filename.CString());
     }
     bool loaded = file->Load(buffer);
 #ifdef __EMSCRIPTEN__
@@ -445,10 +3457,26 @@ void DynamicResourceCache::AddImageFile(const String& filename, const char* cont
         module.call<void>("FileLoadFailed", val(filename.CString()));
     }
 #endif
+
+    return loaded;
 }
 
-void DynamicResourceCache::AddModel(const String& filename, const char* content, int size)
+bool DynamicResourceCache::AddModel(const String& filename, const char* content, int size)
 {
+    // Models loaded on the main thread, without an asynchronous ingest, are optimised here
+    PODVector<unsigned char> optimized;
+    if (modelOptimization_) {
+        ModelOptimizeResult result;
+        String error;
+        HiresTimer timer;
+        bufferPool_.Acquire(optimized, (unsigned)size);
+        if (OptimizeModel(content, (unsigned)size, modelSettings_, optimized, result, error)) {
+            content = (const char*)optimized.Buffer();
+            size = optimized.Size();
+        }
+        RecordModelOptimization(filename, result, error, timer.GetUSec(false));
+    }
+
     MemoryBuffer buffer((const void*) content, size);
     buffer.SetName(filename);
     SharedPtr<Model> file = SharedPtr<Model>(resourceCacheObject->GetSubsystem<ResourceCache>()->GetResource<Model>(filename));
@@ -456,9 +3484,10 @@ void DynamicResourceCache::AddModel(const String& filename, const char* content,
         file = SharedPtr<Model>(new Model(context_));
         file->SetName(filename);
         GetSubsystem<ResourceCache>()->AddManualResource(file);
-        URHO3D_LOGINFOF("Creating new manual Model resource %s, size=%d", filename.CString(), size);
+        LOGRESOURCEINFOF("Creating new manual Model resource %s, size=%d", filename.CString(), size);
     }
     bool loaded = file->Load(buffer);
+    bufferPool_.Release(optimized);
 #ifdef __EMSCRIPTEN__
     if (loaded) {
         val module = val::global("Module");
@@ -468,16 +3497,44 @@ void DynamicResourceCache::AddModel(const String& filename, const char* content,
         module.call<void>("FileLoadFailed", val(filename.CString()));
     }
 #endif
+
+    return loaded;
+}
+
+void DynamicResourceCache::RecordModelOptimization(const String& filename, const ModelOptimizeResult& result, const String& error,
+    long long time)
+{
+    stats_.modelOptimizeTime_ += time;
+    if (!error.Empty()) {
+        URHO3D_LOGWARNINGF("Failed to optimise model %s, loading it as it is: %s", filename.CString(), error.CString());
+        ++stats_.numModelOptimizeFailed_;
+        return;
+    }
+
+    ++stats_.numOptimizedModels_;
+    stats_.modelVerticesRemoved_ += result.verticesBefore_ - result.verticesAfter_;
+    stats_.modelCacheMissesBefore_ += result.cacheMissesBefore_;
+    stats_.modelCacheMissesAfter_ += result.cacheMissesAfter_;
+    stats_.modelTriangles_ += result.numTriangles_;
+    stats_.numModelLodLevels_ += result.numLodLevels_;
+    LOGRESOURCEINFOF("Optimised model %s, %u -> %u vertices, ACMR %.2f -> %.2f, %u LOD levels generated",
+        filename.CString(), result.verticesBefore_, result.verticesAfter_,
+        result.numTriangles_ ? (float)result.cacheMissesBefore_ / result.numTriangles_ : 0.0f,
+        result.numTriangles_ ? (float)result.cacheMissesAfter_ / result.numTriangles_ : 0.0f, result.numLodLevels_);
 }
 
 void DynamicResourceCache::StartScripts()
 {
 #ifdef URHO3D_ANGELSCRIPT
-    for (auto it = asScripts_.Begin(); it != asScripts_.End(); ++it) {
-        if ((*it).second_->GetFunction("void Start()")) {
-            URHO3D_LOGINFOF("Starting script %s", (*it).second_->GetName().CString());
-            (*it).second_->Execute("void Start()");
-        }
+    CompileScripts();
+    for (auto it = asStartFunctions_.Begin(); it != asStartFunctions_.End(); ++it) {
+        URHO3D_LOGINFOF("Starting script %s", it->first_.CString());
+        asScripts_[it->first_]->Execute(it->second_);
+    }
+#endif
+#ifdef URHO3D_LUA
+    for (auto it = luaScripts_.Begin(); it != luaScripts_.End(); ++it) {
+        RunLuaScriptFile(it->second_);
     }
 #endif
 }
@@ -485,53 +3542,532 @@ void DynamicResourceCache::StartScripts()
 void DynamicResourceCache::StartSingleScript(const String& filename)
 {
 #ifdef URHO3D_ANGELSCRIPT
-    if (asScripts_.Contains(filename)) {
-        if (asScripts_[filename]->GetFunction("void Start()")) {
-            asScripts_[filename]->Execute("void Start()");
-        }
+    if (pendingScripts_.Contains(filename)) {
+        CompileScripts();
+    }
+    auto it = asStartFunctions_.Find(filename);
+    if (it != asStartFunctions_.End()) {
+        asScripts_[filename]->Execute(it->second_);
+    }
+#endif
+#ifdef URHO3D_LUA
+    auto luaScript = luaScripts_.Find(filename);
+    if (luaScript != luaScripts_.End()) {
+        RunLuaScriptFile(luaScript->second_);
     }
 #endif
 }
 
-String DynamicResourceCache::GetResourceContent(const String& filename)
+const String& DynamicResourceCache::GetResourceContent(const String& filename)
 {
-    auto cache = GetSubsystem<ResourceCache>();
-    auto file = cache->GetFile(filename);
-    String content;
-    if (file) {
-        while(!file->IsEof()) {
-            content += file->ReadLine() + "\n";
+    String fileName = GetSubsystem<ResourceCache>()->GetResourceFileName(filename);
+    unsigned stamp = fileName.Empty() ? 0 : GetSubsystem<FileSystem>()->GetLastModifiedTime(fileName);
+    if (contentCacheEnabled_ && contentValid_ && contentName_ == filename && contentStamp_ == stamp) {
+        return content_;
+    }
+
+    contentValid_ = false;
+    content_.Clear();
+
+    const unsigned char* view;
+    unsigned size;
+    SharedPtr<File> file;
+    if (!LocateResource(filename, view, size, file)) {
+        return content_;
+    }
+
+    // Single bulk read sized up front, line endings are kept as they are
+    if (size) {
+        content_.Resize(size);
+        if (view) {
+            memcpy(&content_[0], view, size);
+        } else {
+            content_.Resize(file->Read(&content_[0], size));
         }
     }
 
-    return content;
+    contentName_ = filename;
+    contentStamp_ = stamp;
+    contentValid_ = true;
+    return content_;
 }
 
-void* DynamicResourceCache::GetResourceContentBinary(const String& filename)
+const void* DynamicResourceCache::GetResourceContentBinary(const String& filename, unsigned& size, unsigned offset, unsigned length)
 {
-    auto cache = GetSubsystem<ResourceCache>();
-    auto file = cache->GetFile(filename);
-    if (file) {
-        char buffer[file->GetSize()];
-        int read = file->Read(buffer, file->GetSize());
-        buffer_.SetData(buffer, file->GetSize());
-        URHO3D_LOGINFOF(" DynamicResourceCache::GetResourceContentBinary Read %d bytes", read);
+    size = 0;
+    const unsigned char* view;
+    unsigned totalSize;
+    SharedPtr<File> file;
+    if (!LocateResource(filename, view, totalSize, file)) {
+        return nullptr;
+    }
+
+    offset = Min(offset, totalSize);
+    size = Min(length, totalSize - offset);
+    const void* data;
+    if (view) {
+        data = view + offset;
+    } else {
+        readBuffer_.Resize(size);
+        if (offset) {
+            file->Seek(offset);
+        }
+        size = file->Read(readBuffer_.Buffer(), size);
+        data = readBuffer_.Buffer();
+    }
+
 #ifdef __EMSCRIPTEN__
-        uintptr_t pointer = reinterpret_cast<uintptr_t>(buffer_.GetData());
-        val module = val::global("Module");
-        module.call<void>("BinaryFileLoaded", val(filename.CString()), val(pointer), val(file->GetSize()));
+    uintptr_t pointer = reinterpret_cast<uintptr_t>(data);
+    val module = val::global("Module");
+    module.call<void>("BinaryFileLoaded", val(filename.CString()), val(pointer), val(size), val(offset), val(totalSize));
 #endif
+
+    return data;
+}
+
+bool DynamicResourceCache::LocateResource(const String& filename, const unsigned char*& view, unsigned& size, SharedPtr<File>& file)
+{
+    view = nullptr;
+    size = 0;
+
+    auto it = packageResources_.Find(filename);
+    if (it != packageResources_.End()) {
+        view = it->second_->GetEntryData(filename, size);
+        return view != nullptr;
+    }
+
+    file = GetSubsystem<ResourceCache>()->GetFile(filename);
+    if (!file) {
+        return false;
+    }
+
+    if (file->IsPackaged()) {
+        view = GetPackageView(filename, size);
+    }
+    if (!view) {
+        size = file->GetSize();
+    }
+    return true;
+}
+
+const unsigned char* DynamicResourceCache::GetPackageView(const String& filename, unsigned& size)
+{
+    // Same search order as ResourceCache::GetFile()
+    const auto& packageFiles = GetSubsystem<ResourceCache>()->GetPackageFiles();
+    for (auto it = packageFiles.Begin(); it != packageFiles.End(); ++it) {
+        if (!(*it)->GetEntry(filename)) {
+            continue;
+        }
+        if ((*it)->IsCompressed()) {
+            return nullptr;
+        }
+
+        SharedPtr<MappedPackageFile>& packageView = packageViews_[(*it)->GetName()];
+        if (!packageView) {
+            packageView = new MappedPackageFile(context_);
+            if (!packageView->Open((*it)->GetName())) {
+                packageViews_.Erase((*it)->GetName());
+                return nullptr;
+            }
+        }
+        return packageView->GetEntryData(filename, size);
     }
 
     return nullptr;
 }
 
-void DynamicResourceCache::LoadResourceFromUrl(const String& url, const String& filename)
+void DynamicResourceCache::LoadResourceFromUrl(const String& url, const String& filename, unsigned sizeHint, const String& hash)
 {
+    // Skip the download when the stored payload already has the expected content. Payloads are stored decompressed
+    String storedName = GetDecompressedName(filename);
+    if (store_ && !hash.Empty() && store_->GetHash(storedName) == hash.ToLower()) {
+        PODVector<unsigned char> data;
+        if (store_->Load(storedName, data)) {
+            LOGRESOURCEINFOF("Remote resource %s is up to date in the persistent store", storedName.CString());
+            IngestResource(storedName, (const char*)data.Buffer(), data.Size());
+            if (storedName.EndsWith(".as") || (storedName.EndsWith(".lua") && !luaRunOnLoad_)) {
+                StartSingleScript(storedName);
+            }
+            return;
+        }
+    }
+
 #ifdef URHO3D_NETWORK
-    remoteResources_.Push(url);
-    remoteResources_.Push(filename);
+    if (CoalesceDownload(url, filename)) {
+        return;
+    }
+    if (rangeDownloads_ && sizeHint) {
+        QueueRangedDownload(url, filename, sizeHint, hash.ToLower());
+        return;
+    }
+
+    RemoteResource resource;
+    resource.url_ = url;
+    resource.filename_ = filename;
+    resource.hash_ = hash.ToLower();
+    resource.sizeHint_ = sizeHint;
+    resource.priority_ = GetDownloadPriority(filename);
+    QueueDownload(resource);
 #else
     URHO3D_LOGERROR("Engine built without network support!");
 #endif
 }
+
+bool DynamicResourceCache::CancelResourceDownload(const String& filename)
+{
+    bool cancelled = false;
+#ifdef URHO3D_NETWORK
+    // A resource sharing a download only stops waiting for it
+    for (auto it = downloadWaiters_.Begin(); it != downloadWaiters_.End();) {
+        while (it->second_.Remove(filename)) {
+            cancelled = true;
+        }
+        if (it->second_.Empty()) {
+            it = downloadWaiters_.Erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // A download shared with other resources keeps running for the first of them
+    HashMap<String, String> newOwners;
+    for (auto it = downloadWaiters_.Begin(); it != downloadWaiters_.End();) {
+        bool owned = false;
+        for (auto it2 = remoteResources_.Begin(); it2 != remoteResources_.End() && !owned; ++it2) {
+            owned = it2->url_ == it->first_ && it2->filename_ == filename;
+        }
+        for (auto it2 = httpRequests_.Begin(); it2 != httpRequests_.End() && !owned; ++it2) {
+            owned = it2->resource_.url_ == it->first_ && it2->resource_.filename_ == filename;
+        }
+        if (!owned) {
+            ++it;
+            continue;
+        }
+        newOwners[it->first_] = it->second_.Front();
+        it->second_.Erase(0);
+        if (it->second_.Empty()) {
+            it = downloadWaiters_.Erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = newOwners.Begin(); it != newOwners.End(); ++it) {
+        LOGRESOURCEINFOF("Download of %s is handed over from %s to %s", it->first_.CString(), filename.CString(),
+            it->second_.CString());
+        for (auto it2 = remoteResources_.Begin(); it2 != remoteResources_.End(); ++it2) {
+            if (it2->url_ == it->first_ && it2->filename_ == filename) {
+                it2->filename_ = it->second_;
+                if (it2->ranged_) {
+                    it2->ranged_->filename_ = it->second_;
+                }
+            }
+        }
+        for (auto it2 = httpRequests_.Begin(); it2 != httpRequests_.End(); ++it2) {
+            RemoteResource& resource = it2->resource_;
+            if (resource.url_ == it->first_ && resource.filename_ == filename) {
+                resource.filename_ = it->second_;
+                if (resource.ranged_) {
+                    resource.ranged_->filename_ = it->second_;
+                }
+            }
+        }
+        cancelled = true;
+    }
+#endif
+
+    for (auto it = remoteResources_.Begin(); it != remoteResources_.End();) {
+        if (it->filename_ == filename) {
+            it = remoteResources_.Erase(it);
+            cancelled = true;
+        } else {
+            ++it;
+        }
+    }
+
+#ifdef URHO3D_NETWORK
+    for (auto it = httpRequests_.Begin(); it != httpRequests_.End();) {
+        if (it->resource_.filename_ == filename) {
+            if (--downloadsPerHost_[it->host_] == 0) {
+                downloadsPerHost_.Erase(it->host_);
+            }
+            bufferPool_.Release(it->data_);
+            it = httpRequests_.Erase(it);
+            cancelled = true;
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = partialDownloads_.Begin(); it != partialDownloads_.End();) {
+        if (it->second_->filename_ == filename) {
+            bufferPool_.Release(it->second_->data_);
+            it = partialDownloads_.Erase(it);
+            cancelled = true;
+        } else {
+            ++it;
+        }
+    }
+#endif
+
+    if (cancelled) {
+        LOGRESOURCEINFOF("Cancelled download of remote resource %s", filename.CString());
+    }
+    return cancelled;
+}
+
+unsigned DynamicResourceCache::GetNumActiveDownloads() const
+{
+#ifdef URHO3D_NETWORK
+    return httpRequests_.Size();
+#else
+    return 0;
+#endif
+}
+
+unsigned DynamicResourceCache::GetNumPartialDownloads() const
+{
+#ifdef URHO3D_NETWORK
+    return partialDownloads_.Size();
+#else
+    return 0;
+#endif
+}
+
+void DynamicResourceCache::ClearPartialDownloads()
+{
+#ifdef URHO3D_NETWORK
+    for (auto it = partialDownloads_.Begin(); it != partialDownloads_.End(); ++it) {
+        bufferPool_.Release(it->second_->data_);
+    }
+    partialDownloads_.Clear();
+#endif
+}
+
+bool DynamicResourceCache::SetPersistentCacheDir(const String& directory, bool restore)
+{
+    auto* cache = GetSubsystem<ResourceCache>();
+    if (store_) {
+        store_->SaveIndex();
+        cache->RemoveResourceRouter(store_);
+        cache->RemoveResourceDir(store_->GetDirectory());
+        store_.Reset();
+    }
+
+    if (directory.Empty()) {
+        return true;
+    }
+
+    SharedPtr<PersistentResourceStore> store(new PersistentResourceStore(context_));
+    if (!store->Open(directory)) {
+        return false;
+    }
+
+    // Stored resources are not loaded here, when restoring them the router lets the ResourceCache load them on first request
+    store->SetRouteAll(restore);
+    cache->AddResourceDir(store->GetDirectory());
+    cache->AddResourceRouter(store);
+    store_ = store;
+    return true;
+}
+
+bool DynamicResourceCache::ExportPackage(const String& fileName)
+{
+    Vector<String> names;
+    for (auto it = dynamicResources_.Begin(); it != dynamicResources_.End(); ++it) {
+        names.Push(it->first_);
+    }
+    if (store_) {
+        const auto& entries = store_->GetEntries();
+        for (auto it = entries.Begin(); it != entries.End(); ++it) {
+            if (!dynamicResources_.Contains(it->first_)) {
+                names.Push(it->first_);
+            }
+        }
+    }
+    // Mounting adds entries in package order, so resources which others refer to go first
+    Sort(names.Begin(), names.End(), CompareIngestOrder);
+
+    // Payloads are taken from the package a resource was mounted from or from a store, never through the ResourceCache
+    // where a same-named file may shadow them. Without either nothing added is kept, so the export can't succeed
+    if (!names.Empty() && !store_ && !lazyStore_ && packageResources_.Empty()) {
+        URHO3D_LOGERRORF("Could not export %s, payloads are only kept with SetPersistentCacheDir() called before adding resources",
+            fileName.CString());
+        return false;
+    }
+
+    // A resource whose payload is gone fails the whole export
+    unsigned missing = 0;
+    const String* firstMissing = nullptr;
+    for (auto it = names.Begin(); it != names.End(); ++it) {
+        if (!packageResources_.Contains(*it) && !IsStored(*it)) {
+            if (!missing++) {
+                firstMissing = &*it;
+            }
+        }
+    }
+    if (missing) {
+        URHO3D_LOGERRORF("Could not export %s, payloads of %d resources such as %s are not kept, call SetPersistentCacheDir() "
+            "before adding them", fileName.CString(), missing, firstMissing->CString());
+        return false;
+    }
+
+    File dest(context_, fileName, FILE_WRITE);
+    if (!dest.IsOpen()) {
+        URHO3D_LOGERRORF("Could not open package file %s for writing", fileName.CString());
+        return false;
+    }
+
+    // Write the directory with placeholder offsets, it is rewritten once the data is in place
+    dest.WriteFileID("UPAK");
+    dest.WriteUInt(names.Size());
+    dest.WriteUInt(0);
+    unsigned directoryStart = dest.GetPosition();
+    for (auto it = names.Begin(); it != names.End(); ++it) {
+        dest.WriteString(*it);
+        dest.WriteUInt(0);
+        dest.WriteUInt(0);
+        dest.WriteUInt(0);
+    }
+
+    PODVector<PackageEntry> entries(names.Size());
+    PODVector<unsigned char> payload;
+    unsigned checksum = 0;
+    for (unsigned i = 0; i < names.Size(); ++i) {
+        PackageEntry& entry = entries[i];
+        entry.offset_ = dest.GetPosition();
+        entry.size_ = 0;
+        entry.checksum_ = 0;
+
+        auto package = packageResources_.Find(names[i]);
+        if (package != packageResources_.End()) {
+            unsigned size;
+            const unsigned char* data = package->second_->GetEntryData(names[i], size);
+            if (data) {
+                WritePackageData(dest, data, size, entry, checksum);
+                continue;
+            }
+        } else if ((store_ && store_->Load(names[i], payload)) || (lazyStore_ && lazyStore_->Load(names[i], payload))) {
+            WritePackageData(dest, payload.Buffer(), payload.Size(), entry, checksum);
+            continue;
+        }
+
+        URHO3D_LOGERRORF("Could not read payload of %s, package file %s is discarded", names[i].CString(), fileName.CString());
+        dest.Close();
+        GetSubsystem<FileSystem>()->Delete(fileName);
+        return false;
+    }
+
+    unsigned packageSize = dest.GetSize();
+    dest.Seek(8);
+    dest.WriteUInt(checksum);
+    dest.Seek(directoryStart);
+    for (unsigned i = 0; i < names.Size(); ++i) {
+        dest.WriteString(names[i]);
+        dest.WriteUInt(entries[i].offset_);
+        dest.WriteUInt(entries[i].size_);
+        dest.WriteUInt(entries[i].checksum_);
+    }
+    // Package size at the end allows finding the package when it is appended to another file
+    dest.Seek(packageSize);
+    dest.WriteUInt(packageSize + sizeof(unsigned));
+
+    URHO3D_LOGINFOF("Exported %d dynamic resources to %s, size = %d", names.Size(), fileName.CString(), packageSize);
+    return true;
+}
+
+bool DynamicResourceCache::MountPackage(const String& fileName)
+{
+    for (auto it = mappedPackages_.Begin(); it != mappedPackages_.End(); ++it) {
+        if ((*it)->GetName() == fileName) {
+            URHO3D_LOGERRORF("Package %s is already mounted", fileName.CString());
+            return false;
+        }
+    }
+
+    SharedPtr<MappedPackageFile> package(new MappedPackageFile(context_));
+    if (!package->Open(fileName)) {
+        return false;
+    }
+
+    mappedPackages_.Push(package);
+
+    // In lazy mode the ResourceCache reads the entries from the package itself when they are first requested. The
+    // package goes last, resource directories and packages added before keep their priority
+    auto* cache = GetSubsystem<ResourceCache>();
+    bool lazy = lazyLoading_ && cache->AddPackageFile(fileName);
+
+    mountingPackage_ = package;
+    const auto& entries = package->GetEntries();
+    for (auto it = entries.Begin(); it != entries.End(); ++it) {
+        unsigned size;
+        const unsigned char* data = package->GetEntryData(it->first_, size);
+        ResourceHandler handler;
+        if (lazy && GetResourceHandler(it->first_, (const char*)data, size, handler) && handler.async_ && handler.type_ != StringHash()) {
+            StringHash type = handler.type_ == XMLFile::GetTypeStatic() ? GetXMLResourceType((const char*)data, size) : handler.type_;
+            bool optimizeModel = modelOptimization_ && type == Model::GetTypeStatic();
+            if (!optimizeModel && !cache->GetExistingResource(type, it->first_)) {
+                // The hash lets a later identical payload skip the reload once the resource has been loaded
+                String hash = PersistentResourceStore::ComputeHash(data, size);
+                DynamicResourceInfo& info = RegisterResourceInfo(it->first_);
+                info.type_ = type;
+                info.hash_ = hash;
+                info.lazy_ = true;
+                packageResources_[it->first_] = package;
+                if (store_) {
+                    store_->Store(it->first_, (const char*)data, size, hash);
+                }
+                if (lazyStore_) {
+                    lazyStore_->Remove(it->first_);
+                }
+                ++stats_.numDeferred_;
+                continue;
+            }
+        }
+        IngestResource(it->first_, (const char*)data, size);
+    }
+    mountingPackage_ = nullptr;
+
+    URHO3D_LOGINFOF("Mounted package %s with %d resources%s", fileName.CString(), entries.Size(),
+        package->IsMapped() ? "" : ", memory mapping is not available");
+    return true;
+}
+
+bool DynamicResourceCache::UnmountPackage(const String& fileName)
+{
+    SharedPtr<MappedPackageFile> package;
+    for (auto it = mappedPackages_.Begin(); it != mappedPackages_.End(); ++it) {
+        if ((*it)->GetName() == fileName) {
+            package = *it;
+            mappedPackages_.Erase(it);
+            break;
+        }
+    }
+    if (!package) {
+        URHO3D_LOGERRORF("Package %s is not mounted", fileName.CString());
+        return false;
+    }
+
+    // Loaded resources stay, lazily registered ones are removed unless the persistent store holds their payload
+    StringVector removed;
+    for (auto it = packageResources_.Begin(); it != packageResources_.End();) {
+        if (it->second_ != package.Get()) {
+            ++it;
+            continue;
+        }
+        if (it->first_ == contentName_) {
+            contentValid_ = false;
+        }
+        auto info = dynamicResources_.Find(it->first_);
+        if (!store_ && info != dynamicResources_.End() && info->second_.lazy_ &&
+            !GetSubsystem<ResourceCache>()->GetExistingResource(info->second_.type_, it->first_)) {
+            removed.Push(it->first_);
+        }
+        it = packageResources_.Erase(it);
+    }
+    for (auto it = removed.Begin(); it != removed.End(); ++it) {
+        RemoveResource(*it);
+    }
+    GetSubsystem<ResourceCache>()->RemovePackageFile(fileName, false);
+
+    URHO3D_LOGINFOF("Unmounted package %s, %d lazily registered resources removed", fileName.CString(), removed.Size());
+    return true;
+}
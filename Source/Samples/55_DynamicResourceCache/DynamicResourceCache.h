@@ -22,25 +22,313 @@
 
 #pragma once
 
+#include <Urho3D/Container/HashSet.h>
+#include <Urho3D/Container/List.h>
 #include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Graphics/GraphicsDefs.h>
 #include <list>
 #include <string>
+
+#include "BufferPool.h"
+#include "ModelOptimizer.h"
+#include "PayloadCompression.h"
+
 using namespace Urho3D;
 
 namespace Urho3D {
+    class Image;
+    class File;
+    class LuaFile;
+    class Node;
+    class Resource;
     class ScriptFile;
+    class Shader;
+    class Technique;
+    class Texture2D;
     class XMLElement;
     class VectorBuffer;
     class HttpRequest;
     class VectorBuffer;
 }
 
+class MappedPackageFile;
+class PersistentResourceStore;
+struct OwnedWorkItem;
+class asIScriptFunction;
+
+/// Download priority class, lower value is started first.
+enum DownloadPriority
+{
+    /// Scripts and shaders.
+    DOWNLOAD_PRIORITY_HIGH = 0,
+    /// XML and JSON files - scenes, materials, techniques.
+    DOWNLOAD_PRIORITY_NORMAL,
+    /// Textures, models and everything else.
+    DOWNLOAD_PRIORITY_LOW
+};
+
+/// Remote resource downloaded in byte ranges, assembled into one buffer.
+struct RangedDownload : public RefCounted
+{
+    /// Resource url.
+    String url_;
+    /// Resource name.
+    String filename_;
+    /// Expected hash of the decompressed content, empty if not checked.
+    String hash_;
+    /// Response body, sized to the whole resource.
+    PODVector<unsigned char> data_;
+    /// Start offsets of the chunks, followed by the resource size.
+    PODVector<unsigned> chunkOffsets_;
+    /// Bytes received so far for each chunk, counted from the chunk start.
+    PODVector<unsigned> received_;
+    /// Download attempt. Incremented when the download fails or completes, requests of an earlier attempt are dropped.
+    unsigned generation_{};
+    /// Whether the server has answered a range request with the range instead of the whole resource.
+    bool rangesVerified_{};
+};
+
+/// Remote resource waiting for the download to start.
+struct RemoteResource
+{
+    /// Resource url.
+    String url_;
+    /// Resource name.
+    String filename_;
+    /// Expected hash of the decompressed content, empty if not checked.
+    String hash_;
+    /// Expected response size in bytes used to pre-size the download buffer, 0 if unknown.
+    unsigned sizeHint_{};
+    /// Priority class.
+    DownloadPriority priority_{DOWNLOAD_PRIORITY_LOW};
+    /// Number of failed attempts so far.
+    unsigned attempts_{};
+    /// System time in milliseconds before which the download is not retried.
+    unsigned retryTime_{};
+    /// Ranged download the request fetches a chunk of, null for a whole resource request.
+    SharedPtr<RangedDownload> ranged_;
+    /// Chunk index in the ranged download.
+    unsigned chunk_{};
+    /// Attempt of the ranged download the request belongs to.
+    unsigned generation_{};
+};
+
 #ifdef URHO3D_NETWORK
 /// HTTP request to handle remote resource loading.
-typedef Pair<String, VectorBuffer> NetworkResourceResponse;
-typedef Pair<SharedPtr<HttpRequest>, NetworkResourceResponse> NetworkResourceRequest;
+struct NetworkResourceRequest
+{
+    /// HTTP request.
+    SharedPtr<HttpRequest> request_;
+    /// Remote resource being downloaded.
+    RemoteResource resource_;
+    /// Host which the request counts against.
+    String host_;
+    /// Response body, accumulated every frame while the request is open.
+    PODVector<unsigned char> data_;
+    /// Measures time since the request was made.
+    HiresTimer timer_;
+};
 #endif
 
+/// Load statistics of a resource type.
+struct DynamicResourceTypeStats
+{
+    /// Number of loaded resources.
+    unsigned numLoaded_{};
+    /// Number of failed loads.
+    unsigned numFailed_{};
+    /// Payload bytes of the loaded resources.
+    unsigned long long bytes_{};
+    /// Time spent decoding on worker threads in microseconds.
+    long long parseTime_{};
+    /// Time spent on the main thread in microseconds, including the whole load of synchronously loaded resources.
+    long long mainThreadTime_{};
+};
+
+/// Counters of the dynamic resource pipeline.
+struct DynamicResourceStats
+{
+    /// Number of payloads processed.
+    unsigned numProcessed_{};
+    /// Payload bytes passed to ProcessResource.
+    unsigned long long bytesProcessed_{};
+    /// Number of payloads skipped because the resource has not changed.
+    unsigned numSkipped_{};
+    /// Number of payloads without a handler.
+    unsigned numUnhandled_{};
+    /// Number of payloads registered for loading on first request.
+    unsigned numDeferred_{};
+    /// Number of payloads replaced by a later payload of the same resource before they were loaded.
+    unsigned numCoalescedIngests_{};
+    /// Number of completed downloads.
+    unsigned numDownloaded_{};
+    /// Number of retried downloads.
+    unsigned numDownloadRetries_{};
+    /// Number of downloads which failed after all retries.
+    unsigned numDownloadsFailed_{};
+    /// Number of LoadResourceFromUrl calls which shared a queued or running download of the same url.
+    unsigned numCoalescedDownloads_{};
+    /// Bytes received by downloads, including interrupted ones.
+    unsigned long long bytesDownloaded_{};
+    /// Number of HTTP range requests made.
+    unsigned numRangeRequests_{};
+    /// Number of range requests continuing an interrupted chunk.
+    unsigned numResumedRequests_{};
+    /// Bytes not downloaded again because interrupted chunks were resumed.
+    unsigned long long bytesResumed_{};
+    /// Sum of the completed download durations in microseconds.
+    long long downloadTime_{};
+    /// Time in seconds during which at least one download was running.
+    float downloadActiveTime_{};
+    /// Number of resources evicted to meet the memory budget.
+    unsigned numEvicted_{};
+    /// Number of textures uploaded progressively.
+    unsigned numProgressiveTextures_{};
+    /// Bytes uploaded to progressive textures.
+    unsigned long long progressiveUploadBytes_{};
+    /// Number of decompressed payloads.
+    unsigned numDecompressed_{};
+    /// Number of compressed payloads which could not be decompressed.
+    unsigned numDecompressFailed_{};
+    /// Compressed bytes of the decompressed payloads.
+    unsigned long long bytesCompressed_{};
+    /// Worker thread time spent on decompression in microseconds.
+    long long decompressTime_{};
+    /// Number of precompiled shader variations.
+    unsigned numShaderVariants_{};
+    /// Number of shader variations which failed validation or compilation.
+    unsigned numShaderVariantsFailed_{};
+    /// Time spent on precompiling shader variations in microseconds.
+    long long shaderVariantTime_{};
+    /// Number of optimised models.
+    unsigned numOptimizedModels_{};
+    /// Number of models which could not be optimised and were loaded as they are.
+    unsigned numModelOptimizeFailed_{};
+    /// Vertices removed from optimised models.
+    unsigned long long modelVerticesRemoved_{};
+    /// Vertex cache misses of optimised models before the optimisation.
+    unsigned long long modelCacheMissesBefore_{};
+    /// Vertex cache misses of optimised models after the optimisation.
+    unsigned long long modelCacheMissesAfter_{};
+    /// Triangles of the optimised models, excluding generated LOD levels.
+    unsigned long long modelTriangles_{};
+    /// Number of LOD levels generated for optimised models.
+    unsigned numModelLodLevels_{};
+    /// Time spent on model optimisation in microseconds.
+    long long modelOptimizeTime_{};
+    /// Load statistics by resource type.
+    HashMap<StringHash, DynamicResourceTypeStats> types_;
+};
+
+/// Dynamically added resource has finished loading.
+URHO3D_EVENT(E_DYNAMICRESOURCELOADED, DynamicResourceLoaded)
+{
+    URHO3D_PARAM(P_RESOURCENAME, ResourceName);         // String
+    URHO3D_PARAM(P_SUCCESS, Success);                   // bool
+    URHO3D_PARAM(P_TOTALTIME, TotalTime);               // float, milliseconds from ProcessResource call to completion
+    URHO3D_PARAM(P_MAINTHREADTIME, MainThreadTime);     // float, milliseconds spent on the main thread
+}
+
+/// Batch of dynamically added resources has been committed to the ResourceCache.
+URHO3D_EVENT(E_DYNAMICRESOURCEBATCHLOADED, DynamicResourceBatchLoaded)
+{
+    URHO3D_PARAM(P_BATCHID, BatchId);                   // unsigned
+    URHO3D_PARAM(P_SUCCESS, Success);                   // bool
+    URHO3D_PARAM(P_NUMRESOURCES, NumResources);         // unsigned
+    URHO3D_PARAM(P_NUMFAILED, NumFailed);               // unsigned, nothing is committed if any payload fails to decode
+    URHO3D_PARAM(P_TOTALTIME, TotalTime);               // float, milliseconds from ProcessResourceBatch call to commit
+}
+
+/// Resource payload which is loaded on a worker thread and finalized on the main thread.
+struct AsyncIngestItem : public RefCounted
+{
+    /// Resource name.
+    String filename_;
+    /// Payload, either in the copy or in the data of the batch the resource belongs to.
+    const unsigned char* payload_{};
+    /// Pooled copy of the payload, the caller's buffer is not guaranteed to outlive the call. Empty for batches.
+    PODVector<unsigned char> copy_;
+    /// Payload size.
+    unsigned size_{};
+    /// Resource type that will be created.
+    StringHash type_;
+    /// Payload content hash.
+    String hash_;
+    /// Staging resource which receives BeginLoad() on the worker thread.
+    SharedPtr<Resource> resource_;
+    /// Decoded image for textures, uploaded on the main thread.
+    SharedPtr<Image> image_;
+    /// Whether the texture is uploaded progressively.
+    bool progressive_{};
+    /// Mip levels of a progressively uploaded uncompressed image, generated on the worker thread. The image itself is level 0.
+    Vector<SharedPtr<Image>> mipLevels_;
+    /// Whether the model is optimised on the worker thread before it is loaded.
+    bool optimizeModel_{};
+    /// Model optimisation settings.
+    ModelOptimizeSettings modelSettings_;
+    /// Pooled optimised model data, loaded instead of the payload when the optimisation succeeds.
+    PODVector<unsigned char> optimized_;
+    /// Model optimisation result.
+    ModelOptimizeResult modelResult_;
+    /// Model optimisation error, empty on success.
+    String optimizeError_;
+    /// Worker thread time spent on model optimisation in microseconds.
+    long long optimizeTime_{};
+    /// Work item executing BeginLoad().
+    SharedPtr<OwnedWorkItem> workItem_;
+    /// BeginLoad() result, and EndLoad() result once it has been called.
+    bool success_{};
+    /// Whether EndLoad() has been called already. Batches call it before anything is committed.
+    bool loadEnded_{};
+    /// Measures time since the payload was queued.
+    HiresTimer timer_;
+    /// Main thread time spent on this resource in microseconds.
+    long long mainThreadTime_{};
+    /// Worker thread time spent on this resource in microseconds.
+    long long parseTime_{};
+};
+
+/// Compressed payload which is decompressed on a worker thread before it is processed.
+struct CompressedPayloadItem : public RefCounted
+{
+    /// Resource name without the compression suffix.
+    String filename_;
+    /// Copy of the compressed payload.
+    PODVector<unsigned char> compressed_;
+    /// Decompressed payload.
+    PODVector<unsigned char> data_;
+    /// Payload compression.
+    PayloadCompression compression_{};
+    /// Expected hash of the decompressed payload, empty if not checked.
+    String hash_;
+    /// Decompression error.
+    String error_;
+    /// Work item executing the decompression.
+    SharedPtr<OwnedWorkItem> workItem_;
+    /// Decompression result.
+    bool success_{};
+    /// Whether the payload is a downloaded script which is started after it is added.
+    bool startScript_{};
+    /// Whether a newer payload of the same resource has been processed meanwhile.
+    bool superseded_{};
+    /// Worker thread time spent on decompression in microseconds.
+    long long time_{};
+};
+
+/// Dynamically added resource and the resources it refers to.
+struct DynamicResourceInfo
+{
+    /// Resource type, zero if the payload is not kept as a resource.
+    StringHash type_;
+    /// Content hash of the loaded payload, empty if the last load failed.
+    String hash_;
+    /// Names of the resources this resource refers to.
+    StringVector dependencies_;
+    /// Payload was only registered, the ResourceCache loads it when it is first requested.
+    bool lazy_{};
+};
+
 /// Allows adding dynamic data to the resource cache.
 class URHO3D_API DynamicResourceCache : public Object {
 URHO3D_OBJECT(DynamicResourceCache, Object);
@@ -51,53 +339,661 @@ public:
 
     /// Destruct. Free all resources.
     ~DynamicResourceCache() override;
-    /// Call Start() method to the dynamically loaded AngelScript files.
+    /// Call Start() method to the dynamically loaded AngelScript files and run the dynamically loaded Lua files.
     void StartScripts();
-    /// Start single AngelScript file.
+    /// Start single AngelScript file, or run single Lua file and call its Start() function.
     void StartSingleScript(const String& filename);
-    /// Get textual resource data - XML,JSON, etc.
-    String GetResourceContent(const String& filename);
-    /// Get binary resource data - images, models, etc.
-    void* GetResourceContentBinary(const String& filename);
-    /// Load resource from url.
-    void LoadResourceFromUrl(const String& url, const String& filename);
-    /// Process single resource.
+    /// Enable or disable running Lua files as soon as they are added, the same way as StartSingleScript() does.
+    void SetLuaRunOnLoad(bool enable) { luaRunOnLoad_ = enable; }
+    /// Return whether Lua files are run as soon as they are added.
+    bool GetLuaRunOnLoad() const { return luaRunOnLoad_; }
+    /// Enable or disable batch compilation of AngelScript files. When enabled, added scripts are compiled together once per
+    /// frame or before they are started, and a script sent several times in between is compiled only once.
+    void SetScriptBatchCompile(bool enable) { scriptBatchCompile_ = enable; }
+    /// Return whether AngelScript files are compiled in batches.
+    bool GetScriptBatchCompile() const { return scriptBatchCompile_; }
+    /// Compile AngelScript files waiting for batch compilation.
+    void CompileScripts();
+    /// Return number of AngelScript files waiting for batch compilation.
+    unsigned GetNumPendingScripts() const;
+    /// Clear compiled AngelScript and Lua bytecode caches.
+    void ClearScriptByteCodeCache();
+    /// Get textual resource data - XML,JSON, etc. Content is returned exactly as stored and stays valid until the next call.
+    const String& GetResourceContent(const String& filename);
+    /// Enable or disable reusing the last read text content while the resource has not changed.
+    void SetContentCacheEnabled(bool enable) { contentCacheEnabled_ = enable; }
+    /// Return whether the last read text content is reused.
+    bool GetContentCacheEnabled() const { return contentCacheEnabled_; }
+    /// Get binary resource data - images, models, etc. Optionally only a range of it. Entries of uncompressed packages are
+    /// returned in place, other files are read into a reused buffer. Data stays valid until the next call. Return null if not found.
+    const void* GetResourceContentBinary(const String& filename, unsigned& size, unsigned offset = 0, unsigned length = M_MAX_UNSIGNED);
+    /// Load resource from url. Size hint in bytes is used to pre-size the download buffer. When the content hash is known
+    /// and matches the persistent store, the stored copy is used without downloading. The hash is that of the decompressed content.
+    void LoadResourceFromUrl(const String& url, const String& filename, unsigned sizeHint = 0, const String& hash = String::EMPTY);
+    /// Cancel queued or running download of a resource. Return true if anything was cancelled.
+    bool CancelResourceDownload(const String& filename);
+    /// Set maximum number of downloads running at the same time.
+    void SetMaxConcurrentDownloads(unsigned count) { maxConcurrentDownloads_ = Max(count, 1U); }
+    /// Return maximum number of downloads running at the same time.
+    unsigned GetMaxConcurrentDownloads() const { return maxConcurrentDownloads_; }
+    /// Set maximum number of downloads running at the same time from a single host.
+    void SetMaxDownloadsPerHost(unsigned count) { maxDownloadsPerHost_ = Max(count, 1U); }
+    /// Return maximum number of downloads running at the same time from a single host.
+    unsigned GetMaxDownloadsPerHost() const { return maxDownloadsPerHost_; }
+    /// Set how many times a failed download is retried.
+    void SetMaxDownloadRetries(unsigned count) { maxDownloadRetries_ = count; }
+    /// Return how many times a failed download is retried.
+    unsigned GetMaxDownloadRetries() const { return maxDownloadRetries_; }
+    /// Set delay in milliseconds before the first retry, doubled on every following attempt.
+    void SetDownloadRetryDelay(unsigned ms) { downloadRetryDelay_ = ms; }
+    /// Return delay in milliseconds before the first retry.
+    unsigned GetDownloadRetryDelay() const { return downloadRetryDelay_; }
+    /// Enable or disable HTTP range requests for downloads with a size hint, which must then be the exact size. Interrupted
+    /// downloads continue where they stopped and resources larger than the chunk size are fetched in parallel chunks.
+    void SetRangeDownloads(bool enable) { rangeDownloads_ = enable; }
+    /// Return whether downloads with a size hint use range requests.
+    bool GetRangeDownloads() const { return rangeDownloads_; }
+    /// Set chunk size in bytes for range requests.
+    void SetDownloadChunkSize(unsigned size) { downloadChunkSize_ = Max(size, 1024U); }
+    /// Return chunk size in bytes for range requests.
+    unsigned GetDownloadChunkSize() const { return downloadChunkSize_; }
+    /// Return number of failed ranged downloads kept to be resumed by the next LoadResourceFromUrl() call.
+    unsigned GetNumPartialDownloads() const;
+    /// Drop the data of failed ranged downloads.
+    void ClearPartialDownloads();
+    /// Return number of downloads waiting to start.
+    unsigned GetNumQueuedDownloads() const { return remoteResources_.Size(); }
+    /// Return number of running downloads.
+    unsigned GetNumActiveDownloads() const;
+    /// Process single resource. Gzip and LZ4 payloads, recognized by .gz/.lz4 suffix or magic bytes, are decompressed on a
+    /// worker thread first and processed under the name without the suffix. With ingest coalescing the payload is copied
+    /// and loaded in the next update.
     void ProcessResource(const String& filename, const char* content, int size);
+    /// Enable or disable ingest coalescing. When enabled, ProcessResource only keeps a copy of the payload. The resource is
+    /// loaded in the next update, once with the latest payload no matter how many times it has been processed meanwhile.
+    void SetIngestCoalescing(bool enable) { ingestCoalescing_ = enable; }
+    /// Return whether ingest coalescing is enabled.
+    bool GetIngestCoalescing() const { return ingestCoalescing_; }
+    /// Return number of coalesced payloads waiting for the next update.
+    unsigned GetNumCoalescedIngests() const { return coalescedIngests_.Size(); }
+    /// Return interned copy of a resource name, so that calls with the name of a registered resource do not allocate.
+    /// Other names are copied into the storage string. Names are interned when their resource is registered and dropped
+    /// when it is removed.
+    const String& InternName(const char* name, String& storage) const;
+    /// Return pool of the transient payload buffers: download bodies, batch data and payload copies.
+    BufferPool& GetBufferPool() { return bufferPool_; }
+    /// Process resources packed into a single blob. Manifest is a JSON array of {"name", "offset", "size"} objects.
+    /// Payloads are decoded on worker threads and committed to the ResourceCache in a single frame. Return batch id, 0 on error.
+    unsigned ProcessResourceBatch(const String& manifest, const void* data, unsigned size);
+    /// Decode base64 content or a data URI and process the resulting resource. Return false if the content can't be decoded.
+    bool ProcessResourceBase64(const String& filename, const char* content, unsigned length);
+    /// Decode base64 content, standard or URL-safe alphabet, whitespace is skipped. Return true on success.
+    static bool DecodeBase64(const char* content, unsigned length, PODVector<unsigned char>& dest);
+    /// Decode payload of a data URI, either base64 or percent-encoded. Content without the data: scheme is decoded as base64. Return true on success.
+    static bool DecodeDataURI(const char* content, unsigned length, PODVector<unsigned char>& dest);
+    /// Return number of batches waiting to be committed.
+    unsigned GetNumPendingBatches() const { return pendingBatches_.Size(); }
+    /// Register resource type for a file extension, e.g. ".ogg". Payloads are loaded through the type's Load() function.
+    void RegisterResourceExtension(const String& extension, StringHash type);
+    /// Register resource type for payloads starting with magic bytes, checked when the extension is not registered.
+    void RegisterResourceMagic(const String& magic, StringHash type);
+    /// Register resource type for XML files with a root element name, e.g. "particleeffect".
+    void RegisterXMLRootType(const String& rootName, StringHash type);
+    /// Remove resource type registration of a file extension.
+    void UnregisterResourceExtension(const String& extension);
+    /// Persist added resources in a directory. Empty directory disables it. Resources stored in previous sessions serve
+    /// downloads with a known hash, with restore they are also loaded on request and take the place of same-named files.
+    bool SetPersistentCacheDir(const String& directory, bool restore = false);
+    /// Return persistent resource store, null if disabled.
+    PersistentResourceStore* GetPersistentStore() const { return store_; }
+    /// Write all dynamically added resources into an uncompressed Urho3D package file. Payloads are not kept by default, so
+    /// this needs SetPersistentCacheDir() to be called before the resources are added, except for those from mounted
+    /// packages. Fails without writing anything if the payload of a resource is neither in a mounted package nor in a
+    /// store. Return true on success.
+    bool ExportPackage(const String& fileName);
+    /// Memory-map a package file and add all its entries without per-file reads. Return false if it fails or the package is
+    /// already mounted.
+    bool MountPackage(const String& fileName);
+    /// Remove a mounted package. Resources loaded from it stay loaded, lazily registered ones that nothing else can
+    /// provide are removed. Return true if the package was mounted.
+    bool UnmountPackage(const String& fileName);
+    /// Remove dynamically added resource from the ResourceCache and the persistent store. Return true if it was added.
+    bool RemoveResource(const String& filename);
+    /// Remove dynamically added resources whose name starts with a prefix. Return number of removed resources.
+    unsigned RemoveResourcesByPrefix(const String& prefix);
+    /// Remove dynamically added resources of a type. Return number of removed resources.
+    unsigned RemoveResourcesByType(StringHash type);
+    /// Set memory budget in bytes for dynamically added resources, 0 for unlimited. Least recently used resources which the ResourceCache can load again are released when it is exceeded.
+    /// Only resources kept in a store or in a package added to the ResourceCache can be released, so without SetPersistentCacheDir(),
+    /// lazy loading or lazily mounted packages the budget is only reported as exceeded.
+    void SetMemoryBudget(unsigned long long budget);
+    /// Return memory budget in bytes for dynamically added resources.
+    unsigned long long GetMemoryBudget() const { return memoryBudget_; }
+    /// Return memory use in bytes of the dynamically added resources currently in the ResourceCache.
+    unsigned long long GetMemoryUse() const;
+    /// Return pipeline counters.
+    const DynamicResourceStats& GetStats() const { return stats_; }
+    /// Return pipeline counters and queue depths as a JSON string.
+    String GetStatsJSON() const;
+    /// Return download throughput in bytes per second while downloads are running.
+    float GetDownloadThroughput() const;
+    /// Reset pipeline counters.
+    void ResetStats() { stats_ = DynamicResourceStats(); }
+    /// Enable or disable info logging of every processed resource. Errors and warnings are always logged.
+    void SetResourceLogging(bool enable) { resourceLogging_ = enable; }
+    /// Return whether info logging of every processed resource is enabled.
+    bool GetResourceLogging() const { return resourceLogging_; }
+    /// Return all resources added through ProcessResource.
+    const HashMap<String, DynamicResourceInfo>& GetDynamicResources() const { return dynamicResources_; }
+    /// Return names of the resources that refer to a resource.
+    StringVector GetResourceDependents(const String& filename) const;
+    /// Set maximum number of dependent resources refreshed per frame after a change.
+    void SetMaxReloadPropagationsPerFrame(unsigned count) { maxReloadPropagationsPerFrame_ = Max(count, 1U); }
+    /// Return maximum number of dependent resources refreshed per frame after a change.
+    unsigned GetMaxReloadPropagationsPerFrame() const { return maxReloadPropagationsPerFrame_; }
+    /// Return number of dependent resources waiting to be refreshed.
+    unsigned GetNumPendingReloads() const { return pendingReloads_.Size(); }
+    /// Enable or disable asynchronous ingest. When enabled, the CPU-heavy part of loading runs on worker threads.
+    void SetAsyncIngest(bool enable) { asyncIngest_ = enable; }
+    /// Return whether asynchronous ingest is enabled.
+    bool GetAsyncIngest() const { return asyncIngest_; }
+    /// Set main thread time budget in milliseconds for finalizing asynchronously loaded resources per frame.
+    void SetFinishLoadTimeBudget(int ms) { finishLoadTimeBudget_ = ms; }
+    /// Return main thread time budget in milliseconds for finalizing asynchronously loaded resources per frame.
+    int GetFinishLoadTimeBudget() const { return finishLoadTimeBudget_; }
+    /// Enable or disable lazy loading. When enabled, payloads of resource types the ResourceCache can load by itself are only
+    /// stored and loaded when first requested. Scripts and resources which are already loaded are always loaded right away.
+    void SetLazyLoading(bool enable) { lazyLoading_ = enable; }
+    /// Return whether lazy loading is enabled.
+    bool GetLazyLoading() const { return lazyLoading_; }
+    /// Start background loading of lazily registered resources. Return number of resources queued.
+    unsigned PrefetchResources(const StringVector& names);
+    /// Start background loading of the lazily registered resources referred to by the components of a node and its children. Return number of resources queued.
+    unsigned PrefetchNodeResources(Node* node);
+    /// Enable or disable precompiling the shader variations which the passes of loaded techniques and materials need, when
+    /// GLSL shaders, techniques or materials are added. Variations are built over several frames within the time budget.
+    void SetShaderPrecompile(bool enable) { shaderPrecompile_ = enable; }
+    /// Return whether shader variations are precompiled.
+    bool GetShaderPrecompile() const { return shaderPrecompile_; }
+    /// Set define combinations added to the pass defines of every precompiled variation, e.g. the geometry and lighting
+    /// defines the renderer uses. Default is a single empty combination.
+    void SetShaderVariantDefines(const StringVector& defines) { shaderVariantDefines_ = defines; }
+    /// Return define combinations added to the pass defines of every precompiled variation.
+    const StringVector& GetShaderVariantDefines() const { return shaderVariantDefines_; }
+    /// Set main thread time budget in milliseconds for precompiling shader variations per frame.
+    void SetShaderPrecompileTimeBudget(int ms) { shaderPrecompileTimeBudget_ = ms; }
+    /// Return main thread time budget in milliseconds for precompiling shader variations per frame.
+    int GetShaderPrecompileTimeBudget() const { return shaderPrecompileTimeBudget_; }
+    /// Queue the shader variations of all loaded techniques and materials for precompiling.
+    void PrecompileShaders();
+    /// Precompile queued shader variations within the time budget. Without Graphics they are only preprocessed and validated.
+    void BuildShaderVariants();
+    /// Return number of shader variations waiting to be precompiled.
+    unsigned GetNumPendingShaderVariants() const { return pendingShaderVariants_.Size(); }
+    /// Preprocess shader variation and validate it without a GPU. Return true if valid, otherwise the error is logged.
+    bool ValidateShaderVariant(const String& filename, ShaderType type, const String& defines);
+    /// Return preprocessed source of shader variation, empty if it is not valid.
+    const String& GetPreprocessedShader(const String& filename, ShaderType type, const String& defines);
+    /// Clear preprocessed shader source cache.
+    void ClearShaderVariantCache() { preprocessedShaders_.Clear(); }
+    /// Enable or disable progressive texture loading. Large textures are added with their low mip levels as a placeholder
+    /// first, the full texture is then uploaded level by level over several frames and replaces the placeholder in materials.
+    void SetProgressiveTextures(bool enable) { progressiveTextures_ = enable; }
+    /// Return whether textures are loaded progressively.
+    bool GetProgressiveTextures() const { return progressiveTextures_; }
+    /// Set upload budget in bytes per frame for progressive textures.
+    void SetTextureUploadBudget(unsigned bytes) { textureUploadBudget_ = Max(bytes, 1U); }
+    /// Return upload budget in bytes per frame for progressive textures.
+    unsigned GetTextureUploadBudget() const { return textureUploadBudget_; }
+    /// Set largest width or height of the mip level used as the placeholder. Textures which are not larger are added at once.
+    void SetProgressiveTextureTailSize(int size) { progressiveTextureTailSize_ = Max(size, 1); }
+    /// Return largest width or height of the mip level used as the placeholder.
+    int GetProgressiveTextureTailSize() const { return progressiveTextureTailSize_; }
+    /// Enable or disable model optimisation. Models are optimised on a worker thread before they are loaded: duplicate
+    /// vertices are merged, triangles are reordered for the vertex cache and vertices by first use, and simplified LOD
+    /// levels are generated if the settings ask for them.
+    void SetModelOptimization(bool enable) { modelOptimization_ = enable; }
+    /// Return whether models are optimised.
+    bool GetModelOptimization() const { return modelOptimization_; }
+    /// Set model optimisation settings.
+    void SetModelOptimizeSettings(const ModelOptimizeSettings& settings) { modelSettings_ = settings; }
+    /// Return model optimisation settings.
+    const ModelOptimizeSettings& GetModelOptimizeSettings() const { return modelSettings_; }
+    /// Return number of textures being uploaded progressively.
+    unsigned GetNumProgressiveTextures() const { return progressiveUploads_.Size(); }
+    /// Return number of compressed payloads waiting for decompression.
+    unsigned GetNumPendingDecompressions() const { return pendingDecompressions_.Size(); }
+    /// Return number of resources waiting for asynchronous ingest to finish.
+    unsigned GetNumPendingIngests() const { return pendingIngests_.Size(); }
 
 private:
+    /// Resource handler function.
+    typedef bool (DynamicResourceCache::*ResourceHandlerFunction)(const String& filename, const char* content, int size);
+
+    /// Resource handler registered for an extension or magic bytes.
+    struct ResourceHandler
+    {
+        /// Resource type.
+        StringHash type_;
+        /// Specialized handler, null to load the resource type generically.
+        ResourceHandlerFunction function_{};
+        /// Whether the loading can be split between a worker thread and the main thread.
+        bool async_{};
+    };
+
+    /// Payload waiting for the next update, replaced when the same resource is processed again meanwhile.
+    struct CoalescedIngest
+    {
+        /// Resource name, empty if the resource has been removed meanwhile.
+        String filename_;
+        /// Copy of the latest payload.
+        PODVector<unsigned char> data_;
+        /// Number of ProcessResource calls collapsed into the payload.
+        unsigned calls_{};
+    };
+
+    /// Resource of a batch, staged without touching the store or the resource maps until the whole batch is committed.
+    struct BatchResource
+    {
+        /// Resource name.
+        String filename_;
+        /// Payload in the batch data, or in the decompressed data once a compressed entry is staged.
+        const char* content_{};
+        /// Payload size.
+        int size_{};
+        /// Compression of the entry in the batch data.
+        PayloadCompression compression_{};
+        /// Resource handler.
+        ResourceHandler handler_;
+        /// Payload content hash.
+        String hash_;
+        /// Decompression of a compressed entry on a worker thread.
+        SharedPtr<CompressedPayloadItem> decompression_;
+        /// Resource decoded on a worker thread, null if the resource is loaded synchronously when the batch is committed.
+        SharedPtr<AsyncIngestItem> item_;
+        /// Whether the payload, handler and hash are known, false while a compressed entry is being decompressed.
+        bool staged_{};
+        /// Whether decompression failed or no handler was found, which discards the batch.
+        bool failed_{};
+        /// Whether the resource was removed while the batch was pending, which leaves it out of the commit.
+        bool removed_{};
+    };
+
+    /// Resources processed together and committed to the ResourceCache in a single frame.
+    struct ResourceBatch : public RefCounted
+    {
+        /// Batch id.
+        unsigned id_{};
+        /// Pooled copy of the blob holding all payloads.
+        PODVector<unsigned char> data_;
+        /// Staged resources in load order.
+        Vector<BatchResource> resources_;
+        /// Measures time since the batch was queued.
+        HiresTimer timer_;
+    };
+
+    /// Texture uploaded level by level, from the smallest level to the largest.
+    struct ProgressiveTexture : public RefCounted
+    {
+        /// Resource name.
+        String filename_;
+        /// Payload hash. The upload is stale once the resource has been loaded from another payload.
+        String hash_;
+        /// Texture in the ResourceCache holding the low mip levels until the upload is complete.
+        SharedPtr<Texture2D> placeholder_;
+        /// Full size texture receiving the uploads.
+        SharedPtr<Texture2D> texture_;
+        /// Decoded image.
+        SharedPtr<Image> image_;
+        /// Mip levels of an uncompressed image, level 0 first.
+        Vector<SharedPtr<Image>> levels_;
+        /// Level being uploaded.
+        unsigned level_{};
+        /// Next row to upload in the level.
+        int row_{};
+    };
+
+    /// Shader variation waiting to be precompiled.
+    struct ShaderVariantRequest
+    {
+        /// Shader resource name.
+        String shader_;
+        /// Shader type.
+        ShaderType type_;
+        /// Normalized defines.
+        String defines_;
+    };
+
+    /// Preprocessed shader variation.
+    struct PreprocessedShader
+    {
+        /// Active source lines, empty if not valid.
+        String source_;
+        /// Validation error.
+        String error_;
+    };
+
+    /// Compiled scripts by resource name and source hash. Entries outlive the resources, so that going back to an earlier
+    /// source or adding a removed script again skips the compiler. The oldest entries are dropped above the size limit.
+    struct ScriptByteCodeCache
+    {
+        /// Return bytecode of a resource source, null if not cached.
+        const PODVector<unsigned char>* Find(const String& filename, const String& hash) const;
+        /// Add bytecode of a resource source.
+        void Insert(const String& filename, const String& hash, const PODVector<unsigned char>& data);
+        /// Remove all entries.
+        void Clear();
+
+        /// Bytecode by resource name and source hash.
+        HashMap<String, PODVector<unsigned char>> entries_;
+        /// Keys from the oldest to the newest entry.
+        List<String> order_;
+        /// Total bytecode size.
+        unsigned size_{};
+    };
+
+    /// Register built-in handler for an extension.
+    void RegisterHandler(const String& extension, StringHash type, ResourceHandlerFunction function, bool async);
+    /// Find handler for a resource by extension, then by magic bytes. Return true if found.
+    bool GetResourceHandler(const String& filename, const char* content, int size, ResourceHandler& handler) const;
+    /// Return resource type of an XML payload from its root element name, without parsing it.
+    StringHash GetXMLResourceType(const char* content, int size) const;
+    /// Return whether a newer payload of a resource is still being loaded.
+    bool IsIngestPending(const String& filename) const { return pendingIngestCounts_.Contains(filename); }
+    /// Remove one pending payload of a resource from the counts.
+    void RemovePendingIngest(const String& filename);
+    /// Process single resource right away, without ingest coalescing.
+    void IngestResource(const String& filename, const char* content, int size);
+    /// Register resource payload with the resource maps and the persistent store before it is loaded. Return the resource info.
+    DynamicResourceInfo& RecordIngest(const String& filename, const char* content, int size, const String& hash);
+    /// Report a payload that is identical to the loaded resource and needs no reload.
+    void ReportUnchanged(const String& filename);
+    /// Keep copy of a payload to be loaded in the next update, replacing an earlier payload of the same resource.
+    void CoalesceIngest(const String& filename, const char* content, int size);
+    /// Load the coalesced payloads in the order the resources were first processed.
+    void FlushCoalescedIngests();
+    /// Send the completion callbacks owed to the calls which were collapsed into a load of the resource.
+    void NotifyIngestWaiters(const String& filename, bool success);
+    /// Load resource synchronously through its handler. Return true on success.
+    bool LoadResource(const String& filename, const char* content, int size, const ResourceHandler& handler, const String& hash);
+    /// Add resource of a registered type to the ResourceCache.
+    bool AddResource(StringHash type, const String& filename, const char* content, int size);
     /// Add AngelScript file to the ResourceCache.
-    void AddAngelScriptFile(const String& filename, const char* content, int size);
-    /// Add LUA file to the ResourceCache.
-    void AddLuaScriptFile(const String& filename, const char* content, int size);
+    bool AddAngelScriptFile(const String& filename, const char* content, int size);
+    /// Compile AngelScript file, from cached bytecode if its latest source has been compiled before, and add it to the ResourceCache.
+    bool CompileAngelScriptFile(const String& filename, const char* content, int size);
+    /// Queue the shader variations which need rebuilding after a shader, technique or material has been loaded.
+    void QueueShaderVariants(const String& filename, StringHash type);
+    /// Queue the shader variations of technique passes, only those of one shader if name is not empty.
+    void QueueTechniqueVariants(Technique* technique, const String& shader);
+    /// Queue shader variation unless it is already queued.
+    void QueueShaderVariant(const String& shader, ShaderType type, const String& defines);
+    /// Preprocess shader variation, from cache if the same source has been preprocessed with the same defines before.
+    const PreprocessedShader& PreprocessShaderVariant(Shader* shader, ShaderType type, const String& defines);
+    /// Add LUA file to the ResourceCache, from cached precompiled chunk if the same source has been compiled before.
+    bool AddLuaScriptFile(const String& filename, const char* content, int size);
+    /// Run Lua file chunk the first time the file is started and call the Start() function it defines.
+    bool RunLuaScriptFile(LuaFile* file);
+    /// Release the Start() function of a Lua file, so that the chunk is run again the next time the file is started.
+    void ReleaseLuaStart(const String& filename);
+    /// Run JavaScript file in web builds.
+    bool AddJavaScriptFile(const String& filename, const char* content, int size);
     /// Add XML file to the ResourceCache.
-    void AddXMLFile(const String& filename, const char* content, int size);
+    bool AddXMLFile(const String& filename, const char* content, int size);
     /// Add JSON file to the ResourceCache.
-    void AddJSONFile(const String& filename, const char* content, int size);
+    bool AddJSONFile(const String& filename, const char* content, int size);
     /// Add GLSL file to the ResourceCache.
-    void AddGLSLShader(const String& filename, const char* content, int size);
+    bool AddGLSLShader(const String& filename, const char* content, int size);
     /// Add Material file to the ResourceCache.
-    void AddMaterialFile(const String& filename, const XMLElement& source);
+    bool AddMaterialFile(const String& filename, const XMLElement& source);
     /// Add Techinque file to the ResourceCache.
-    void AddTechniqueFile(const String& filename, const char* content, int size);
+    bool AddTechniqueFile(const String& filename, const char* content, int size);
     /// Add Image file to the ResourceCache.
-    void AddImageFile(const String& filename, const char* content, int size);
+    bool AddImageFile(const String& filename, const char* content, int size);
     /// Add model to ResourceCache.
-    void AddModel(const String& filename, const char* content, int size);
+    bool AddModel(const String& filename, const char* content, int size);
+    /// Add model optimisation result to the statistics and log it.
+    void RecordModelOptimization(const String& filename, const ModelOptimizeResult& result, const String& error, long long time);
     /// Handle queue data and add resources.
     void HandleUpdate(StringHash eventType, VariantMap& eventData);
-    /// Checks if filename has image extension.
-    bool IsImage(const String& filename);
+    /// Insert remote resource into the download queue after the resources of the same or higher priority.
+    void QueueDownload(const RemoteResource& resource);
+    #ifdef URHO3D_NETWORK
+    /// Start queued downloads allowed by the concurrency limits.
+    void StartDownloads();
+    /// Read received data and handle completion of a download. Return true when the request is finished.
+    bool UpdateDownload(NetworkResourceRequest& download);
+    /// Copy the response of a finished range request into the ranged download, retry if the chunk is incomplete.
+    void UpdateRangedDownload(NetworkResourceRequest& download, bool failed);
+    /// Queue failed download for another attempt, or give up when out of retries.
+    void RetryDownload(RemoteResource resource, const String& error);
+    /// Report failed download to the resource and the resources sharing it. The received ranges of a ranged download
+    /// are kept to be resumed if requested, otherwise they are freed.
+    void FailDownload(const RemoteResource& resource, const String& error, bool keepPartial);
+    /// Return whether a downloaded body matches the expected hash. Compressed bodies are checked after decompression.
+    bool VerifyDownload(const RemoteResource& resource, const PODVector<unsigned char>& data) const;
+    /// Queue range requests for the missing chunks of a resource, continuing a partial download of the url if there is one.
+    void QueueRangedDownload(const String& url, const String& filename, unsigned size, const String& hash);
+    /// Process downloaded response body, also for the resources which shared the download.
+    void ProcessDownload(const String& filename, const String& url, const PODVector<unsigned char>& data, const String& hash);
+    /// Let a resource share a queued or running download of the url. Return false if there is none.
+    bool CoalesceDownload(const String& url, const String& filename);
+    #endif
+    /// Locate resource content either as a view of package memory or as an open file. Return false if not found.
+    bool LocateResource(const String& filename, const unsigned char*& view, unsigned& size, SharedPtr<File>& file);
+    /// Return entry data of a ResourceCache package file through a memory-mapped view. Return null if compressed or not found.
+    const unsigned char* GetPackageView(const String& filename, unsigned& size);
+    /// Register resource payload for loading on first request. Return false if it has to be loaded right away.
+    bool DeferResource(const String& filename, const char* content, int size, StringHash type, const String& hash);
+    /// Open the session store holding lazily registered payloads when there is no persistent store. Return true on success.
+    bool OpenLazyStore();
+    /// Remove the session store from the ResourceCache and delete its payloads.
+    void CloseLazyStore();
+    /// Queue compressed payload for decompression on a worker thread.
+    void QueueDecompression(const String& filename, const char* content, int size, PayloadCompression compression, bool startScript,
+        const String& hash = String::EMPTY);
+    /// Start decompression of a payload on a worker thread.
+    SharedPtr<CompressedPayloadItem> StartDecompression(const String& filename, const char* content, int size, PayloadCompression compression,
+        const String& hash, bool startScript);
+    /// Process the payloads which have been decompressed, in the order they were queued.
+    void FinishDecompressions();
+    /// Queue resource for asynchronous ingest. Return null if the resource has to be loaded synchronously. Batched resources
+    /// keep their payload in the batch data and are committed with the batch instead of one by one.
+    SharedPtr<AsyncIngestItem> QueueAsyncIngest(const String& filename, const char* content, int size, StringHash type,
+        const String& hash, bool batched);
+    /// Finalize asynchronously loaded resources on the main thread within the time budget.
+    void FinishAsyncIngests();
+    /// Finalize single asynchronously loaded resource. Return true on success.
+    bool FinishAsyncIngest(AsyncIngestItem* item);
+    /// Add the low mip levels of a decoded image to the texture and queue the full texture for progressive upload. Return true on success.
+    bool StartProgressiveTexture(Texture2D* texture, AsyncIngestItem* item);
+    /// Upload queued progressive textures within the byte budget.
+    void UploadProgressiveTextures();
+    /// Replace the placeholder of a completely uploaded texture in the ResourceCache and in materials.
+    void FinishProgressiveTexture(ProgressiveTexture* upload);
+    /// Return whether a progressive texture upload still has the latest payload of its resource.
+    bool IsProgressiveTextureCurrent(const ProgressiveTexture* upload) const;
+    /// Stop progressive upload of a texture.
+    void CancelProgressiveTexture(const String& filename);
+    /// Commit batches whose payloads have all been decoded, in the order they were queued.
+    void CommitBatches();
+    /// Stage decompressed entry of a batch and queue it for decoding.
+    void StageDecompressedResource(ResourceBatch* batch, BatchResource& resource);
+    /// Process decompressed payload or report the failed decompression.
+    void ProcessDecompressed(CompressedPayloadItem* item);
+    /// Commit single batch to the ResourceCache.
+    void CommitBatch(ResourceBatch* batch);
+    /// Register and load single resource of a batch which is being committed. Return true on success.
+    bool CommitBatchResource(const BatchResource& resource);
+    /// Return info of a dynamic resource, registering the resource and interning its name if it is new.
+    DynamicResourceInfo& RegisterResourceInfo(const String& filename);
+    /// Record the load result of a resource, update its dependencies and queue its dependents for refresh.
+    void UpdateResourceGraph(const String& filename, StringHash type, const String& hash, bool loaded, bool reloaded);
+    /// Return names of the resources a loaded resource refers to.
+    StringVector CollectDependencies(const String& filename, StringHash type) const;
+    /// Append dependents of a resource to the list in depth-first postorder.
+    void CollectDependents(const String& filename, HashSet<String>& visited, StringVector& order) const;
+    /// Add load result of a resource to the statistics of its type.
+    void RecordLoad(StringHash type, unsigned size, bool loaded, long long parseTime, long long mainThreadTime);
+    /// Release least recently used resources that nothing else refers to until the memory budget is met.
+    void CheckMemoryBudget();
+    /// Return whether the persistent or the session store holds the payload of a resource.
+    bool IsStored(const String& filename) const;
+    /// Return whether an evicted resource can be loaded again by the ResourceCache.
+    bool CanReloadResource(const String& filename) const;
+    /// Refresh queued dependent resources, at most the per-frame limit.
+    void PropagateReloads();
+    /// Refresh single dependent resource after something it refers to has changed.
+    void RefreshDependent(const String& filename);
 
-    /// Remote resource queue.
-    List<String> remoteResources_;
+    /// Resource handlers by lowercase extension hash.
+    HashMap<StringHash, ResourceHandler> handlers_;
+    /// Resource handlers by magic bytes.
+    Vector<Pair<String, ResourceHandler> > magicHandlers_;
+    /// Resource types by XML root element name hash.
+    HashMap<StringHash, StringHash> xmlRootTypes_;
+    /// Remote resource queue, sorted by priority.
+    List<RemoteResource> remoteResources_;
+    /// Maximum number of downloads running at the same time.
+    unsigned maxConcurrentDownloads_{16};
+    /// Maximum number of downloads running at the same time from a single host.
+    unsigned maxDownloadsPerHost_{6};
+    /// Number of retries for failed downloads.
+    unsigned maxDownloadRetries_{3};
+    /// Delay in milliseconds before the first retry.
+    unsigned downloadRetryDelay_{500};
+    /// Chunk size in bytes for range requests.
+    unsigned downloadChunkSize_{4 * 1024 * 1024};
+    /// Range request flag.
+    bool rangeDownloads_{};
     #ifdef URHO3D_ANGELSCRIPT
     /// Custom .as script handler to support calling Start() method on them.
     HashMap<String, SharedPtr<ScriptFile>> asScripts_;
+    /// Start() functions of the AngelScript files which have one, looked up again whenever a file is compiled.
+    HashMap<String, asIScriptFunction*> asStartFunctions_;
+    /// AngelScript payloads waiting for batch compilation.
+    HashMap<String, PODVector<unsigned char>> pendingScripts_;
+    /// Compiled AngelScript bytecode.
+    ScriptByteCodeCache scriptByteCode_;
+    #endif
+    #ifdef URHO3D_LUA
+    /// Dynamically loaded Lua files.
+    HashMap<String, SharedPtr<LuaFile>> luaScripts_;
+    /// Precompiled Lua chunks.
+    ScriptByteCodeCache luaByteCode_;
+    /// Registry references to the Start() functions of the Lua files which have been run, LUA_NOREF if a file has none.
+    HashMap<String, int> luaStartRefs_;
     #endif
-    /// Buffer used to serve resource data to JS.
-    VectorBuffer buffer_;
+    /// Resources loading on worker threads, in the order they were queued.
+    List<SharedPtr<AsyncIngestItem>> pendingIngests_;
+    /// Number of payloads loading on worker threads or waiting in uncommitted batches by resource name.
+    HashMap<String, unsigned> pendingIngestCounts_;
+    /// Textures being uploaded progressively, in the order they were queued.
+    List<SharedPtr<ProgressiveTexture>> progressiveUploads_;
+    /// Upload budget in bytes per frame for progressive textures.
+    unsigned textureUploadBudget_{1048576};
+    /// Largest width or height of the placeholder mip level.
+    int progressiveTextureTailSize_{64};
+    /// Progressive texture loading flag.
+    bool progressiveTextures_{};
+    /// Model optimisation settings.
+    ModelOptimizeSettings modelSettings_;
+    /// Model optimisation flag.
+    bool modelOptimization_{};
+    /// Compressed payloads decompressing on worker threads, in the order they were queued.
+    List<SharedPtr<CompressedPayloadItem>> pendingDecompressions_;
+    /// Asynchronous ingest flag.
+    bool asyncIngest_{};
+    /// Coalesced payloads in the order the resources were first processed.
+    Vector<CoalescedIngest> coalescedIngests_;
+    /// Coalesced payloads being loaded, kept to reuse the storage.
+    Vector<CoalescedIngest> flushedIngests_;
+    /// Index of the coalesced payload by resource name.
+    HashMap<String, unsigned> coalescedIngestIndex_;
+    /// Number of completion callbacks owed by resource name to calls collapsed into a single load.
+    HashMap<String, unsigned> ingestWaiters_;
+    /// Ingest coalescing flag.
+    bool ingestCoalescing_{};
+    /// Main thread time budget for finalizing resources in milliseconds.
+    int finishLoadTimeBudget_{5};
+    /// Batches waiting to be committed, in the order they were queued.
+    List<SharedPtr<ResourceBatch>> pendingBatches_;
+    /// Id of the next batch.
+    unsigned nextBatchId_{1};
+    /// Resources added through ProcessResource.
+    HashMap<String, DynamicResourceInfo> dynamicResources_;
+    /// Names of the resources that refer to a resource, by resource name.
+    HashMap<String, HashSet<String>> dependents_;
+    /// Dependent resources waiting to be refreshed, in topological order.
+    StringVector pendingReloads_;
+    /// Maximum number of dependent resources refreshed per frame.
+    unsigned maxReloadPropagationsPerFrame_{32};
+    /// Memory budget for dynamically added resources in bytes, 0 for unlimited.
+    unsigned long long memoryBudget_{};
+    /// Memory budget needs to be checked flag.
+    bool memoryBudgetDirty_{};
+    /// Memory budget exceeded without enough resources to release warning shown flag.
+    bool memoryBudgetWarned_{};
+    /// Pipeline counters.
+    DynamicResourceStats stats_;
+    /// Per-resource info logging flag.
+    bool resourceLogging_{true};
+    /// Mounted packages, kept mapped so that their content can be read back.
+    Vector<SharedPtr<MappedPackageFile>> mappedPackages_;
+    /// Mounted package holding the current content of a resource.
+    HashMap<String, MappedPackageFile*> packageResources_;
+    /// Package being mounted.
+    MappedPackageFile* mountingPackage_{};
+    /// Memory-mapped views of the ResourceCache package files by package file name.
+    HashMap<String, SharedPtr<MappedPackageFile>> packageViews_;
+    /// Persistent on-disk store of the added resources.
+    SharedPtr<PersistentResourceStore> store_;
+    /// Session store of the lazily registered payloads, used when there is no persistent store.
+    SharedPtr<PersistentResourceStore> lazyStore_;
+    /// Lazy loading flag.
+    bool lazyLoading_{};
+    /// AngelScript batch compilation flag.
+    bool scriptBatchCompile_{};
+    /// Lua run on load flag.
+    bool luaRunOnLoad_{};
+    /// Shader variations waiting to be precompiled, in the order they were queued.
+    List<ShaderVariantRequest> pendingShaderVariants_;
+    /// Keys of the queued shader variations.
+    HashSet<String> queuedShaderVariants_;
+    /// Preprocessed shader variations by source hash, shader type and defines.
+    HashMap<String, PreprocessedShader> preprocessedShaders_;
+    /// Define combinations added to the pass defines.
+    StringVector shaderVariantDefines_;
+    /// Main thread time budget in milliseconds for precompiling shader variations per frame.
+    int shaderPrecompileTimeBudget_{2};
+    /// Shader precompile flag.
+    bool shaderPrecompile_{};
+    /// Last read text content.
+    String content_;
+    /// Name of the resource in the last read text content.
+    String contentName_;
+    /// Modification time of the resource file in the last read text content, 0 if not a file.
+    unsigned contentStamp_{};
+    /// Last read text content is up to date flag.
+    bool contentValid_{};
+    /// Reuse last read text content flag.
+    bool contentCacheEnabled_{};
+    /// Buffer used to serve resource data to JS, reused between calls.
+    PODVector<unsigned char> readBuffer_;
+    /// Buffer receiving decoded base64 payloads, reused between calls.
+    PODVector<unsigned char> decodeBuffer_;
+    /// Pool of the transient payload buffers.
+    BufferPool bufferPool_;
+    /// Interned names of the registered resources by hash.
+    HashMap<StringHash, String> internedNames_;
     #ifdef URHO3D_NETWORK
     /// HTTP request to handle remote resource loading.
-    Vector<NetworkResourceRequest> httpRequests_;
+    List<NetworkResourceRequest> httpRequests_;
+    /// Number of running downloads per host.
+    HashMap<String, unsigned> downloadsPerHost_;
+    /// Failed ranged downloads by url, kept to be resumed.
+    HashMap<String, SharedPtr<RangedDownload>> partialDownloads_;
+    /// Resource names sharing a download by url, besides the one it was started for.
+    HashMap<String, StringVector> downloadWaiters_;
     #endif
 };
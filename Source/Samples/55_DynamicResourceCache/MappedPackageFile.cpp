@@ -0,0 +1,185 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedPackageFile.h"
+
+MappedPackageFile::MappedPackageFile(Context* context) :
+    Object(context)
+{
+}
+
+MappedPackageFile::~MappedPackageFile()
+{
+    Close();
+}
+
+bool MappedPackageFile::Open(const String& fileName)
+{
+    Close();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileW(WString(GetNativePath(fileName)).CString(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER fileSize;
+        HANDLE mapping = GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0 && fileSize.QuadPart <= M_MAX_UNSIGNED
+            ? CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+        void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (view) {
+            fileHandle_ = file;
+            mappingHandle_ = mapping;
+            data_ = static_cast<unsigned char*>(view);
+            size_ = (unsigned)fileSize.QuadPart;
+            mapped_ = true;
+        } else {
+            if (mapping) {
+                CloseHandle(mapping);
+            }
+            CloseHandle(file);
+        }
+    }
+#elif !defined(__EMSCRIPTEN__)
+    int fd = open(GetNativePath(fileName).CString(), O_RDONLY);
+    if (fd >= 0) {
+        struct stat st{};
+        if (fstat(fd, &st) == 0 && st.st_size > 0 && (unsigned long long)st.st_size <= M_MAX_UNSIGNED) {
+            void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED) {
+                data_ = static_cast<unsigned char*>(view);
+                size_ = (unsigned)st.st_size;
+                mapped_ = true;
+            }
+        }
+        // The mapping stays valid after the descriptor is closed
+        close(fd);
+    }
+#endif
+
+    if (!mapped_) {
+        File file(context_, fileName, FILE_READ);
+        if (!file.IsOpen() || !file.GetSize()) {
+            URHO3D_LOGERRORF("Could not open package file %s", fileName.CString());
+            return false;
+        }
+
+        size_ = file.GetSize();
+        fallbackData_ = new unsigned char[size_];
+        data_ = fallbackData_.Get();
+        if (file.Read(data_, size_) != size_) {
+            URHO3D_LOGERRORF("Could not read package file %s", fileName.CString());
+            Close();
+            return false;
+        }
+    }
+
+    fileName_ = fileName;
+    if (!ReadDirectory()) {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedPackageFile::Close()
+{
+    if (mapped_) {
+#if defined(_WIN32)
+        UnmapViewOfFile(data_);
+        CloseHandle(mappingHandle_);
+        CloseHandle(fileHandle_);
+        mappingHandle_ = nullptr;
+        fileHandle_ = nullptr;
+#elif !defined(__EMSCRIPTEN__)
+        munmap(data_, size_);
+#endif
+    }
+
+    fallbackData_.Reset();
+    data_ = nullptr;
+    size_ = 0;
+    mapped_ = false;
+    entries_.Clear();
+    fileName_.Clear();
+}
+
+const unsigned char* MappedPackageFile::GetEntryData(const String& name, unsigned& size) const
+{
+    auto it = entries_.Find(name);
+    if (it == entries_.End()) {
+        size = 0;
+        return nullptr;
+    }
+
+    size = it->second_.size_;
+    return data_ + it->second_.offset_;
+}
+
+bool MappedPackageFile::ReadDirectory()
+{
+    MemoryBuffer buffer(data_, size_);
+    String id = buffer.ReadFileID();
+    if (id == "ULZ4") {
+        URHO3D_LOGERRORF("Compressed package file %s can not be memory-mapped", fileName_.CString());
+        return false;
+    } else if (id != "UPAK") {
+        URHO3D_LOGERRORF("%s is not a valid package file", fileName_.CString());
+        return false;
+    }
+
+    unsigned numFiles = buffer.ReadUInt();
+    buffer.ReadUInt(); // Package checksum
+    for (unsigned i = 0; i < numFiles; ++i) {
+        if (buffer.IsEof()) {
+            URHO3D_LOGERRORF("Package file %s directory is truncated", fileName_.CString());
+            return false;
+        }
+
+        String entryName = buffer.ReadString();
+        PackageEntry entry;
+        entry.offset_ = buffer.ReadUInt();
+        entry.size_ = buffer.ReadUInt();
+        entry.checksum_ = buffer.ReadUInt();
+        if (entry.offset_ > size_ || entry.size_ > size_ - entry.offset_) {
+            URHO3D_LOGERRORF("File entry %s outside package file %s", entryName.CString(), fileName_.CString());
+            return false;
+        }
+        entries_[entryName] = entry;
+    }
+
+    return true;
+}
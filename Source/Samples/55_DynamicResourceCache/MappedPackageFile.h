@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/IO/PackageFile.h>
+
+using namespace Urho3D;
+
+/// Read-only Urho3D package file mapped into memory. Entry data is accessed in place without opening or copying files.
+class URHO3D_API MappedPackageFile : public Object {
+URHO3D_OBJECT(MappedPackageFile, Object);
+
+public:
+    /// Construct.
+    explicit MappedPackageFile(Context* context);
+    /// Destruct. Unmap the file.
+    ~MappedPackageFile() override;
+
+    /// Map package file and read the entry directory. Compressed packages are not supported. Return true on success.
+    bool Open(const String& fileName);
+    /// Unmap the file.
+    void Close();
+
+    /// Return entry data pointer and size, or null if not found.
+    const unsigned char* GetEntryData(const String& name, unsigned& size) const;
+    /// Return whether the package contains an entry.
+    bool Exists(const String& name) const { return entries_.Contains(name); }
+    /// Return all entries in package order.
+    const HashMap<String, PackageEntry>& GetEntries() const { return entries_; }
+    /// Return package file name.
+    const String& GetName() const { return fileName_; }
+    /// Return package size in bytes.
+    unsigned GetTotalSize() const { return size_; }
+    /// Return whether the file is memory-mapped. False if the platform has no mmap and the file was read into memory.
+    bool IsMapped() const { return mapped_; }
+
+private:
+    /// Read the entry directory from the mapped data. Return true on success.
+    bool ReadDirectory();
+
+    /// Entries by name.
+    HashMap<String, PackageEntry> entries_;
+    /// Package file name.
+    String fileName_;
+    /// Mapped package data.
+    unsigned char* data_{};
+    /// Package size.
+    unsigned size_{};
+    /// Package data read into memory when mapping is not available.
+    SharedArrayPtr<unsigned char> fallbackData_;
+    /// Memory-mapped flag.
+    bool mapped_{};
+#ifdef _WIN32
+    /// File handle.
+    void* fileHandle_{};
+    /// File mapping handle.
+    void* mappingHandle_{};
+#endif
+};
@@ -0,0 +1,913 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/HashSet.h>
+#include <Urho3D/Graphics/GraphicsDefs.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+#include <Urho3D/Math/BoundingBox.h>
+#include <Urho3D/Math/MathDefs.h>
+
+#include "ModelOptimizer.h"
+
+#include <cmath>
+#include <cstring>
+
+/// Size of the vertex cache modelled by the triangle reordering.
+static const int VERTEX_CACHE_SIZE = 32;
+/// Size of the FIFO cache used to count vertex cache misses.
+static const unsigned FIFO_CACHE_SIZE = 16;
+/// Finest grid resolution tried when clustering vertices for a LOD level.
+static const unsigned MAX_CLUSTER_RESOLUTION = 1024;
+/// Smallest triangle count of a generated LOD level.
+static const unsigned MIN_LOD_TRIANGLES = 8;
+
+/// Vertex buffer of a model file.
+struct ModelVertexBuffer
+{
+    /// Vertex count.
+    unsigned vertexCount_{};
+    /// Element mask of UMDL files.
+    unsigned elementMask_{};
+    /// Element descriptions of UMD2 files.
+    PODVector<unsigned> elementDescs_;
+    /// First vertex of the morph range.
+    unsigned morphRangeStart_{};
+    /// Vertex count of the morph range.
+    unsigned morphRangeCount_{};
+    /// Vertex size in bytes.
+    unsigned vertexSize_{};
+    /// Offset of the float3 position in the vertex, M_MAX_UNSIGNED if there is none.
+    unsigned positionOffset_{M_MAX_UNSIGNED};
+    /// Whether the vertices must stay as they are.
+    bool locked_{};
+    /// Vertex data.
+    PODVector<unsigned char> data_;
+};
+
+/// Index buffer of a model file, widened to 32-bit indices.
+struct ModelIndexBuffer
+{
+    /// Index size in the file.
+    unsigned indexSize_{};
+    /// Indices.
+    PODVector<unsigned> indices_;
+};
+
+/// LOD level of a model file geometry.
+struct ModelLodLevel
+{
+    /// LOD distance.
+    float distance_{};
+    /// Primitive type.
+    unsigned type_{};
+    /// Vertex buffer index.
+    unsigned vbRef_{};
+    /// Index buffer index.
+    unsigned ibRef_{};
+    /// First index.
+    unsigned indexStart_{};
+    /// Index count.
+    unsigned indexCount_{};
+};
+
+/// Geometry of a model file.
+struct ModelGeometry
+{
+    /// Bone mapping of skinned geometries.
+    PODVector<unsigned> boneMapping_;
+    /// LOD levels.
+    PODVector<ModelLodLevel> lodLevels_;
+};
+
+/// Parsed model file. What follows the geometries is only copied.
+struct ModelFileData
+{
+    /// File id, UMDL or UMD2.
+    char id_[4];
+    /// Vertex buffers.
+    Vector<ModelVertexBuffer> vertexBuffers_;
+    /// Index buffers.
+    Vector<ModelIndexBuffer> indexBuffers_;
+    /// Geometries.
+    Vector<ModelGeometry> geometries_;
+    /// Morphs, skeleton, bounding box and geometry centers.
+    const unsigned char* tail_{};
+    /// Size of the rest of the file.
+    unsigned tailSize_{};
+};
+
+/// Sequential reader of little endian file data with bounds checking.
+struct ModelFileReader
+{
+    /// Construct.
+    ModelFileReader(const unsigned char* data, unsigned size) :
+        data_(data),
+        size_(size)
+    {
+    }
+
+    /// Read unsigned integer, 0 past the end.
+    unsigned ReadUInt()
+    {
+        unsigned value = 0;
+        Read(&value, sizeof value);
+        return value;
+    }
+
+    /// Read float, 0 past the end.
+    float ReadFloat()
+    {
+        float value = 0.0f;
+        Read(&value, sizeof value);
+        return value;
+    }
+
+    /// Read bytes. Return false and set the overflow flag past the end.
+    bool Read(void* dest, unsigned size)
+    {
+        if (size > size_ - position_) {
+            overflow_ = true;
+            return false;
+        }
+        if (!size) {
+            return true;
+        }
+        memcpy(dest, data_ + position_, size);
+        position_ += size;
+        return true;
+    }
+
+    /// Return whether the count of items of the size fits in the rest of the data.
+    bool Fits(unsigned count, unsigned itemSize) const { return !itemSize || count <= (size_ - position_) / itemSize; }
+
+    /// Data.
+    const unsigned char* data_;
+    /// Data size.
+    unsigned size_;
+    /// Read position.
+    unsigned position_{};
+    /// Read past the end flag.
+    bool overflow_{};
+};
+
+/// Resize vector and set every element to a value.
+template <class T> static void ResizeFill(PODVector<T>& vector, unsigned size, const T& value)
+{
+    vector.Resize(size);
+    for (unsigned i = 0; i < size; ++i) {
+        vector[i] = value;
+    }
+}
+
+static inline void WriteBytes(PODVector<unsigned char>& dest, const void* data, unsigned size)
+{
+    if (size) {
+        unsigned offset = dest.Size();
+        dest.Resize(offset + size);
+        memcpy(&dest[offset], data, size);
+    }
+}
+
+static inline void WriteUInt(PODVector<unsigned char>& dest, unsigned value)
+{
+    WriteBytes(dest, &value, sizeof value);
+}
+
+static inline void WriteFloat(PODVector<unsigned char>& dest, float value)
+{
+    WriteBytes(dest, &value, sizeof value);
+}
+
+/// Return position of a vertex.
+static inline Vector3 GetVertexPosition(const ModelVertexBuffer& vb, unsigned vertex)
+{
+    Vector3 position;
+    memcpy(&position.x_, &vb.data_[vertex * vb.vertexSize_ + vb.positionOffset_], sizeof(Vector3));
+    return position;
+}
+
+static bool ReadModelFile(const unsigned char* data, unsigned size, ModelFileData& model, String& error)
+{
+    ModelFileReader source(data, size);
+    if (!source.Read(model.id_, 4) || (memcmp(model.id_, "UMDL", 4) && memcmp(model.id_, "UMD2", 4))) {
+        error = "not a model file";
+        return false;
+    }
+    bool hasVertexDeclarations = !memcmp(model.id_, "UMD2", 4);
+
+    unsigned numVertexBuffers = source.ReadUInt();
+    if (!source.Fits(numVertexBuffers, 16)) {
+        error = "truncated vertex buffers";
+        return false;
+    }
+    model.vertexBuffers_.Resize(numVertexBuffers);
+    for (unsigned i = 0; i < numVertexBuffers; ++i) {
+        ModelVertexBuffer& vb = model.vertexBuffers_[i];
+        vb.vertexCount_ = source.ReadUInt();
+        PODVector<VertexElement> elements;
+        if (!hasVertexDeclarations) {
+            vb.elementMask_ = source.ReadUInt();
+            elements = VertexBuffer::GetElements(vb.elementMask_);
+        } else {
+            unsigned numElements = source.ReadUInt();
+            if (!source.Fits(numElements, 4)) {
+                error = "truncated vertex declaration";
+                return false;
+            }
+            for (unsigned j = 0; j < numElements; ++j) {
+                unsigned desc = source.ReadUInt();
+                unsigned type = desc & 0xffu;
+                if (type >= MAX_VERTEX_ELEMENT_TYPES) {
+                    error = "invalid vertex element type";
+                    return false;
+                }
+                vb.elementDescs_.Push(desc);
+                elements.Push(VertexElement((VertexElementType)type, (VertexElementSemantic)((desc >> 8u) & 0xffu),
+                    (unsigned char)((desc >> 16u) & 0xffu)));
+            }
+        }
+        for (auto it = elements.Begin(); it != elements.End(); ++it) {
+            if (it->semantic_ == SEM_POSITION && it->index_ == 0 && it->type_ == TYPE_VECTOR3) {
+                vb.positionOffset_ = vb.vertexSize_;
+            }
+            vb.vertexSize_ += ELEMENT_TYPESIZES[it->type_];
+        }
+        vb.morphRangeStart_ = source.ReadUInt();
+        vb.morphRangeCount_ = source.ReadUInt();
+        if (!vb.vertexSize_ || !source.Fits(vb.vertexCount_, vb.vertexSize_)) {
+            error = "truncated vertex data";
+            return false;
+        }
+        vb.data_.Resize(vb.vertexCount_ * vb.vertexSize_);
+        source.Read(vb.data_.Buffer(), vb.data_.Size());
+    }
+
+    unsigned numIndexBuffers = source.ReadUInt();
+    if (!source.Fits(numIndexBuffers, 8)) {
+        error = "truncated index buffers";
+        return false;
+    }
+    model.indexBuffers_.Resize(numIndexBuffers);
+    for (unsigned i = 0; i < numIndexBuffers; ++i) {
+        ModelIndexBuffer& ib = model.indexBuffers_[i];
+        unsigned indexCount = source.ReadUInt();
+        ib.indexSize_ = source.ReadUInt();
+        if (ib.indexSize_ != 2 && ib.indexSize_ != 4) {
+            error = "invalid index size";
+            return false;
+        }
+        if (!source.Fits(indexCount, ib.indexSize_)) {
+            error = "truncated index data";
+            return false;
+        }
+        ib.indices_.Resize(indexCount);
+        for (unsigned j = 0; j < indexCount; ++j) {
+            if (ib.indexSize_ == 2) {
+                unsigned short index;
+                source.Read(&index, sizeof index);
+                ib.indices_[j] = index;
+            } else {
+                source.Read(&ib.indices_[j], sizeof(unsigned));
+            }
+        }
+    }
+
+    unsigned numGeometries = source.ReadUInt();
+    if (!source.Fits(numGeometries, 8)) {
+        error = "truncated geometries";
+        return false;
+    }
+    model.geometries_.Resize(numGeometries);
+    for (unsigned i = 0; i < numGeometries; ++i) {
+        ModelGeometry& geometry = model.geometries_[i];
+        unsigned numBones = source.ReadUInt();
+        if (!source.Fits(numBones, 4)) {
+            error = "truncated bone mapping";
+            return false;
+        }
+        geometry.boneMapping_.Resize(numBones);
+        source.Read(geometry.boneMapping_.Buffer(), numBones * sizeof(unsigned));
+        unsigned numLodLevels = source.ReadUInt();
+        if (!source.Fits(numLodLevels, 24)) {
+            error = "truncated LOD levels";
+            return false;
+        }
+        geometry.lodLevels_.Resize(numLodLevels);
+        for (unsigned j = 0; j < numLodLevels; ++j) {
+            ModelLodLevel& lod = geometry.lodLevels_[j];
+            lod.distance_ = source.ReadFloat();
+            lod.type_ = source.ReadUInt();
+            lod.vbRef_ = source.ReadUInt();
+            lod.ibRef_ = source.ReadUInt();
+            lod.indexStart_ = source.ReadUInt();
+            lod.indexCount_ = source.ReadUInt();
+            if (lod.vbRef_ >= numVertexBuffers || lod.ibRef_ >= numIndexBuffers ||
+                lod.indexStart_ > model.indexBuffers_[lod.ibRef_].indices_.Size() ||
+                lod.indexCount_ > model.indexBuffers_[lod.ibRef_].indices_.Size() - lod.indexStart_) {
+                error = "invalid LOD level";
+                return false;
+            }
+        }
+    }
+
+    if (source.overflow_) {
+        error = "truncated model data";
+        return false;
+    }
+    model.tail_ = data + source.position_;
+    model.tailSize_ = size - source.position_;
+    return true;
+}
+
+static void WriteModelFile(const ModelFileData& model, PODVector<unsigned char>& dest)
+{
+    dest.Clear();
+    WriteBytes(dest, model.id_, 4);
+    bool hasVertexDeclarations = !memcmp(model.id_, "UMD2", 4);
+
+    WriteUInt(dest, model.vertexBuffers_.Size());
+    for (auto it = model.vertexBuffers_.Begin(); it != model.vertexBuffers_.End(); ++it) {
+        WriteUInt(dest, it->vertexCount_);
+        if (!hasVertexDeclarations) {
+            WriteUInt(dest, it->elementMask_);
+        } else {
+            WriteUInt(dest, it->elementDescs_.Size());
+            WriteBytes(dest, it->elementDescs_.Buffer(), it->elementDescs_.Size() * sizeof(unsigned));
+        }
+        WriteUInt(dest, it->morphRangeStart_);
+        WriteUInt(dest, it->morphRangeCount_);
+        WriteBytes(dest, it->data_.Buffer(), it->data_.Size());
+    }
+
+    WriteUInt(dest, model.indexBuffers_.Size());
+    for (auto it = model.indexBuffers_.Begin(); it != model.indexBuffers_.End(); ++it) {
+        WriteUInt(dest, it->indices_.Size());
+        WriteUInt(dest, it->indexSize_);
+        if (it->indexSize_ == 2) {
+            for (unsigned i = 0; i < it->indices_.Size(); ++i) {
+                auto index = (unsigned short)it->indices_[i];
+                WriteBytes(dest, &index, sizeof index);
+            }
+        } else {
+            WriteBytes(dest, it->indices_.Buffer(), it->indices_.Size() * sizeof(unsigned));
+        }
+    }
+
+    WriteUInt(dest, model.geometries_.Size());
+    for (auto it = model.geometries_.Begin(); it != model.geometries_.End(); ++it) {
+        WriteUInt(dest, it->boneMapping_.Size());
+        WriteBytes(dest, it->boneMapping_.Buffer(), it->boneMapping_.Size() * sizeof(unsigned));
+        WriteUInt(dest, it->lodLevels_.Size());
+        for (auto lod = it->lodLevels_.Begin(); lod != it->lodLevels_.End(); ++lod) {
+            WriteFloat(dest, lod->distance_);
+            WriteUInt(dest, lod->type_);
+            WriteUInt(dest, lod->vbRef_);
+            WriteUInt(dest, lod->ibRef_);
+            WriteUInt(dest, lod->indexStart_);
+            WriteUInt(dest, lod->indexCount_);
+        }
+    }
+
+    WriteBytes(dest, model.tail_, model.tailSize_);
+}
+
+/// Return FNV-1a hash of vertex data.
+static unsigned HashVertex(const unsigned char* data, unsigned size)
+{
+    unsigned hash = 2166136261u;
+    for (unsigned i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/// Fill remap with the first vertex of identical data for every vertex. Return number of unique vertices.
+static unsigned FindDuplicateVertices(const ModelVertexBuffer& vb, PODVector<unsigned>& remap)
+{
+    // Vertices of the same hash are chained from the first one, so collisions are compared in full
+    HashMap<unsigned, unsigned> chains;
+    PODVector<unsigned> next;
+    ResizeFill(next, vb.vertexCount_, M_MAX_UNSIGNED);
+    remap.Resize(vb.vertexCount_);
+    unsigned numUnique = 0;
+    for (unsigned i = 0; i < vb.vertexCount_; ++i) {
+        const unsigned char* vertex = &vb.data_[i * vb.vertexSize_];
+        unsigned hash = HashVertex(vertex, vb.vertexSize_);
+        remap[i] = i;
+        auto chain = chains.Find(hash);
+        if (chain == chains.End()) {
+            chains[hash] = i;
+            ++numUnique;
+            continue;
+        }
+        unsigned candidate = chain->second_;
+        while (candidate != M_MAX_UNSIGNED && memcmp(vertex, &vb.data_[candidate * vb.vertexSize_], vb.vertexSize_)) {
+            candidate = next[candidate];
+        }
+        if (candidate != M_MAX_UNSIGNED) {
+            remap[i] = candidate;
+        } else {
+            next[i] = chain->second_;
+            chain->second_ = i;
+            ++numUnique;
+        }
+    }
+    return numUnique;
+}
+
+/// Return score of a vertex by its position in the modelled cache and its number of remaining triangles.
+static float GetVertexScore(int cachePosition, unsigned remainingTriangles)
+{
+    if (!remainingTriangles) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        // The vertices of the last triangle score the same, whichever order they were used in
+        score = cachePosition < 3 ? 0.75f : powf(1.0f - (float)(cachePosition - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+    }
+    // Vertices with few triangles left are finished first so they leave the cache for good
+    return score + 2.0f * powf((float)remainingTriangles, -0.5f);
+}
+
+unsigned GetVertexCacheMisses(const unsigned* indices, unsigned numIndices)
+{
+    unsigned cache[FIFO_CACHE_SIZE];
+    unsigned cacheSize = 0;
+    unsigned head = 0;
+    unsigned misses = 0;
+    for (unsigned i = 0; i < numIndices; ++i) {
+        bool hit = false;
+        for (unsigned j = 0; j < cacheSize && !hit; ++j) {
+            hit = cache[j] == indices[i];
+        }
+        if (!hit) {
+            ++misses;
+            cache[head] = indices[i];
+            head = (head + 1) % FIFO_CACHE_SIZE;
+            cacheSize = Min(cacheSize + 1, FIFO_CACHE_SIZE);
+        }
+    }
+    return misses;
+}
+
+void OptimizeVertexCache(unsigned* indices, unsigned numIndices)
+{
+    // Linear-speed vertex cache optimisation (Forsyth): greedily emit the triangle whose vertices score highest, the
+    // scores favour vertices in the cache and vertices with few triangles left
+    unsigned numTriangles = numIndices / 3;
+    if (numTriangles < 2) {
+        return;
+    }
+    unsigned numVertices = 0;
+    for (unsigned i = 0; i < numTriangles * 3; ++i) {
+        numVertices = Max(numVertices, indices[i] + 1);
+    }
+
+    // Triangles of every vertex, the live ones are kept in front
+    PODVector<unsigned> remaining;
+    ResizeFill(remaining, numVertices, 0u);
+    for (unsigned i = 0; i < numTriangles * 3; ++i) {
+        ++remaining[indices[i]];
+    }
+    PODVector<unsigned> adjacencyStart(numVertices + 1);
+    adjacencyStart[0] = 0;
+    for (unsigned i = 0; i < numVertices; ++i) {
+        adjacencyStart[i + 1] = adjacencyStart[i] + remaining[i];
+    }
+    PODVector<unsigned> adjacency(numTriangles * 3);
+    PODVector<unsigned> fill(adjacencyStart);
+    for (unsigned i = 0; i < numTriangles * 3; ++i) {
+        adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    PODVector<int> cachePosition;
+    ResizeFill(cachePosition, numVertices, -1);
+    PODVector<float> vertexScore(numVertices);
+    for (unsigned i = 0; i < numVertices; ++i) {
+        vertexScore[i] = GetVertexScore(-1, remaining[i]);
+    }
+    PODVector<unsigned char> emitted;
+    ResizeFill(emitted, numTriangles, (unsigned char)0);
+
+    PODVector<unsigned> output(numTriangles * 3);
+    int cache[VERTEX_CACHE_SIZE + 3];
+    unsigned cacheSize = 0;
+    unsigned bestTriangle = M_MAX_UNSIGNED;
+    unsigned scanCursor = 0;
+    for (unsigned n = 0; n < numTriangles; ++n) {
+        if (bestTriangle == M_MAX_UNSIGNED) {
+            // Nothing in the cache has triangles left, continue with the next triangle in input order
+            while (emitted[scanCursor]) {
+                ++scanCursor;
+            }
+            bestTriangle = scanCursor;
+        }
+
+        emitted[bestTriangle] = 1;
+        const unsigned* triangle = indices + bestTriangle * 3;
+        memcpy(&output[n * 3], triangle, 3 * sizeof(unsigned));
+        for (unsigned k = 0; k < 3; ++k) {
+            unsigned vertex = triangle[k];
+            unsigned* live = &adjacency[adjacencyStart[vertex]];
+            for (unsigned j = 0; j < remaining[vertex]; ++j) {
+                if (live[j] == bestTriangle) {
+                    live[j] = live[remaining[vertex] - 1];
+                    --remaining[vertex];
+                    break;
+                }
+            }
+        }
+
+        // The triangle's vertices move to the front of the cache, the ones pushed past its end drop out
+        int newCache[VERTEX_CACHE_SIZE + 3];
+        unsigned newCacheSize = 0;
+        for (unsigned k = 0; k < 3; ++k) {
+            bool duplicate = false;
+            for (unsigned j = 0; j < k; ++j) {
+                duplicate = duplicate || triangle[j] == triangle[k];
+            }
+            if (!duplicate) {
+                newCache[newCacheSize++] = (int)triangle[k];
+            }
+        }
+        for (unsigned i = 0; i < cacheSize; ++i) {
+            auto vertex = (unsigned)cache[i];
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) {
+                newCache[newCacheSize++] = cache[i];
+            }
+        }
+        for (unsigned i = 0; i < newCacheSize; ++i) {
+            auto vertex = (unsigned)newCache[i];
+            cachePosition[vertex] = i < (unsigned)VERTEX_CACHE_SIZE ? (int)i : -1;
+            vertexScore[vertex] = GetVertexScore(cachePosition[vertex], remaining[vertex]);
+        }
+        cacheSize = Min(newCacheSize, (unsigned)VERTEX_CACHE_SIZE);
+        memcpy(cache, newCache, cacheSize * sizeof(int));
+
+        // Only triangles of the vertices whose score changed are rescored
+        bestTriangle = M_MAX_UNSIGNED;
+        float bestScore = -1.0f;
+        for (unsigned i = 0; i < newCacheSize; ++i) {
+            auto vertex = (unsigned)newCache[i];
+            const unsigned* live = &adjacency[adjacencyStart[vertex]];
+            for (unsigned j = 0; j < remaining[vertex]; ++j) {
+                const unsigned* candidate = indices + live[j] * 3;
+                float score = vertexScore[candidate[0]] + vertexScore[candidate[1]] + vertexScore[candidate[2]];
+                if (score > bestScore) {
+                    bestScore = score;
+                    bestTriangle = live[j];
+                }
+            }
+        }
+    }
+
+    memcpy(indices, output.Buffer(), numTriangles * 3 * sizeof(unsigned));
+}
+
+/// Cluster the vertices used by a triangle list on a grid of the resolution and write the triangles that do not collapse.
+/// Every cluster is represented by its vertex nearest to the cluster average. Return number of triangles.
+static unsigned ClusterTriangles(const unsigned* indices, unsigned numIndices, const ModelVertexBuffer& vb, const BoundingBox& box,
+    unsigned resolution, PODVector<unsigned>& dest)
+{
+    Vector3 size = box.Size();
+    float extent = Max(Max(size.x_, size.y_), size.z_);
+    float scale = resolution / extent;
+
+    HashMap<unsigned long long, unsigned> cells;
+    PODVector<unsigned> vertexCluster;
+    ResizeFill(vertexCluster, vb.vertexCount_, M_MAX_UNSIGNED);
+    PODVector<Vector3> clusterSum;
+    PODVector<unsigned> clusterCount;
+    for (unsigned i = 0; i < numIndices; ++i) {
+        unsigned vertex = indices[i];
+        if (vertexCluster[vertex] != M_MAX_UNSIGNED) {
+            continue;
+        }
+        Vector3 position = GetVertexPosition(vb, vertex);
+        Vector3 cell = (position - box.min_) * scale;
+        auto x = (unsigned long long)Clamp((int)cell.x_, 0, (int)resolution - 1);
+        auto y = (unsigned long long)Clamp((int)cell.y_, 0, (int)resolution - 1);
+        auto z = (unsigned long long)Clamp((int)cell.z_, 0, (int)resolution - 1);
+        unsigned long long key = x + (y + z * resolution) * resolution;
+        auto it = cells.Find(key);
+        if (it == cells.End()) {
+            it = cells.Insert(MakePair(key, clusterSum.Size()));
+            clusterSum.Push(Vector3::ZERO);
+            clusterCount.Push(0);
+        }
+        vertexCluster[vertex] = it->second_;
+        clusterSum[it->second_] += position;
+        ++clusterCount[it->second_];
+    }
+
+    PODVector<unsigned> clusterVertex;
+    ResizeFill(clusterVertex, clusterSum.Size(), M_MAX_UNSIGNED);
+    PODVector<float> clusterDistance;
+    ResizeFill(clusterDistance, clusterSum.Size(), M_INFINITY);
+    for (unsigned i = 0; i < numIndices; ++i) {
+        unsigned vertex = indices[i];
+        unsigned cluster = vertexCluster[vertex];
+        float distance = (GetVertexPosition(vb, vertex) - clusterSum[cluster] / (float)clusterCount[cluster]).LengthSquared();
+        if (distance < clusterDistance[cluster] || (distance == clusterDistance[cluster] && vertex < clusterVertex[cluster])) {
+            clusterDistance[cluster] = distance;
+            clusterVertex[cluster] = vertex;
+        }
+    }
+
+    // Triangles collapsing to a line or a point are dropped, as are duplicates once rotated to start from the lowest index
+    HashSet<unsigned long long> triangles;
+    bool packable = vb.vertexCount_ < (1u << 21u);
+    dest.Clear();
+    for (unsigned i = 0; i + 2 < numIndices; i += 3) {
+        unsigned a = clusterVertex[vertexCluster[indices[i]]];
+        unsigned b = clusterVertex[vertexCluster[indices[i + 1]]];
+        unsigned c = clusterVertex[vertexCluster[indices[i + 2]]];
+        if (a == b || b == c || a == c) {
+            continue;
+        }
+        if (packable) {
+            while (a > b || a > c) {
+                unsigned first = a;
+                a = b;
+                b = c;
+                c = first;
+            }
+            unsigned long long key = a | (unsigned long long)b << 21u | (unsigned long long)c << 42u;
+            if (triangles.Contains(key)) {
+                continue;
+            }
+            triangles.Insert(key);
+        }
+        dest.Push(a);
+        dest.Push(b);
+        dest.Push(c);
+    }
+    return dest.Size() / 3;
+}
+
+/// Simplify a triangle list to at most the target triangle count with the finest vertex clustering that reaches it. Return
+/// false if the triangle list can't be simplified.
+static bool SimplifyTriangles(const unsigned* indices, unsigned numIndices, const ModelVertexBuffer& vb, unsigned targetTriangles,
+    PODVector<unsigned>& dest)
+{
+    BoundingBox box;
+    for (unsigned i = 0; i < numIndices; ++i) {
+        if (indices[i] >= vb.vertexCount_) {
+            return false;
+        }
+        box.Merge(GetVertexPosition(vb, indices[i]));
+    }
+    Vector3 size = box.Size();
+    if (Max(Max(size.x_, size.y_), size.z_) <= 0.0f) {
+        return false;
+    }
+
+    // Coarser grids leave fewer triangles, search for the finest one within the target
+    PODVector<unsigned> candidate;
+    unsigned low = 1;
+    unsigned high = MAX_CLUSTER_RESOLUTION;
+    unsigned numTriangles = 0;
+    while (low <= high) {
+        unsigned resolution = (low + high) / 2;
+        unsigned count = ClusterTriangles(indices, numIndices, vb, box, resolution, candidate);
+        if (count <= targetTriangles) {
+            if (count > numTriangles) {
+                numTriangles = count;
+                dest.Swap(candidate);
+            }
+            low = resolution + 1;
+        } else {
+            high = resolution - 1;
+        }
+    }
+    return numTriangles > 0;
+}
+
+/// Merge duplicate vertices and reorder vertices by first use, as enabled in the settings. Rewrite the indices of every
+/// range using a vertex buffer.
+static void OptimizeVertexBuffers(ModelFileData& model, const ModelOptimizeSettings& settings)
+{
+    // Owner vertex buffer of every index, a vertex buffer whose indices are shared with another one stays as it is
+    Vector<PODVector<unsigned> > owners(model.indexBuffers_.Size());
+    for (unsigned i = 0; i < model.indexBuffers_.Size(); ++i) {
+        ResizeFill(owners[i], model.indexBuffers_[i].indices_.Size(), M_MAX_UNSIGNED);
+    }
+    for (auto geometry = model.geometries_.Begin(); geometry != model.geometries_.End(); ++geometry) {
+        for (auto lod = geometry->lodLevels_.Begin(); lod != geometry->lodLevels_.End(); ++lod) {
+            ModelVertexBuffer& vb = model.vertexBuffers_[lod->vbRef_];
+            const PODVector<unsigned>& indices = model.indexBuffers_[lod->ibRef_].indices_;
+            PODVector<unsigned>& owner = owners[lod->ibRef_];
+            for (unsigned i = lod->indexStart_; i < lod->indexStart_ + lod->indexCount_; ++i) {
+                if (indices[i] >= vb.vertexCount_) {
+                    vb.locked_ = true;
+                } else if (owner[i] == M_MAX_UNSIGNED) {
+                    owner[i] = lod->vbRef_;
+                } else if (owner[i] != lod->vbRef_) {
+                    vb.locked_ = true;
+                    model.vertexBuffers_[owner[i]].locked_ = true;
+                }
+            }
+        }
+    }
+
+    for (unsigned v = 0; v < model.vertexBuffers_.Size(); ++v) {
+        ModelVertexBuffer& vb = model.vertexBuffers_[v];
+        if (vb.locked_) {
+            continue;
+        }
+
+        PODVector<unsigned> remap;
+        if (settings.removeDuplicateVertices_) {
+            FindDuplicateVertices(vb, remap);
+        } else {
+            remap.Resize(vb.vertexCount_);
+            for (unsigned i = 0; i < vb.vertexCount_; ++i) {
+                remap[i] = i;
+            }
+        }
+
+        // Referenced vertices in the order of first use, then the unreferenced ones in their original order
+        PODVector<unsigned> newIndex;
+        ResizeFill(newIndex, vb.vertexCount_, M_MAX_UNSIGNED);
+        PODVector<unsigned> order;
+        if (settings.optimizeVertexFetch_) {
+            for (unsigned i = 0; i < model.indexBuffers_.Size(); ++i) {
+                const PODVector<unsigned>& indices = model.indexBuffers_[i].indices_;
+                for (unsigned j = 0; j < indices.Size(); ++j) {
+                    unsigned vertex = owners[i][j] == v ? remap[indices[j]] : M_MAX_UNSIGNED;
+                    if (vertex != M_MAX_UNSIGNED && newIndex[vertex] == M_MAX_UNSIGNED) {
+                        newIndex[vertex] = order.Size();
+                        order.Push(vertex);
+                    }
+                }
+            }
+        }
+        for (unsigned i = 0; i < vb.vertexCount_; ++i) {
+            if (remap[i] == i && newIndex[i] == M_MAX_UNSIGNED) {
+                newIndex[i] = order.Size();
+                order.Push(i);
+            }
+        }
+
+        PODVector<unsigned char> data(order.Size() * vb.vertexSize_);
+        for (unsigned i = 0; i < order.Size(); ++i) {
+            memcpy(&data[i * vb.vertexSize_], &vb.data_[order[i] * vb.vertexSize_], vb.vertexSize_);
+        }
+        vb.data_.Swap(data);
+        vb.vertexCount_ = order.Size();
+
+        for (unsigned i = 0; i < model.indexBuffers_.Size(); ++i) {
+            PODVector<unsigned>& indices = model.indexBuffers_[i].indices_;
+            for (unsigned j = 0; j < indices.Size(); ++j) {
+                if (owners[i][j] == v) {
+                    indices[j] = newIndex[remap[indices[j]]];
+                }
+            }
+        }
+    }
+}
+
+/// Return whether a LOD level shares indices with another one without being identical to it.
+static bool OverlapsOtherRange(const ModelFileData& model, const ModelLodLevel& level)
+{
+    for (auto geometry = model.geometries_.Begin(); geometry != model.geometries_.End(); ++geometry) {
+        for (auto lod = geometry->lodLevels_.Begin(); lod != geometry->lodLevels_.End(); ++lod) {
+            bool identical = lod->indexStart_ == level.indexStart_ && lod->indexCount_ == level.indexCount_;
+            if (lod->ibRef_ == level.ibRef_ && !identical && lod->indexStart_ < level.indexStart_ + level.indexCount_ &&
+                level.indexStart_ < lod->indexStart_ + lod->indexCount_) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool OptimizeModel(const void* data, unsigned size, const ModelOptimizeSettings& settings, PODVector<unsigned char>& dest,
+    ModelOptimizeResult& result, String& error)
+{
+    ModelFileData model;
+    if (!ReadModelFile(static_cast<const unsigned char*>(data), size, model, error)) {
+        return false;
+    }
+
+    // Morphs address vertices by index, the tail starts with the morph count
+    unsigned numMorphs = 0;
+    if (model.tailSize_ >= sizeof numMorphs) {
+        memcpy(&numMorphs, model.tail_, sizeof numMorphs);
+    }
+    for (auto it = model.vertexBuffers_.Begin(); it != model.vertexBuffers_.End(); ++it) {
+        it->locked_ = numMorphs > 0 || it->morphRangeCount_ > 0;
+        result.verticesBefore_ += it->vertexCount_;
+    }
+
+    // Ranges shared by several LOD levels are measured and optimised once
+    PODVector<ModelLodLevel> ranges;
+    for (auto geometry = model.geometries_.Begin(); geometry != model.geometries_.End(); ++geometry) {
+        for (auto lod = geometry->lodLevels_.Begin(); lod != geometry->lodLevels_.End(); ++lod) {
+            if (lod->type_ != TRIANGLE_LIST || lod->indexCount_ < 3) {
+                continue;
+            }
+            bool found = false;
+            for (auto it = ranges.Begin(); it != ranges.End() && !found; ++it) {
+                found = it->ibRef_ == lod->ibRef_ && it->indexStart_ == lod->indexStart_ && it->indexCount_ == lod->indexCount_;
+            }
+            if (!found) {
+                ranges.Push(*lod);
+            }
+        }
+    }
+    for (auto it = ranges.Begin(); it != ranges.End(); ++it) {
+        const unsigned* indices = &model.indexBuffers_[it->ibRef_].indices_[it->indexStart_];
+        result.numTriangles_ += it->indexCount_ / 3;
+        result.cacheMissesBefore_ += GetVertexCacheMisses(indices, it->indexCount_);
+    }
+
+    // Duplicates are merged first, so that the triangle order sees the shared vertices
+    bool mergeVertices = settings.removeDuplicateVertices_;
+    if (mergeVertices) {
+        ModelOptimizeSettings mergeSettings = settings;
+        mergeSettings.optimizeVertexFetch_ = false;
+        OptimizeVertexBuffers(model, mergeSettings);
+    }
+    if (settings.optimizeVertexCache_) {
+        for (auto it = ranges.Begin(); it != ranges.End(); ++it) {
+            if (!OverlapsOtherRange(model, *it)) {
+                OptimizeVertexCache(&model.indexBuffers_[it->ibRef_].indices_[it->indexStart_], it->indexCount_);
+            }
+        }
+    }
+    if (settings.optimizeVertexFetch_) {
+        ModelOptimizeSettings fetchSettings = settings;
+        fetchSettings.removeDuplicateVertices_ = false;
+        OptimizeVertexBuffers(model, fetchSettings);
+    }
+
+    for (auto it = ranges.Begin(); it != ranges.End(); ++it) {
+        const unsigned* indices = &model.indexBuffers_[it->ibRef_].indices_[it->indexStart_];
+        result.cacheMissesAfter_ += GetVertexCacheMisses(indices, it->indexCount_);
+    }
+    for (auto it = model.vertexBuffers_.Begin(); it != model.vertexBuffers_.End(); ++it) {
+        result.verticesAfter_ += it->vertexCount_;
+    }
+
+    // LOD levels are simplified from the full detail level and appended to its index buffer
+    for (auto geometry = model.geometries_.Begin(); settings.numLodLevels_ && geometry != model.geometries_.End(); ++geometry) {
+        if (geometry->lodLevels_.Size() != 1 || geometry->lodLevels_[0].type_ != TRIANGLE_LIST) {
+            continue;
+        }
+        ModelLodLevel base = geometry->lodLevels_[0];
+        const ModelVertexBuffer& vb = model.vertexBuffers_[base.vbRef_];
+        ModelIndexBuffer& ib = model.indexBuffers_[base.ibRef_];
+        if (vb.positionOffset_ == M_MAX_UNSIGNED || base.indexCount_ < 3) {
+            continue;
+        }
+
+        PODVector<unsigned> source(&ib.indices_[base.indexStart_], base.indexCount_);
+        unsigned previousTriangles = base.indexCount_ / 3;
+        PODVector<unsigned> simplified;
+        for (unsigned level = 1; level <= settings.numLodLevels_; ++level) {
+            auto targetTriangles = (unsigned)(previousTriangles * settings.lodReduction_);
+            if (targetTriangles < MIN_LOD_TRIANGLES || targetTriangles >= previousTriangles ||
+                !SimplifyTriangles(source.Buffer(), source.Size(), vb, targetTriangles, simplified)) {
+                break;
+            }
+            if (settings.optimizeVertexCache_) {
+                OptimizeVertexCache(simplified.Buffer(), simplified.Size());
+            }
+
+            ModelLodLevel lod = base;
+            lod.distance_ = settings.lodDistance_ * (float)(1u << (level - 1));
+            lod.indexStart_ = ib.indices_.Size();
+            lod.indexCount_ = simplified.Size();
+            ib.indices_.Push(simplified);
+            geometry->lodLevels_.Push(lod);
+            previousTriangles = simplified.Size() / 3;
+            ++result.numLodLevels_;
+        }
+    }
+
+    WriteModelFile(model, dest);
+    return true;
+}
@@ -0,0 +1,72 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Container/Vector.h>
+
+using namespace Urho3D;
+
+/// Optimisations applied to a model file before it is loaded.
+struct ModelOptimizeSettings
+{
+    /// Merge vertices whose data is identical.
+    bool removeDuplicateVertices_{true};
+    /// Reorder triangles for vertex cache locality.
+    bool optimizeVertexCache_{true};
+    /// Reorder vertices in the order the triangles first use them.
+    bool optimizeVertexFetch_{true};
+    /// Number of simplified LOD levels generated for geometries that have a single LOD level, 0 for none.
+    unsigned numLodLevels_{};
+    /// Triangle count of each generated LOD level relative to the previous level.
+    float lodReduction_{0.5f};
+    /// Distance of the first generated LOD level, doubled for every following level.
+    float lodDistance_{20.0f};
+};
+
+/// Result of a model optimisation.
+struct ModelOptimizeResult
+{
+    /// Vertex count of all vertex buffers before the optimisation.
+    unsigned verticesBefore_{};
+    /// Vertex count of all vertex buffers after the optimisation.
+    unsigned verticesAfter_{};
+    /// Triangles in the triangle lists of the original LOD levels.
+    unsigned numTriangles_{};
+    /// Vertex cache misses of the original LOD levels before the optimisation, measured with a 16-entry FIFO cache.
+    unsigned cacheMissesBefore_{};
+    /// Vertex cache misses of the original LOD levels after the optimisation.
+    unsigned cacheMissesAfter_{};
+    /// Number of generated LOD levels over all geometries.
+    unsigned numLodLevels_{};
+};
+
+/// Optimise model file data (.mdl, UMDL or UMD2) into dest, which is a model file with the same layout. Vertices are only
+/// merged and reordered in models without vertex morphs. CPU only, safe to call from worker threads. Return true on
+/// success, otherwise error is set and dest is undefined.
+bool OptimizeModel(const void* data, unsigned size, const ModelOptimizeSettings& settings, PODVector<unsigned char>& dest,
+    ModelOptimizeResult& result, String& error);
+/// Return number of vertex cache misses of a triangle list, measured with a 16-entry FIFO cache.
+unsigned GetVertexCacheMisses(const unsigned* indices, unsigned numIndices);
+/// Reorder triangles of a triangle list for vertex cache locality.
+void OptimizeVertexCache(unsigned* indices, unsigned numIndices);
@@ -0,0 +1,338 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Math/MathDefs.h>
+
+#include <LZ4/lz4.h>
+#include <STB/stb_image.h>
+
+#include "PayloadCompression.h"
+
+/// Magic bytes of an LZ4 frame, little endian.
+static const unsigned LZ4_FRAME_MAGIC = 0x184d2204;
+/// Magic bytes of a Zstandard frame, little endian.
+static const unsigned ZSTD_FRAME_MAGIC = 0xfd2fb528;
+/// Largest window an LZ4 block can refer back to.
+static const unsigned LZ4_MAX_DICTIONARY = 65536;
+
+/// CRC-32 lookup table of the gzip trailer checksum.
+struct CRC32Table
+{
+    /// Construct.
+    CRC32Table()
+    {
+        for (unsigned i = 0; i < 256; ++i) {
+            unsigned crc = i;
+            for (unsigned j = 0; j < 8; ++j) {
+                crc = crc & 1 ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+            }
+            entries_[i] = crc;
+        }
+    }
+
+    /// Table entries.
+    unsigned entries_[256];
+};
+
+static inline unsigned ReadLE32(const unsigned char* data)
+{
+    return data[0] | (unsigned)data[1] << 8 | (unsigned)data[2] << 16 | (unsigned)data[3] << 24;
+}
+
+static unsigned ComputeCRC32(const unsigned char* data, unsigned size)
+{
+    // Function-local static is initialized once even when workers race for it
+    static const CRC32Table table;
+    unsigned crc = 0xffffffff;
+    for (unsigned i = 0; i < size; ++i) {
+        crc = table.entries_[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static inline unsigned RotateLeft(unsigned value, unsigned bits)
+{
+    return value << bits | value >> (32 - bits);
+}
+
+/// Return xxHash32 with zero seed, the checksum of LZ4 frames.
+static unsigned ComputeXXH32(const unsigned char* data, unsigned size)
+{
+    static const unsigned PRIME1 = 2654435761U;
+    static const unsigned PRIME2 = 2246822519U;
+    static const unsigned PRIME3 = 3266489917U;
+    static const unsigned PRIME4 = 668265263U;
+    static const unsigned PRIME5 = 374761393U;
+
+    unsigned pos = 0;
+    unsigned hash;
+    if (size >= 16) {
+        unsigned v[4] = {PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1};
+        for (; pos + 16 <= size; pos += 16) {
+            for (unsigned i = 0; i < 4; ++i) {
+                v[i] = RotateLeft(v[i] + ReadLE32(data + pos + i * 4) * PRIME2, 13) * PRIME1;
+            }
+        }
+        hash = RotateLeft(v[0], 1) + RotateLeft(v[1], 7) + RotateLeft(v[2], 12) + RotateLeft(v[3], 18);
+    } else {
+        hash = PRIME5;
+    }
+    hash += size;
+    for (; pos + 4 <= size; pos += 4) {
+        hash = RotateLeft(hash + ReadLE32(data + pos) * PRIME3, 17) * PRIME4;
+    }
+    for (; pos < size; ++pos) {
+        hash = RotateLeft(hash + data[pos] * PRIME5, 11) * PRIME1;
+    }
+    hash ^= hash >> 15;
+    hash *= PRIME2;
+    hash ^= hash >> 13;
+    hash *= PRIME3;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/// Decompress a single gzip member straight into an output of the size stored in its trailer.
+static bool DecompressGzip(const unsigned char* data, unsigned size, PODVector<unsigned char>& dest, String& error)
+{
+    if (size < 18 || data[0] != 0x1f || data[1] != 0x8b || data[2] != 8) {
+        error = "invalid gzip header";
+        return false;
+    }
+
+    // Skip the optional extra field, file name, comment and header checksum
+    unsigned char flags = data[3];
+    unsigned pos = 10;
+    if (flags & 4) {
+        pos += 2 + (data[pos] | data[pos + 1] << 8);
+    }
+    if (flags & 8) {
+        while (pos < size && data[pos++]) {
+        }
+    }
+    if (flags & 16) {
+        while (pos < size && data[pos++]) {
+        }
+    }
+    if (flags & 2) {
+        pos += 2;
+    }
+    if (pos + 8 > size) {
+        error = "truncated gzip data";
+        return false;
+    }
+
+    // Deflate can't expand more than 1032:1, a larger size means a corrupt trailer
+    unsigned crc = ReadLE32(data + size - 8);
+    unsigned decompressedSize = ReadLE32(data + size - 4);
+    unsigned compressedSize = size - 8 - pos;
+    if (decompressedSize / 1032 > compressedSize) {
+        error = "corrupt gzip trailer";
+        return false;
+    }
+
+    dest.Resize(decompressedSize);
+    if (decompressedSize) {
+        int decoded = stbi_zlib_decode_noheader_buffer((char*)dest.Buffer(), decompressedSize, (const char*)data + pos, compressedSize);
+        if (decoded != (int)decompressedSize) {
+            // stbi_failure_reason() is a global shared by all threads, the result is enough to tell the cases apart
+            error = decoded < 0 ? String("corrupt deflate stream") : String("gzip size mismatch");
+            return false;
+        }
+    }
+    if (ComputeCRC32(dest.Buffer(), dest.Size()) != crc) {
+        error = "gzip checksum mismatch";
+        return false;
+    }
+    return true;
+}
+
+/// Decompress an LZ4 frame block by block into a contiguous output, so linked blocks find their history in place.
+static bool DecompressLZ4(const unsigned char* data, unsigned size, PODVector<unsigned char>& dest, String& error)
+{
+    if (size < 7 || ReadLE32(data) != LZ4_FRAME_MAGIC || (data[4] >> 6) != 1) {
+        error = "invalid LZ4 frame header";
+        return false;
+    }
+    unsigned char flags = data[4];
+    if (flags & 1) {
+        error = "LZ4 frames with a dictionary are not supported";
+        return false;
+    }
+    bool independentBlocks = (flags & 0x20) != 0;
+    bool blockChecksums = (flags & 0x10) != 0;
+    bool hasContentSize = (flags & 0x08) != 0;
+    bool contentChecksum = (flags & 0x04) != 0;
+    unsigned blockSizeId = (data[5] >> 4) & 7;
+    if (blockSizeId < 4) {
+        error = "invalid LZ4 block size";
+        return false;
+    }
+    unsigned blockMaxSize = 1u << (2 * blockSizeId + 8);
+
+    dest.Clear();
+    unsigned pos = 6;
+    unsigned contentSize = M_MAX_UNSIGNED;
+    if (hasContentSize) {
+        if (pos + 8 > size || ReadLE32(data + pos + 4)) {
+            error = "LZ4 frame is truncated or too large";
+            return false;
+        }
+        contentSize = ReadLE32(data + pos);
+        dest.Reserve(contentSize);
+        pos += 8;
+    }
+    // Header checksum
+    ++pos;
+
+    for (;;) {
+        if (pos + 4 > size) {
+            error = "truncated LZ4 frame";
+            return false;
+        }
+        unsigned blockSize = ReadLE32(data + pos);
+        pos += 4;
+        if (!blockSize) {
+            break;
+        }
+
+        bool uncompressed = (blockSize & 0x80000000) != 0;
+        blockSize &= 0x7fffffff;
+        unsigned offset = dest.Size();
+        if (blockSize > blockMaxSize || blockSize + (blockChecksums ? 4 : 0) > size - pos || offset > contentSize) {
+            error = "corrupt LZ4 block";
+            return false;
+        }
+        if (blockChecksums && ComputeXXH32(data + pos, blockSize) != ReadLE32(data + pos + blockSize)) {
+            error = "LZ4 block checksum mismatch";
+            return false;
+        }
+
+        // Output never grows past the stored content size
+        unsigned capacity = Min(blockMaxSize, contentSize - offset);
+        const char* source = (const char*)data + pos;
+        if (uncompressed) {
+            if (blockSize > capacity) {
+                error = "corrupt LZ4 block";
+                return false;
+            }
+            dest.Resize(offset + blockSize);
+            memcpy(dest.Buffer() + offset, source, blockSize);
+        } else {
+            dest.Resize(offset + capacity);
+            char* output = (char*)dest.Buffer() + offset;
+            unsigned dictionarySize = independentBlocks ? 0 : Min(offset, LZ4_MAX_DICTIONARY);
+            int decoded = dictionarySize ? LZ4_decompress_safe_usingDict(source, output, blockSize, capacity, output - dictionarySize, dictionarySize) :
+                LZ4_decompress_safe(source, output, blockSize, capacity);
+            if (decoded < 0) {
+                error = "corrupt LZ4 block";
+                return false;
+            }
+            dest.Resize(offset + decoded);
+        }
+        pos += blockSize + (blockChecksums ? 4 : 0);
+    }
+
+    if (hasContentSize && dest.Size() != contentSize) {
+        error = "LZ4 content size mismatch";
+        return false;
+    }
+    if (contentChecksum && (pos + 4 > size || ComputeXXH32(dest.Buffer(), dest.Size()) != ReadLE32(data + pos))) {
+        error = "LZ4 content checksum mismatch";
+        return false;
+    }
+    return true;
+}
+
+PayloadCompression GetPayloadCompression(const String& filename, const void* data, unsigned size)
+{
+    if (filename.EndsWith(".gz", false)) {
+        return COMPRESSION_GZIP;
+    } else if (filename.EndsWith(".lz4", false)) {
+        return COMPRESSION_LZ4;
+    } else if (filename.EndsWith(".zst", false)) {
+        return COMPRESSION_ZSTD;
+    }
+
+    auto* bytes = static_cast<const unsigned char*>(data);
+    if (size >= 3 && bytes[0] == 0x1f && bytes[1] == 0x8b && bytes[2] == 8) {
+        return COMPRESSION_GZIP;
+    } else if (size >= 4 && ReadLE32(bytes) == LZ4_FRAME_MAGIC) {
+        return COMPRESSION_LZ4;
+    } else if (size >= 4 && ReadLE32(bytes) == ZSTD_FRAME_MAGIC) {
+        return COMPRESSION_ZSTD;
+    }
+    return COMPRESSION_NONE;
+}
+
+String GetDecompressedName(const String& filename)
+{
+    if (filename.EndsWith(".gz", false) || filename.EndsWith(".lz4", false) || filename.EndsWith(".zst", false)) {
+        return filename.Substring(0, filename.FindLast('.'));
+    }
+    return filename;
+}
+
+const char* GetPayloadCompressionName(PayloadCompression compression)
+{
+    switch (compression) {
+    case COMPRESSION_GZIP:
+        return "gzip";
+    case COMPRESSION_LZ4:
+        return "LZ4";
+    case COMPRESSION_ZSTD:
+        return "zstd";
+    default:
+        return "none";
+    }
+}
+
+unsigned GetDecompressedSize(PayloadCompression compression, const void* data, unsigned size)
+{
+    auto* bytes = static_cast<const unsigned char*>(data);
+    if (compression == COMPRESSION_GZIP && size >= 18) {
+        // Same limit as DecompressGzip(), a corrupt trailer must not reserve a huge output
+        unsigned decompressedSize = ReadLE32(bytes + size - 4);
+        return decompressedSize / 1032 <= size ? decompressedSize : 0;
+    } else if (compression == COMPRESSION_LZ4 && size >= 15 && (bytes[4] & 0x08) && !ReadLE32(bytes + 10)) {
+        return ReadLE32(bytes + 6);
+    }
+    return 0;
+}
+
+bool DecompressPayload(PayloadCompression compression, const void* data, unsigned size, PODVector<unsigned char>& dest, String& error)
+{
+    auto* bytes = static_cast<const unsigned char*>(data);
+    switch (compression) {
+    case COMPRESSION_GZIP:
+        return DecompressGzip(bytes, size, dest, error);
+    case COMPRESSION_LZ4:
+        return DecompressLZ4(bytes, size, dest, error);
+    case COMPRESSION_ZSTD:
+        error = "zstd is not supported, Urho3D has no zstd decoder";
+        return false;
+    default:
+        dest.Resize(size);
+        memcpy(dest.Buffer(), data, size);
+        return true;
+    }
+}
@@ -0,0 +1,52 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Container/Vector.h>
+
+using namespace Urho3D;
+
+/// Compression of a resource payload.
+enum PayloadCompression
+{
+    /// Raw payload.
+    COMPRESSION_NONE = 0,
+    /// Gzip member (RFC 1952), .gz suffix or HTTP Content-Encoding: gzip.
+    COMPRESSION_GZIP,
+    /// LZ4 frame, .lz4 suffix.
+    COMPRESSION_LZ4,
+    /// Zstandard frame, .zst suffix. Detected but not supported, there is no decoder in Urho3D.
+    COMPRESSION_ZSTD
+};
+
+/// Return compression of a payload from the file name suffix, or from the magic bytes if there is no suffix.
+PayloadCompression GetPayloadCompression(const String& filename, const void* data, unsigned size);
+/// Return file name without the compression suffix.
+String GetDecompressedName(const String& filename);
+/// Return compression name for logging.
+const char* GetPayloadCompressionName(PayloadCompression compression);
+/// Return decompressed size stored in the payload, or 0 if it does not store one.
+unsigned GetDecompressedSize(PayloadCompression compression, const void* data, unsigned size);
+/// Decompress payload into dest. Output is allocated once when the payload stores the decompressed size. Return true on success, otherwise error is set.
+bool DecompressPayload(PayloadCompression compression, const void* data, unsigned size, PODVector<unsigned char>& dest, String& error);
@@ -0,0 +1,422 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Thread.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+
+#include "PersistentResourceStore.h"
+
+/// Index file name inside the store directory.
+static const char* INDEX_FILE_NAME = "index.dat";
+/// Index file format version, increment when the layout changes.
+static const unsigned INDEX_VERSION = 1;
+
+/// Write payload to a temporary file and rename it to the object file, so that an object file is never seen half-written.
+static bool WriteObject(Context* context, const String& directory, const String& tempName, const String& hash, const void* data,
+    unsigned size)
+{
+    bool success;
+    {
+        File file(context, directory + tempName, FILE_WRITE);
+        success = file.IsOpen() && file.Write(data, size) == size;
+    }
+
+    auto* fileSystem = context->GetSubsystem<FileSystem>();
+    if (success && fileSystem->Rename(directory + tempName, directory + hash)) {
+        return true;
+    }
+    // Rename does not replace an existing file on every platform, an existing object file has the same content
+    fileSystem->Delete(directory + tempName);
+    return success && fileSystem->FileExists(directory + hash);
+}
+
+/// Worker thread part of storing a payload.
+static void WriteObjectWork(const WorkItem* workItem, unsigned threadIndex)
+{
+    auto* write = static_cast<PersistentObjectWrite*>(workItem->aux_);
+    if (write->hash_.Empty()) {
+        write->hash_ = PersistentResourceStore::ComputeHash(write->data_.Buffer(), write->data_.Size());
+    }
+    write->success_ = WriteObject(write->context_, write->directory_, write->tempName_, write->hash_, write->data_.Buffer(),
+        write->data_.Size());
+}
+
+/// Complete a write without waiting for a worker thread and return its result and content hash. A write no worker thread
+/// has started yet is taken off the queue and executed, which only the main thread may do. A running write is taken over:
+/// the object is written from the same copy under another temporary name, and the worker's result is ignored.
+static bool CompleteWrite(WorkQueue* queue, PersistentObjectWrite* write, String& hash)
+{
+    OwnedWorkItem* workItem = write->workItem_;
+    if (workItem->completed_ && !write->takenOver_) {
+        hash = write->hash_;
+        return write->success_;
+    }
+    // Without the work queue there are no worker threads left to run the item
+    if (!write->takenOver_ && Thread::IsMainThread() && (!queue || queue->RemoveWorkItem(SharedPtr<WorkItem>(workItem)))) {
+        workItem->workFunction_(workItem, 0);
+        workItem->completed_ = true;
+        hash = write->hash_;
+        return write->success_;
+    }
+
+    // The worker fills in the hash of a deferred entry, so it is computed here again instead of being read
+    hash = write->deferredEntry_ ? PersistentResourceStore::ComputeHash(write->data_.Buffer(), write->data_.Size()) : write->hash_;
+    if (write->takenOver_ && write->context_->GetSubsystem<FileSystem>()->FileExists(write->directory_ + hash)) {
+        return true;
+    }
+    write->takenOver_ = true;
+    return WriteObject(write->context_, write->directory_, "s" + write->tempName_, hash, write->data_.Buffer(), write->data_.Size());
+}
+
+PersistentResourceStore::PersistentResourceStore(Context* context) :
+    ResourceRouter(context)
+{
+}
+
+PersistentResourceStore::~PersistentResourceStore()
+{
+    FinishWrites(true);
+    SaveIndex();
+}
+
+bool PersistentResourceStore::Open(const String& directory)
+{
+    FinishWrites(true);
+    MutexLock lock(mutex_);
+    auto* fileSystem = GetSubsystem<FileSystem>();
+    directory_ = AddTrailingSlash(directory);
+    entries_.Clear();
+    indexDirty_ = false;
+
+    if (!fileSystem->DirExists(directory_) && !fileSystem->CreateDir(directory_)) {
+        URHO3D_LOGERRORF("Could not create persistent resource store directory %s", directory_.CString());
+        directory_.Clear();
+        return false;
+    }
+
+    // Temporary files of writes interrupted in a previous session
+    StringVector tempFiles;
+    fileSystem->ScanDir(tempFiles, directory_, "*.tmp", SCAN_FILES, false);
+    for (auto it = tempFiles.Begin(); it != tempFiles.End(); ++it) {
+        fileSystem->Delete(directory_ + *it);
+    }
+
+    if (fileSystem->FileExists(directory_ + INDEX_FILE_NAME) && !LoadIndex()) {
+        URHO3D_LOGWARNINGF("Persistent resource store index in %s is invalid, starting with an empty store", directory_.CString());
+        entries_.Clear();
+        indexDirty_ = true;
+    }
+
+    URHO3D_LOGINFOF("Opened persistent resource store %s with %d resources", directory_.CString(), entries_.Size());
+    return true;
+}
+
+String PersistentResourceStore::Store(const String& filename, const char* content, unsigned size, const String& contentHash)
+{
+    if (directory_.Empty()) {
+        return String::EMPTY;
+    }
+
+    MutexLock lock(mutex_);
+
+    SupersedeWrites(filename);
+    auto it = entries_.Find(filename);
+    if (!contentHash.Empty() && it != entries_.End() && it->second_.hash_ == contentHash) {
+        it->second_.session_ = true;
+        return contentHash;
+    }
+
+    if (contentHash.Empty()) {
+        // The entry of the previous content would be stale until the hash of the new one is known
+        if (it != entries_.End()) {
+            String oldHash = it->second_.hash_;
+            entries_.Erase(it);
+            indexDirty_ = true;
+            DeleteUnusedObject(oldHash);
+        }
+        QueueWrite(filename, content, size, String::EMPTY);
+        return String::EMPTY;
+    }
+
+    // Identical content stored under another name shares the object file
+    if (!pendingObjects_.Contains(contentHash) && !GetSubsystem<FileSystem>()->FileExists(directory_ + contentHash)) {
+        pendingObjects_[contentHash] = QueueWrite(filename, content, size, contentHash);
+    }
+    SetEntry(filename, contentHash, size);
+    return contentHash;
+}
+
+bool PersistentResourceStore::Remove(const String& filename)
+{
+    MutexLock lock(mutex_);
+    SupersedeWrites(filename);
+    auto it = entries_.Find(filename);
+    if (it == entries_.End()) {
+        return false;
+    }
+
+    String hash = it->second_.hash_;
+    entries_.Erase(it);
+    indexDirty_ = true;
+    DeleteUnusedObject(hash);
+    return true;
+}
+
+bool PersistentResourceStore::Load(const String& filename, PODVector<unsigned char>& dest) const
+{
+    auto it = entries_.Find(filename);
+    if (it == entries_.End()) {
+        return false;
+    }
+
+    {
+        MutexLock lock(mutex_);
+        WaitForObject(it->second_.hash_);
+    }
+    File file(context_, directory_ + it->second_.hash_, FILE_READ);
+    if (!file.IsOpen()) {
+        return false;
+    }
+
+    dest.Resize(file.GetSize());
+    return file.Read(dest.Buffer(), dest.Size()) == dest.Size();
+}
+
+bool PersistentResourceStore::SaveIndex()
+{
+    if (!indexDirty_ || directory_.Empty()) {
+        return true;
+    }
+
+    // Write to a temporary file first so that a crash never leaves a truncated index behind
+    String indexPath = directory_ + INDEX_FILE_NAME;
+    String tempPath = indexPath + ".tmp";
+    {
+        File file(context_, tempPath, FILE_WRITE);
+        if (!file.IsOpen()) {
+            return false;
+        }
+
+        file.WriteFileID("DRCI");
+        file.WriteUInt(INDEX_VERSION);
+        file.WriteUInt(entries_.Size());
+        for (auto it = entries_.Begin(); it != entries_.End(); ++it) {
+            file.WriteString(it->first_);
+            file.WriteString(it->second_.hash_);
+            file.WriteUInt(it->second_.size_);
+        }
+    }
+
+    auto* fileSystem = GetSubsystem<FileSystem>();
+    fileSystem->Delete(indexPath);
+    if (!fileSystem->Rename(tempPath, indexPath)) {
+        return false;
+    }
+
+    indexDirty_ = false;
+    return true;
+}
+
+void PersistentResourceStore::FinishWrites(bool wait)
+{
+    MutexLock lock(mutex_);
+    auto* queue = GetSubsystem<WorkQueue>();
+    while (!pendingWrites_.Empty()) {
+        SharedPtr<PersistentObjectWrite> write = pendingWrites_.Front();
+        if (!write->workItem_->completed_ && !write->takenOver_ && !wait) {
+            return;
+        }
+        String hash;
+        bool success = CompleteWrite(queue, write, hash);
+        pendingWrites_.PopFront();
+        if (!write->deferredEntry_) {
+            auto pending = pendingObjects_.Find(hash);
+            if (pending != pendingObjects_.End() && pending->second_ == write) {
+                pendingObjects_.Erase(pending);
+            }
+        }
+        // A worker still writing a taken over object keeps the write alive until it has finished
+        if (!write->workItem_->completed_) {
+            write->workItem_->owner_ = write.Get();
+        }
+        write->workItem_.Reset();
+
+        // Without a known hash the object file of the same content may have been deleted as unused meanwhile
+        if (success && write->deferredEntry_ && !GetSubsystem<FileSystem>()->FileExists(directory_ + hash)) {
+            success = WriteObject(context_, directory_, "s" + write->tempName_, hash, write->data_.Buffer(), write->data_.Size());
+        }
+
+        if (!success) {
+            URHO3D_LOGERRORF("Failed to write %s to the persistent resource store", write->filename_.CString());
+            // Entries must not refer to an object file which doesn't exist
+            for (auto it = entries_.Begin(); it != entries_.End() && !write->deferredEntry_;) {
+                if (it->second_.hash_ == hash) {
+                    it = entries_.Erase(it);
+                    indexDirty_ = true;
+                } else {
+                    ++it;
+                }
+            }
+        } else if (write->deferredEntry_ && !write->superseded_) {
+            SetEntry(write->filename_, hash, write->data_.Size());
+        } else {
+            // The resource may have been removed or stored with other content meanwhile
+            DeleteUnusedObject(hash);
+        }
+    }
+}
+
+void PersistentResourceStore::Route(String& name, ResourceRequest requestType)
+{
+    // Called on the background loader thread too, the main thread changes the entries only under the mutex. Entries of
+    // previous sessions would take the place of same-named resource files which have not been added again
+    MutexLock lock(mutex_);
+    auto it = entries_.Find(name);
+    if (it != entries_.End() && (routeAll_ || it->second_.session_)) {
+        WaitForObject(it->second_.hash_);
+        name = it->second_.hash_;
+    }
+}
+
+const String& PersistentResourceStore::GetHash(const String& filename) const
+{
+    auto it = entries_.Find(filename);
+    return it != entries_.End() ? it->second_.hash_ : String::EMPTY;
+}
+
+String PersistentResourceStore::ComputeHash(const void* data, unsigned size)
+{
+    auto* bytes = static_cast<const unsigned char*>(data);
+    unsigned long long hash = 14695981039346656037ULL;
+    for (unsigned i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return ToString("%016llx", hash);
+}
+
+bool PersistentResourceStore::LoadIndex()
+{
+    File file(context_, directory_ + INDEX_FILE_NAME, FILE_READ);
+    if (!file.IsOpen() || file.ReadFileID() != "DRCI" || file.ReadUInt() != INDEX_VERSION) {
+        return false;
+    }
+
+    auto* fileSystem = GetSubsystem<FileSystem>();
+    unsigned count = file.ReadUInt();
+    for (unsigned i = 0; i < count && !file.IsEof(); ++i) {
+        String filename = file.ReadString();
+        PersistentResourceEntry entry;
+        entry.hash_ = file.ReadString();
+        entry.size_ = file.ReadUInt();
+        // Skip entries whose object file has been removed behind our back
+        if (fileSystem->FileExists(directory_ + entry.hash_)) {
+            entries_[filename] = entry;
+        } else {
+            indexDirty_ = true;
+        }
+    }
+
+    return true;
+}
+
+void PersistentResourceStore::DeleteUnusedObject(const String& hash)
+{
+    if (pendingObjects_.Contains(hash)) {
+        return;
+    }
+    for (auto it = entries_.Begin(); it != entries_.End(); ++it) {
+        if (it->second_.hash_ == hash) {
+            return;
+        }
+    }
+
+    GetSubsystem<FileSystem>()->Delete(directory_ + hash);
+}
+
+void PersistentResourceStore::SetEntry(const String& filename, const String& hash, unsigned size)
+{
+    String oldHash;
+    auto it = entries_.Find(filename);
+    if (it != entries_.End()) {
+        oldHash = it->second_.hash_;
+    }
+
+    PersistentResourceEntry& entry = entries_[filename];
+    entry.hash_ = hash;
+    entry.size_ = size;
+    entry.session_ = true;
+    indexDirty_ = true;
+
+    if (!oldHash.Empty() && oldHash != hash) {
+        DeleteUnusedObject(oldHash);
+    }
+}
+
+SharedPtr<PersistentObjectWrite> PersistentResourceStore::QueueWrite(const String& filename, const char* content, unsigned size,
+    const String& hash)
+{
+    SharedPtr<PersistentObjectWrite> write(new PersistentObjectWrite());
+    write->context_ = context_;
+    write->filename_ = filename;
+    write->hash_ = hash;
+    write->data_.Resize(size);
+    if (size) {
+        memcpy(write->data_.Buffer(), content, size);
+    }
+    write->directory_ = directory_;
+    write->tempName_ = ToString("%u.tmp", nextWriteId_++);
+    write->deferredEntry_ = hash.Empty();
+
+    SharedPtr<OwnedWorkItem> workItem(new OwnedWorkItem());
+    workItem->workFunction_ = WriteObjectWork;
+    workItem->aux_ = write.Get();
+    write->workItem_ = workItem;
+    pendingWrites_.Push(write);
+    GetSubsystem<WorkQueue>()->AddWorkItem(workItem);
+    return write;
+}
+
+void PersistentResourceStore::SupersedeWrites(const String& filename)
+{
+    for (auto it = pendingWrites_.Begin(); it != pendingWrites_.End(); ++it) {
+        if ((*it)->filename_ == filename) {
+            (*it)->superseded_ = true;
+        }
+    }
+}
+
+void PersistentResourceStore::WaitForObject(const String& hash) const
+{
+    auto it = pendingObjects_.Find(hash);
+    if (it == pendingObjects_.End()) {
+        return;
+    }
+    // The work queue is only touched on the main thread, other threads write the object themselves. The mutex keeps the
+    // write from being finished and released meanwhile
+    String objectHash;
+    CompleteWrite(Thread::IsMainThread() ? GetSubsystem<WorkQueue>() : nullptr, it->second_, objectHash);
+}
@@ -0,0 +1,154 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Resource/ResourceCache.h>
+
+using namespace Urho3D;
+
+/// Stored resource entry of the persistent resource store.
+struct PersistentResourceEntry
+{
+    /// Content hash, also the name of the object file.
+    String hash_;
+    /// Payload size in bytes.
+    unsigned size_{};
+    /// Whether the entry has been stored since the store was opened. Not saved in the index.
+    bool session_{};
+};
+
+/// Work item that can be abandoned while a worker thread runs it. The owner of the data the work function uses is kept
+/// alive until the item completes, so the main thread can drop the result instead of waiting for it.
+struct OwnedWorkItem : public WorkItem
+{
+    /// Object owning the work data, set when the item is abandoned. Released on the main thread when the work queue
+    /// purges the completed item.
+    SharedPtr<RefCounted> owner_;
+};
+
+/// Payload written to its object file on a worker thread.
+struct PersistentObjectWrite : public RefCounted
+{
+    /// Context for the file access.
+    Context* context_{};
+    /// Resource name.
+    String filename_;
+    /// Content hash, computed on the worker if it was not known when the payload was stored.
+    String hash_;
+    /// Copy of the payload.
+    PODVector<unsigned char> data_;
+    /// Store directory with trailing slash.
+    String directory_;
+    /// Temporary file the payload is written to before it is renamed to the object file.
+    String tempName_;
+    /// Work item executing the write.
+    SharedPtr<OwnedWorkItem> workItem_;
+    /// Write result.
+    bool success_{};
+    /// Whether the entry is recorded when the write has finished, because the hash was not known when it was queued.
+    bool deferredEntry_{};
+    /// Whether the resource has been stored again or removed since the write was queued.
+    bool superseded_{};
+    /// Whether the object was written on the calling thread because it was needed while a worker thread was still
+    /// writing it. The result of the work item is ignored then.
+    bool takenOver_{};
+};
+
+/// Content-addressed on-disk store of dynamically added resources. Routes resource requests to the stored payloads so that
+/// resources added in a previous session are loaded lazily by the ResourceCache.
+class URHO3D_API PersistentResourceStore : public ResourceRouter {
+URHO3D_OBJECT(PersistentResourceStore, ResourceRouter);
+
+public:
+    /// Construct.
+    explicit PersistentResourceStore(Context* context);
+    /// Destruct. Save the index if it has changed.
+    ~PersistentResourceStore() override;
+
+    /// Open store in a directory, creating it if needed, and restore the index. Return true on success.
+    bool Open(const String& directory);
+    /// Store resource payload, optionally with its precomputed content hash. The object file is written on a worker thread,
+    /// nothing is written if the same content is already stored. With the hash given the entry is recorded right away,
+    /// otherwise the hash is computed on the worker and the entry is recorded by FinishWrites(). Return content hash, empty
+    /// if it is not known yet.
+    String Store(const String& filename, const char* content, unsigned size, const String& hash = String::EMPTY);
+    /// Remove stored resource, deleting its object file if no other entry shares it. Return true if it was stored.
+    bool Remove(const String& filename);
+    /// Read stored payload of a resource. Return true on success.
+    bool Load(const String& filename, PODVector<unsigned char>& dest) const;
+    /// Write the index file if it has changed. Return true on success.
+    bool SaveIndex();
+    /// Finish object writes in the order they were queued, optionally waiting for all of them.
+    void FinishWrites(bool wait);
+    /// Route stored resource names to their object files. Only entries stored since the store was opened are routed,
+    /// unless routing of all entries is enabled.
+    void Route(String& name, ResourceRequest requestType) override;
+    /// Set whether entries stored in previous sessions are routed too. These then take the place of same-named files in
+    /// resource directories and packages.
+    void SetRouteAll(bool enable) { routeAll_ = enable; }
+
+    /// Return store directory with trailing slash.
+    const String& GetDirectory() const { return directory_; }
+    /// Return content hash of a stored resource, empty if not stored.
+    const String& GetHash(const String& filename) const;
+    /// Return all stored entries.
+    const HashMap<String, PersistentResourceEntry>& GetEntries() const { return entries_; }
+
+    /// Compute content hash of a payload as 16 lowercase hex digits (64-bit FNV-1a).
+    static String ComputeHash(const void* data, unsigned size);
+
+private:
+    /// Restore the index file. Return true on success.
+    bool LoadIndex();
+    /// Delete object file if no entry refers to it anymore and no write to it is pending.
+    void DeleteUnusedObject(const String& hash);
+    /// Record entry of a stored payload, deleting the object of the content it replaces.
+    void SetEntry(const String& filename, const String& hash, unsigned size);
+    /// Queue payload to be written to its object file on a worker thread.
+    SharedPtr<PersistentObjectWrite> QueueWrite(const String& filename, const char* content, unsigned size, const String& hash);
+    /// Mark pending writes of a resource as superseded.
+    void SupersedeWrites(const String& filename);
+    /// Make sure the object file of a pending write exists, writing it on the calling thread if needed. Called with the
+    /// mutex held.
+    void WaitForObject(const String& hash) const;
+
+    /// Stored entries by resource name.
+    HashMap<String, PersistentResourceEntry> entries_;
+    /// Store directory.
+    String directory_;
+    /// Object writes in the order they were queued.
+    List<SharedPtr<PersistentObjectWrite>> pendingWrites_;
+    /// Latest pending write of each object file whose hash is known.
+    HashMap<String, SharedPtr<PersistentObjectWrite>> pendingObjects_;
+    /// Id of the next temporary file.
+    unsigned nextWriteId_{};
+    /// Index has unsaved changes flag.
+    bool indexDirty_{};
+    /// Route entries of previous sessions flag.
+    bool routeAll_{};
+    /// Guards the entries and pending objects, which Route() reads on the background loader thread. Only the main thread
+    /// changes them, so its own reads go without the lock.
+    mutable Mutex mutex_;
+};
@@ -0,0 +1,374 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/StringUtils.h>
+
+#include <cstring>
+
+#include "ShaderPreprocessor.h"
+
+/// State of an open #if block.
+struct ConditionalBlock
+{
+    /// Whether the enclosing block is active.
+    bool parentActive_;
+    /// Whether a branch of this block has been taken.
+    bool taken_;
+    /// Whether #else has been seen.
+    bool else_;
+};
+
+static inline bool IsIdentifierChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+/// Replace comments with spaces, keeping line breaks.
+static String StripComments(const String& source)
+{
+    String result(source);
+    unsigned length = result.Length();
+    for (unsigned i = 0; i + 1 < length; ++i) {
+        if (result[i] == '/' && result[i + 1] == '/') {
+            for (; i < length && result[i] != '\n'; ++i) {
+                result[i] = ' ';
+            }
+        } else if (result[i] == '/' && result[i + 1] == '*') {
+            unsigned end = result.Find("*/", i + 2);
+            end = end == String::NPOS ? length : end + 2;
+            for (; i < end; ++i) {
+                if (result[i] != '\n') {
+                    result[i] = ' ';
+                }
+            }
+            --i;
+        }
+    }
+    return result;
+}
+
+ShaderPreprocessor::ShaderPreprocessor(const String& defines)
+{
+    Vector<String> defineVec = defines.Split(' ');
+    for (auto it = defineVec.Begin(); it != defineVec.End(); ++it) {
+        unsigned equals = it->Find('=');
+        if (equals == String::NPOS) {
+            defines_[*it] = String::EMPTY;
+        } else {
+            defines_[it->Substring(0, equals)] = it->Substring(equals + 1);
+        }
+    }
+}
+
+bool ShaderPreprocessor::Process(const String& source, String& result)
+{
+    error_.Clear();
+    macros_ = defines_;
+    result.Clear();
+    result.Reserve(source.Length());
+
+    Vector<String> lines = StripComments(source).Split('\n', true);
+    PODVector<ConditionalBlock> blocks;
+    bool active = true;
+    for (unsigned i = 0; i < lines.Size(); ++i) {
+        String line = lines[i].Trimmed();
+        if (!line.StartsWith("#")) {
+            if (active) {
+                result += lines[i];
+            }
+            result += '\n';
+            continue;
+        }
+
+        unsigned start = 1;
+        while (start < line.Length() && (line[start] == ' ' || line[start] == '\t')) {
+            ++start;
+        }
+        unsigned end = start;
+        while (end < line.Length() && IsIdentifierChar(line[end])) {
+            ++end;
+        }
+        String directive = line.Substring(start, end - start);
+        String argument = line.Substring(end).Trimmed();
+        String name = argument;
+        for (unsigned j = 0; j < argument.Length(); ++j) {
+            if (!IsIdentifierChar(argument[j])) {
+                name = argument.Substring(0, j);
+                break;
+            }
+        }
+
+        if (directive == "ifdef" || directive == "ifndef" || directive == "if") {
+            bool value = false;
+            if (active) {
+                if (directive == "if") {
+                    if (!Evaluate(argument, value)) {
+                        error_ = ToString("line %u: %s", i + 1, error_.CString());
+                        return false;
+                    }
+                } else {
+                    value = macros_.Contains(name) == (directive == "ifdef");
+                }
+            }
+            ConditionalBlock block = {active, value, false};
+            blocks.Push(block);
+            active = active && value;
+        } else if (directive == "elif" || directive == "else" || directive == "endif") {
+            if (blocks.Empty()) {
+                error_ = ToString("line %u: #%s without #if", i + 1, directive.CString());
+                return false;
+            }
+            if (directive != "endif" && blocks.Back().else_) {
+                error_ = ToString("line %u: #%s after #else", i + 1, directive.CString());
+                return false;
+            }
+            ConditionalBlock& block = blocks.Back();
+            if (directive == "endif") {
+                active = block.parentActive_;
+                blocks.Pop();
+            } else if (directive == "else") {
+                active = block.parentActive_ && !block.taken_;
+                block.taken_ = true;
+                block.else_ = true;
+            } else {
+                bool value = false;
+                if (block.parentActive_ && !block.taken_ && !Evaluate(argument, value)) {
+                    error_ = ToString("line %u: %s", i + 1, error_.CString());
+                    return false;
+                }
+                active = value;
+                block.taken_ = block.taken_ || value;
+            }
+        } else if (active) {
+            if (directive == "define") {
+                if (name.Empty()) {
+                    error_ = ToString("line %u: #define without a name", i + 1);
+                    return false;
+                }
+                macros_[name] = argument.Substring(name.Length()).Trimmed();
+            } else if (directive == "undef") {
+                macros_.Erase(name);
+            } else if (directive == "error") {
+                error_ = ToString("line %u: #error %s", i + 1, argument.CString());
+                return false;
+            } else {
+                // #version, #extension, #pragma and #line are left for the compiler
+                result += lines[i];
+            }
+        }
+        result += '\n';
+    }
+
+    if (!blocks.Empty()) {
+        error_ = "unterminated #if";
+        return false;
+    }
+    return true;
+}
+
+String ShaderPreprocessor::NormalizeDefines(const String& defines)
+{
+    Vector<String> defineVec = defines.ToUpper().Split(' ');
+    Sort(defineVec.Begin(), defineVec.End());
+    return String::Joined(defineVec, " ");
+}
+
+bool ShaderPreprocessor::Evaluate(const String& expression, bool& value)
+{
+    expression_ = expression;
+    position_ = 0;
+    int result = ParseOr();
+    SkipWhitespace();
+    if (error_.Empty() && position_ < expression_.Length()) {
+        error_ = "unexpected '" + expression_.Substring(position_) + "' in #if expression";
+    }
+    value = result != 0;
+    return error_.Empty();
+}
+
+int ShaderPreprocessor::ParseOr()
+{
+    int value = ParseAnd();
+    while (error_.Empty() && Accept("||")) {
+        int rhs = ParseAnd();
+        value = value || rhs;
+    }
+    return value;
+}
+
+int ShaderPreprocessor::ParseAnd()
+{
+    int value = ParseEquality();
+    while (error_.Empty() && Accept("&&")) {
+        int rhs = ParseEquality();
+        value = value && rhs;
+    }
+    return value;
+}
+
+int ShaderPreprocessor::ParseEquality()
+{
+    int value = ParseRelational();
+    while (error_.Empty()) {
+        if (Accept("==")) {
+            value = value == ParseRelational();
+        } else if (Accept("!=")) {
+            value = value != ParseRelational();
+        } else {
+            break;
+        }
+    }
+    return value;
+}
+
+int ShaderPreprocessor::ParseRelational()
+{
+    int value = ParseAdditive();
+    while (error_.Empty()) {
+        if (Accept("<=")) {
+            value = value <= ParseAdditive();
+        } else if (Accept(">=")) {
+            value = value >= ParseAdditive();
+        } else if (Accept("<")) {
+            value = value < ParseAdditive();
+        } else if (Accept(">")) {
+            value = value > ParseAdditive();
+        } else {
+            break;
+        }
+    }
+    return value;
+}
+
+int ShaderPreprocessor::ParseAdditive()
+{
+    int value = ParseMultiplicative();
+    while (error_.Empty()) {
+        if (Accept("+")) {
+            value += ParseMultiplicative();
+        } else if (Accept("-")) {
+            value -= ParseMultiplicative();
+        } else {
+            break;
+        }
+    }
+    return value;
+}
+
+int ShaderPreprocessor::ParseMultiplicative()
+{
+    int value = ParseUnary();
+    while (error_.Empty()) {
+        if (Accept("*")) {
+            value *= ParseUnary();
+        } else if (Accept("/") || Accept("%")) {
+            bool modulo = expression_[position_ - 1] == '%';
+            int rhs = ParseUnary();
+            if (!rhs) {
+                error_ = "division by zero in #if expression";
+                return 0;
+            }
+            value = modulo ? value % rhs : value / rhs;
+        } else {
+            break;
+        }
+    }
+    return value;
+}
+
+int ShaderPreprocessor::ParseUnary()
+{
+    if (Accept("!")) {
+        return !ParseUnary();
+    } else if (Accept("-")) {
+        return -ParseUnary();
+    } else if (Accept("+")) {
+        return ParseUnary();
+    }
+    return ParsePrimary();
+}
+
+int ShaderPreprocessor::ParsePrimary()
+{
+    if (Accept("(")) {
+        int value = ParseOr();
+        if (error_.Empty() && !Accept(")")) {
+            error_ = "missing ')' in #if expression";
+        }
+        return value;
+    }
+
+    SkipWhitespace();
+    if (position_ < expression_.Length() && expression_[position_] >= '0' && expression_[position_] <= '9') {
+        String number = ReadIdentifier();
+        return ToInt(number.Replaced("u", "").Replaced("U", ""), 0);
+    }
+
+    String name = ReadIdentifier();
+    if (name.Empty()) {
+        error_ = position_ < expression_.Length() ? "unexpected '" + expression_.Substring(position_) + "' in #if expression" :
+            "unexpected end of #if expression";
+        return 0;
+    }
+    if (name == "defined") {
+        bool parenthesis = Accept("(");
+        String macro = ReadIdentifier();
+        if (macro.Empty() || (parenthesis && !Accept(")"))) {
+            error_ = "invalid defined() in #if expression";
+            return 0;
+        }
+        return macros_.Contains(macro) ? 1 : 0;
+    }
+
+    // Undefined identifiers are zero, the same as in C
+    auto macro = macros_.Find(name);
+    return macro != macros_.End() ? ToInt(macro->second_) : 0;
+}
+
+String ShaderPreprocessor::ReadIdentifier()
+{
+    SkipWhitespace();
+    unsigned start = position_;
+    while (position_ < expression_.Length() && IsIdentifierChar(expression_[position_])) {
+        ++position_;
+    }
+    return expression_.Substring(start, position_ - start);
+}
+
+void ShaderPreprocessor::SkipWhitespace()
+{
+    while (position_ < expression_.Length() && (expression_[position_] == ' ' || expression_[position_] == '\t')) {
+        ++position_;
+    }
+}
+
+bool ShaderPreprocessor::Accept(const char* token)
+{
+    SkipWhitespace();
+    unsigned length = String::CStringLength(token);
+    if (expression_.Length() - position_ < length || strncmp(expression_.CString() + position_, token, length)) {
+        return false;
+    }
+    position_ += length;
+    return true;
+}
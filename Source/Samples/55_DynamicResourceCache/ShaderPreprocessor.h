@@ -0,0 +1,82 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/Str.h>
+
+using namespace Urho3D;
+
+/// Minimal GLSL preprocessor which evaluates conditional compilation for a set of defines. Used to validate shader
+/// variants without a GPU. Macros are only expanded inside #if and #elif expressions, comments are removed.
+class ShaderPreprocessor
+{
+public:
+    /// Construct with space separated defines, NAME=VALUE defines a value.
+    explicit ShaderPreprocessor(const String& defines);
+
+    /// Preprocess source code into the active lines, line numbers are preserved. Return true on success.
+    bool Process(const String& source, String& result);
+    /// Return error of the last failed Process() call.
+    const String& GetError() const { return error_; }
+
+    /// Return defines sorted and in uppercase, the same form Shader uses to identify variations.
+    static String NormalizeDefines(const String& defines);
+
+private:
+    /// Evaluate #if expression. Return true on success.
+    bool Evaluate(const String& expression, bool& value);
+    /// Parse logical or expression.
+    int ParseOr();
+    /// Parse logical and expression.
+    int ParseAnd();
+    /// Parse equality expression.
+    int ParseEquality();
+    /// Parse relational expression.
+    int ParseRelational();
+    /// Parse additive expression.
+    int ParseAdditive();
+    /// Parse multiplicative expression.
+    int ParseMultiplicative();
+    /// Parse unary expression.
+    int ParseUnary();
+    /// Parse number, identifier, defined() or parenthesized expression.
+    int ParsePrimary();
+    /// Read identifier at the current expression position.
+    String ReadIdentifier();
+    /// Skip whitespace in the expression.
+    void SkipWhitespace();
+    /// Skip whitespace and consume token if it is next in the expression. Return true if consumed.
+    bool Accept(const char* token);
+
+    /// Defines given on construction.
+    HashMap<String, String> defines_;
+    /// Macros defined while processing.
+    HashMap<String, String> macros_;
+    /// Expression being evaluated.
+    String expression_;
+    /// Position in the expression.
+    unsigned position_{};
+    /// Last error.
+    String error_;
+};
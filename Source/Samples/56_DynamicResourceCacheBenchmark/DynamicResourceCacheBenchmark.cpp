@@ -0,0 +1,710 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Engine/Engine.h>
+#include <Urho3D/Engine/EngineDefs.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/IndexBuffer.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/ParticleEffect.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Math/Random.h>
+#include <Urho3D/Resource/Image.h>
+#include <Urho3D/Resource/JSONFile.h>
+#include <Urho3D/Resource/ResourceCache.h>
+
+#include "DynamicResourceCache.h"
+#include "DynamicResourceCacheBenchmark.h"
+#include "LoopbackHttpServer.h"
+#include "PersistentResourceStore.h"
+
+#include <Urho3D/DebugNew.h>
+
+URHO3D_DEFINE_APPLICATION_MAIN(DynamicResourceCacheBenchmark)
+
+/// Size class of the generated corpus files.
+struct CorpusSizeClass
+{
+    /// Size class label.
+    const char* name_;
+    /// Number of files of each type.
+    unsigned count_;
+    /// Nodes per XML file.
+    unsigned xmlNodes_;
+    /// Values per JSON file.
+    unsigned jsonValues_;
+    /// Helper functions per GLSL file.
+    unsigned glslFunctions_;
+    /// Width and height of the PNG files.
+    int imageSize_;
+    /// Vertices per model.
+    unsigned modelVertices_;
+};
+
+static const CorpusSizeClass CORPUS_SIZE_CLASSES[] = {
+    {"small", 100, 20, 50, 10, 32, 300},
+    {"medium", 50, 200, 500, 100, 128, 3000},
+    {"large", 10, 2000, 5000, 1000, 512, 30000},
+};
+
+/// Number of times each file is saved in an ingest burst.
+static const unsigned BURST_SAVES = 5;
+
+/// Maximum time to wait for asynchronous work to finish in milliseconds.
+static const unsigned BENCHMARK_TIMEOUT = 60000;
+
+DynamicResourceCacheBenchmark::DynamicResourceCacheBenchmark(Context* context) :
+    Application(context)
+{
+}
+
+void DynamicResourceCacheBenchmark::Setup()
+{
+    engineParameters_[EP_HEADLESS] = true;
+    engineParameters_[EP_LOG_NAME] = GetSubsystem<FileSystem>()->GetAppPreferencesDir("urho3d", "logs") + GetTypeName() + ".log";
+    corpusDir_ = GetSubsystem<FileSystem>()->GetAppPreferencesDir("urho3d", GetTypeName());
+    outputFile_ = corpusDir_ + "BenchmarkResults.json";
+
+    const Vector<String>& arguments = GetArguments();
+    for (unsigned i = 0; i + 1 < arguments.Size(); ++i) {
+        if (arguments[i].ToLower() == "-output") {
+            outputFile_ = arguments[i + 1];
+        }
+    }
+}
+
+void DynamicResourceCacheBenchmark::Start()
+{
+    // Per-file logging would dominate the measurements
+    GetSubsystem<Log>()->SetLevel(LOG_WARNING);
+    auto* dynamicCache = new DynamicResourceCache(context_);
+    dynamicCache->SetResourceLogging(false);
+    context_->RegisterSubsystem(dynamicCache);
+
+    CheckXMLRootTypes();
+    GenerateCorpus();
+
+    // Payloads are read directly from the corpus directory, so nothing can be loaded from it behind the subsystem's back
+    for (auto it = corpora_.Begin(); it != corpora_.End(); ++it) {
+        BenchmarkIngest(*it);
+    }
+    for (auto it = corpora_.Begin(); it != corpora_.End(); ++it) {
+        BenchmarkAsyncIngest(*it);
+    }
+    for (auto it = corpora_.Begin(); it != corpora_.End(); ++it) {
+        BenchmarkIngestBurst(*it);
+    }
+    for (auto it = corpora_.Begin(); it != corpora_.End(); ++it) {
+        if (it->type_ == "mdl") {
+            BenchmarkModelOptimization(*it);
+        }
+    }
+
+    for (auto it = corpora_.Begin(); it != corpora_.End(); ++it) {
+        if (it->type_ == "glsl") {
+            BenchmarkShaderVariants(*it);
+        }
+    }
+
+    auto* cache = GetSubsystem<ResourceCache>();
+    cache->AddResourceDir(corpusDir_);
+    for (auto it = corpora_.Begin(); it != corpora_.End(); ++it) {
+        BenchmarkReadBack(*it);
+    }
+    BenchmarkPackage();
+    cache->RemoveResourceDir(corpusDir_);
+
+#ifdef URHO3D_NETWORK
+    LoopbackHttpServer server(corpusDir_);
+    if (server.Start()) {
+        for (auto it = corpora_.Begin(); it != corpora_.End(); ++it) {
+            BenchmarkDownloads(*it, server.GetPort());
+        }
+        for (auto it = corpora_.Begin(); it != corpora_.End(); ++it) {
+            if (it->size_ == "large") {
+                BenchmarkRangedDownloads(*it, server);
+            }
+        }
+        server.Close();
+    } else {
+        URHO3D_LOGERROR("Could not start the loopback HTTP server, skipping download benchmarks");
+    }
+#endif
+
+    WriteResults();
+    engine_->Exit();
+}
+
+void DynamicResourceCacheBenchmark::GenerateCorpus()
+{
+    GetSubsystem<FileSystem>()->CreateDir(corpusDir_ + "Benchmark");
+    SetRandomSeed(1);
+
+    for (const CorpusSizeClass& sizeClass : CORPUS_SIZE_CLASSES) {
+        BenchmarkCorpus xml;
+        BenchmarkCorpus json;
+        BenchmarkCorpus glsl;
+        BenchmarkCorpus png;
+        BenchmarkCorpus mdl;
+        xml.type_ = "xml";
+        json.type_ = "json";
+        glsl.type_ = "glsl";
+        png.type_ = "png";
+        mdl.type_ = "mdl";
+
+        for (unsigned i = 0; i < sizeClass.count_; ++i) {
+            String prefix = ToString("Benchmark/%s%u", sizeClass.name_, i);
+            String content = GenerateXML(sizeClass.xmlNodes_);
+            WriteCorpusFile(xml, prefix + ".xml", content.CString(), content.Length());
+            content = GenerateJSON(sizeClass.jsonValues_);
+            WriteCorpusFile(json, prefix + ".json", content.CString(), content.Length());
+            content = GenerateGLSL(sizeClass.glslFunctions_);
+            WriteCorpusFile(glsl, prefix + ".glsl", content.CString(), content.Length());
+            GeneratePNG(png, prefix + ".png", sizeClass.imageSize_);
+            GenerateModel(mdl, prefix + ".mdl", sizeClass.modelVertices_);
+        }
+
+        BenchmarkCorpus* corpora[] = {&xml, &json, &glsl, &png, &mdl};
+        for (BenchmarkCorpus* corpus : corpora) {
+            corpus->size_ = sizeClass.name_;
+            corpora_.Push(*corpus);
+        }
+    }
+}
+
+void DynamicResourceCacheBenchmark::WriteCorpusFile(BenchmarkCorpus& corpus, const String& name, const void* data, unsigned size)
+{
+    File file(context_, corpusDir_ + name, FILE_WRITE);
+    file.Write(data, size);
+    corpus.names_.Push(name);
+    corpus.bytes_ += size;
+}
+
+String DynamicResourceCacheBenchmark::GenerateXML(unsigned nodes)
+{
+    String content = "<scene>\n";
+    for (unsigned i = 0; i < nodes; ++i) {
+        content += ToString("    <node id=\"%u\" position=\"%f %f %f\" />\n", i, Random(), Random(), Random());
+    }
+    content += "</scene>\n";
+    return content;
+}
+
+String DynamicResourceCacheBenchmark::GenerateJSON(unsigned values)
+{
+    String content = "{\n    \"values\": [";
+    for (unsigned i = 0; i < values; ++i) {
+        content += ToString(i ? ", %f" : "%f", Random());
+    }
+    content += "]\n}\n";
+    return content;
+}
+
+String DynamicResourceCacheBenchmark::GenerateGLSL(unsigned functions)
+{
+    String content = "varying vec2 vTexCoord;\n#ifdef SKINNED\nuniform vec4 cSkinMatrices[192];\n#endif\n\n";
+    for (unsigned i = 0; i < functions; ++i) {
+        content += ToString("float Helper%u(float x)\n{\n#if defined(SKINNED) && !defined(COMPILEPS)\n    x *= cSkinMatrices[0].x;\n"
+            "#endif\n    return x * %f + %f;\n}\n\n", i, Random(), Random());
+    }
+    content += "void VS()\n{\n    vTexCoord = vec2(Helper0(0.5), 0.0);\n}\n\n";
+    content += "void PS()\n{\n    gl_FragColor = vec4(vTexCoord, 0.0, 1.0);\n}\n";
+    return content;
+}
+
+void DynamicResourceCacheBenchmark::GeneratePNG(BenchmarkCorpus& corpus, const String& name, int size)
+{
+    PODVector<unsigned char> pixels((unsigned)(size * size * 4));
+    for (unsigned i = 0; i < pixels.Size(); ++i) {
+        pixels[i] = (unsigned char)Rand();
+    }
+    SharedPtr<Image> image(new Image(context_));
+    image->SetSize(size, size, 4);
+    image->SetData(pixels.Buffer());
+    image->SavePNG(corpusDir_ + name);
+
+    corpus.names_.Push(name);
+    corpus.bytes_ += GetSubsystem<FileSystem>()->GetFileSize(corpusDir_ + name);
+}
+
+void DynamicResourceCacheBenchmark::GenerateModel(BenchmarkCorpus& corpus, const String& name, unsigned vertices)
+{
+    // Like an unoptimised export: a smooth height field whose triangles each have their own vertices, in random order
+    PODVector<VertexElement> elements;
+    elements.Push(VertexElement(TYPE_VECTOR3, SEM_POSITION));
+    elements.Push(VertexElement(TYPE_VECTOR3, SEM_NORMAL));
+    auto gridSize = (unsigned)Max(sqrtf(vertices / 6.0f), 1.0f);
+    vertices = gridSize * gridSize * 6;
+    PODVector<float> vertexData(vertices * 6);
+    float* vertex = vertexData.Buffer();
+    for (unsigned y = 0; y < gridSize; ++y) {
+        for (unsigned x = 0; x < gridSize; ++x) {
+            static const unsigned corners[] = {0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1};
+            for (unsigned i = 0; i < 6; ++i) {
+                float px = (float)(x + corners[i * 2]) / gridSize * 2.0f - 1.0f;
+                float pz = (float)(y + corners[i * 2 + 1]) / gridSize * 2.0f - 1.0f;
+                float py = 0.25f * sinf(px * 3.0f) * cosf(pz * 3.0f);
+                Vector3 normal = Vector3(-0.75f * cosf(px * 3.0f) * cosf(pz * 3.0f), 1.0f, 0.75f * sinf(px * 3.0f) * sinf(pz * 3.0f)).Normalized();
+                *vertex++ = px;
+                *vertex++ = py;
+                *vertex++ = pz;
+                *vertex++ = normal.x_;
+                *vertex++ = normal.y_;
+                *vertex++ = normal.z_;
+            }
+        }
+    }
+    unsigned numTriangles = vertices / 3;
+    PODVector<unsigned> indexData(vertices);
+    for (unsigned i = 0; i < vertices; ++i) {
+        indexData[i] = i;
+    }
+    for (unsigned i = numTriangles - 1; i > 0; --i) {
+        auto j = (unsigned)Random((int)i + 1);
+        for (unsigned k = 0; k < 3; ++k) {
+            Swap(indexData[i * 3 + k], indexData[j * 3 + k]);
+        }
+    }
+
+    SharedPtr<VertexBuffer> vertexBuffer(new VertexBuffer(context_));
+    vertexBuffer->SetShadowed(true);
+    vertexBuffer->SetSize(vertices, elements);
+    vertexBuffer->SetData(vertexData.Buffer());
+    SharedPtr<IndexBuffer> indexBuffer(new IndexBuffer(context_));
+    indexBuffer->SetShadowed(true);
+    indexBuffer->SetSize(vertices, true);
+    indexBuffer->SetData(indexData.Buffer());
+
+    SharedPtr<Geometry> geometry(new Geometry(context_));
+    geometry->SetVertexBuffer(0, vertexBuffer);
+    geometry->SetIndexBuffer(indexBuffer);
+    geometry->SetDrawRange(TRIANGLE_LIST, 0, vertices);
+
+    Vector<SharedPtr<VertexBuffer>> vertexBuffers;
+    vertexBuffers.Push(vertexBuffer);
+    Vector<SharedPtr<IndexBuffer>> indexBuffers;
+    indexBuffers.Push(indexBuffer);
+    PODVector<unsigned> morphRangeStarts(1, 0);
+    PODVector<unsigned> morphRangeCounts(1, 0);
+
+    SharedPtr<Model> model(new Model(context_));
+    model->SetVertexBuffers(vertexBuffers, morphRangeStarts, morphRangeCounts);
+    model->SetIndexBuffers(indexBuffers);
+    model->SetNumGeometries(1);
+    model->SetNumGeometryLodLevels(0, 1);
+    model->SetGeometry(0, 0, geometry);
+    model->SetBoundingBox(BoundingBox(-1.0f, 1.0f));
+
+    File file(context_, corpusDir_ + name, FILE_WRITE);
+    model->Save(file);
+    corpus.names_.Push(name);
+    corpus.bytes_ += file.GetSize();
+}
+
+void DynamicResourceCacheBenchmark::ReadCorpus(const BenchmarkCorpus& corpus, Vector<PODVector<unsigned char>>& payloads)
+{
+    payloads.Resize(corpus.names_.Size());
+    for (unsigned i = 0; i < corpus.names_.Size(); ++i) {
+        File file(context_, corpusDir_ + corpus.names_[i], FILE_READ);
+        payloads[i].Resize(file.GetSize());
+        file.Read(payloads[i].Buffer(), payloads[i].Size());
+    }
+}
+
+void DynamicResourceCacheBenchmark::CheckXMLRootTypes()
+{
+    auto* cache = GetSubsystem<ResourceCache>();
+    auto* dynamicCache = GetSubsystem<DynamicResourceCache>();
+    dynamicCache->SetAsyncIngest(false);
+    dynamicCache->RegisterXMLRootType("particleEmitterConfig", ParticleEffect::GetTypeStatic());
+
+    // One root registered in lowercase and sent in camelCase, one the other way around
+    static const char* names[] = {"RootTypes/Registered.xml", "RootTypes/CamelCase.xml"};
+    static const char* roots[] = {"particleemitterconfig", "particleEffect"};
+    for (unsigned i = 0; i < 2; ++i) {
+        String content = String("<?xml version=\"1.0\"?>\n<") + roots[i] + " />\n";
+        dynamicCache->ProcessResource(names[i], content.CString(), content.Length());
+        if (!cache->GetExistingResource<ParticleEffect>(names[i])) {
+            URHO3D_LOGERRORF("XML root %s was not loaded as a particle effect", roots[i]);
+        }
+        dynamicCache->RemoveResource(names[i]);
+    }
+}
+
+void DynamicResourceCacheBenchmark::BenchmarkIngest(const BenchmarkCorpus& corpus)
+{
+    auto* dynamicCache = GetSubsystem<DynamicResourceCache>();
+    Vector<PODVector<unsigned char>> payloads;
+    ReadCorpus(corpus, payloads);
+    ResetCaches();
+    dynamicCache->SetAsyncIngest(false);
+
+    HiresTimer timer;
+    for (unsigned i = 0; i < payloads.Size(); ++i) {
+        dynamicCache->ProcessResource(corpus.names_[i], (const char*)payloads[i].Buffer(), payloads[i].Size());
+    }
+    AddResult("ingest", corpus, payloads.Size(), corpus.bytes_, timer.GetUSec(false));
+}
+
+void DynamicResourceCacheBenchmark::BenchmarkIngestBurst(const BenchmarkCorpus& corpus)
+{
+    auto* dynamicCache = GetSubsystem<DynamicResourceCache>();
+    Vector<PODVector<unsigned char>> payloads;
+    ReadCorpus(corpus, payloads);
+    dynamicCache->SetAsyncIngest(false);
+
+    // Every save appends a trailing newline, which all the generated formats ignore, so no save is skipped as unchanged
+    for (unsigned coalescing = 0; coalescing < 2; ++coalescing) {
+        ResetCaches();
+        dynamicCache->SetIngestCoalescing(coalescing != 0);
+        Vector<PODVector<unsigned char>> saves = payloads;
+
+        HiresTimer timer;
+        for (unsigned i = 0; i < BURST_SAVES; ++i) {
+            for (unsigned j = 0; j < saves.Size(); ++j) {
+                saves[j].Push('\n');
+                dynamicCache->ProcessResource(corpus.names_[j], (const char*)saves[j].Buffer(), saves[j].Size());
+            }
+        }
+        RunUpdate();
+        AddResult(coalescing ? "ingest_coalesced" : "ingest_burst", corpus, payloads.Size() * BURST_SAVES,
+            corpus.bytes_ * BURST_SAVES, timer.GetUSec(false));
+    }
+    dynamicCache->SetIngestCoalescing(false);
+}
+
+void DynamicResourceCacheBenchmark::BenchmarkAsyncIngest(const BenchmarkCorpus& corpus)
+{
+    auto* dynamicCache = GetSubsystem<DynamicResourceCache>();
+    Vector<PODVector<unsigned char>> payloads;
+    ReadCorpus(corpus, payloads);
+    ResetCaches();
+    dynamicCache->SetAsyncIngest(true);
+
+    HiresTimer timer;
+    for (unsigned i = 0; i < payloads.Size(); ++i) {
+        dynamicCache->ProcessResource(corpus.names_[i], (const char*)payloads[i].Buffer(), payloads[i].Size());
+    }
+    PODVector<long long> updateTimes;
+    while (dynamicCache->GetNumPendingIngests() && timer.GetUSec(false) < BENCHMARK_TIMEOUT * 1000LL) {
+        updateTimes.Push(RunUpdate());
+    }
+    AddResult("async_ingest", corpus, payloads.Size(), corpus.bytes_, timer.GetUSec(false), &updateTimes);
+    dynamicCache->SetAsyncIngest(false);
+}
+
+void DynamicResourceCacheBenchmark::BenchmarkModelOptimization(const BenchmarkCorpus& corpus)
+{
+    auto* cache = GetSubsystem<ResourceCache>();
+    auto* dynamicCache = GetSubsystem<DynamicResourceCache>();
+    Vector<PODVector<unsigned char>> payloads;
+    ReadCorpus(corpus, payloads);
+    ResetCaches();
+    ModelOptimizeSettings settings;
+    settings.numLodLevels_ = 2;
+    dynamicCache->SetModelOptimizeSettings(settings);
+    dynamicCache->SetModelOptimization(true);
+
+    HiresTimer timer;
+    for (unsigned i = 0; i < payloads.Size(); ++i) {
+        dynamicCache->ProcessResource(corpus.names_[i], (const char*)payloads[i].Buffer(), payloads[i].Size());
+    }
+    PODVector<long long> updateTimes;
+    while (dynamicCache->GetNumPendingIngests() && timer.GetUSec(false) < BENCHMARK_TIMEOUT * 1000LL) {
+        updateTimes.Push(RunUpdate());
+    }
+    AddResult("model_optimize", corpus, payloads.Size(), corpus.bytes_, timer.GetUSec(false), &updateTimes);
+    dynamicCache->SetModelOptimization(false);
+
+    // The generated models have every vertex three or six times over, so the shadowed buffers show whether the
+    // optimisation was applied
+    unsigned failed = 0;
+    for (auto it = corpus.names_.Begin(); it != corpus.names_.End(); ++it) {
+        auto* model = cache->GetExistingResource<Model>(*it);
+        Geometry* geometry = model ? model->GetGeometry(0, 0) : nullptr;
+        if (!geometry || model->GetNumGeometryLodLevels(0) < 2) {
+            ++failed;
+            continue;
+        }
+        IndexBuffer* indexBuffer = geometry->GetIndexBuffer();
+        const unsigned char* indexData = indexBuffer->GetShadowData();
+        PODVector<unsigned> indices(geometry->GetIndexCount());
+        for (unsigned i = 0; i < indices.Size(); ++i) {
+            unsigned index = geometry->GetIndexStart() + i;
+            indices[i] = indexBuffer->GetIndexSize() == 2 ? ((const unsigned short*)indexData)[index] : ((const unsigned*)indexData)[index];
+        }
+        unsigned numTriangles = indices.Size() / 3;
+        float acmr = numTriangles ? (float)GetVertexCacheMisses(indices.Buffer(), indices.Size()) / numTriangles : 0.0f;
+        if (geometry->GetVertexBuffer(0)->GetVertexCount() * 2 > indices.Size() || acmr >= 1.0f) {
+            ++failed;
+        }
+    }
+    if (failed) {
+        URHO3D_LOGERRORF("%u of %u %s %s models were not optimised", failed, corpus.names_.Size(), corpus.size_.CString(),
+            corpus.type_.CString());
+    }
+}
+
+void DynamicResourceCacheBenchmark::BenchmarkShaderVariants(const BenchmarkCorpus& corpus)
+{
+    static const char* variantDefines[] = {"", "SKINNED", "INSTANCED", "SKINNED NORMALMAP"};
+    static const unsigned numVariantDefines = sizeof(variantDefines) / sizeof(variantDefines[0]);
+
+    auto* dynamicCache = GetSubsystem<DynamicResourceCache>();
+    Vector<PODVector<unsigned char>> payloads;
+    ReadCorpus(corpus, payloads);
+    ResetCaches();
+    dynamicCache->ClearShaderVariantCache();
+    for (unsigned i = 0; i < payloads.Size(); ++i) {
+        dynamicCache->ProcessResource(corpus.names_[i], (const char*)payloads[i].Buffer(), payloads[i].Size());
+    }
+
+    // The second pass finds every variation in the preprocessed source cache
+    const char* benchmarks[] = {"shader_variants", "shader_cached"};
+    for (unsigned pass = 0; pass < 2; ++pass) {
+        unsigned failed = 0;
+        HiresTimer timer;
+        for (auto it = corpus.names_.Begin(); it != corpus.names_.End(); ++it) {
+            for (unsigned i = 0; i < numVariantDefines; ++i) {
+                failed += dynamicCache->ValidateShaderVariant(*it, VS, variantDefines[i]) ? 0 : 1;
+                failed += dynamicCache->ValidateShaderVariant(*it, PS, variantDefines[i]) ? 0 : 1;
+            }
+        }
+        unsigned variants = corpus.names_.Size() * numVariantDefines * 2;
+        AddResult(benchmarks[pass], corpus, variants, corpus.bytes_ * numVariantDefines * 2, timer.GetUSec(false));
+        if (failed) {
+            URHO3D_LOGERRORF("%u of %u shader variations failed validation", failed, variants);
+        }
+    }
+}
+
+void DynamicResourceCacheBenchmark::BenchmarkReadBack(const BenchmarkCorpus& corpus)
+{
+    auto* dynamicCache = GetSubsystem<DynamicResourceCache>();
+    bool text = corpus.type_ == "xml" || corpus.type_ == "json" || corpus.type_ == "glsl";
+    unsigned long long bytes = 0;
+
+    HiresTimer timer;
+    for (auto it = corpus.names_.Begin(); it != corpus.names_.End(); ++it) {
+        if (text) {
+            bytes += dynamicCache->GetResourceContent(*it).Length();
+        } else {
+            unsigned size = 0;
+            dynamicCache->GetResourceContentBinary(*it, size);
+            bytes += size;
+        }
+    }
+    AddResult(text ? "read_text" : "read_binary", corpus, corpus.names_.Size(), bytes, timer.GetUSec(false));
+}
+
+void DynamicResourceCacheBenchmark::BenchmarkPackage()
+{
+    auto* cache = GetSubsystem<ResourceCache>();
+    auto* dynamicCache = GetSubsystem<DynamicResourceCache>();
+    String packageName = corpusDir_ + "Benchmark.pak";
+    BenchmarkCorpus all;
+    all.type_ = "all";
+    all.size_ = "all";
+
+    // Payloads are only kept for export in a store, so the corpus is sent again with one open. Unchanged payloads are
+    // stored without being reloaded
+    if (!dynamicCache->SetPersistentCacheDir(corpusDir_ + "Store/")) {
+        URHO3D_LOGERROR("Could not open the persistent store, skipping package benchmarks");
+        return;
+    }
+    dynamicCache->SetAsyncIngest(false);
+    for (auto it = corpora_.Begin(); it != corpora_.End(); ++it) {
+        Vector<PODVector<unsigned char>> payloads;
+        ReadCorpus(*it, payloads);
+        for (unsigned i = 0; i < payloads.Size(); ++i) {
+            dynamicCache->ProcessResource(it->names_[i], (const char*)payloads[i].Buffer(), payloads[i].Size());
+        }
+    }
+    unsigned files = dynamicCache->GetDynamicResources().Size();
+
+    HiresTimer timer;
+    bool exported = dynamicCache->ExportPackage(packageName);
+    long long exportTime = timer.GetUSec(false);
+    // The mount is measured without the store, which would copy every entry into it
+    dynamicCache->SetPersistentCacheDir(String::EMPTY);
+    if (!exported) {
+        URHO3D_LOGERRORF("Could not export %s, skipping package benchmarks", packageName.CString());
+        return;
+    }
+    unsigned packageSize = File(context_, packageName, FILE_READ).GetSize();
+    AddResult("package_export", all, files, packageSize, exportTime);
+
+    // Mounted entries must not be found in the resource directory as well
+    cache->RemoveResourceDir(corpusDir_);
+    ResetCaches();
+    timer.Reset();
+    bool mounted = dynamicCache->MountPackage(packageName);
+    long long mountTime = timer.GetUSec(false);
+    cache->AddResourceDir(corpusDir_);
+    if (!mounted) {
+        URHO3D_LOGERRORF("Could not mount %s, skipping the mount benchmark", packageName.CString());
+        return;
+    }
+    AddResult("package_mount", all, files, packageSize, mountTime);
+}
+
+void DynamicResourceCacheBenchmark::BenchmarkDownloads(const BenchmarkCorpus& corpus, unsigned short port)
+{
+    auto* dynamicCache = GetSubsystem<DynamicResourceCache>();
+    ResetCaches();
+    String baseUrl = ToString("http://127.0.0.1:%u/", (unsigned)port);
+
+    HiresTimer timer;
+    for (auto it = corpus.names_.Begin(); it != corpus.names_.End(); ++it) {
+        dynamicCache->LoadResourceFromUrl(baseUrl + *it, *it);
+    }
+    PODVector<long long> updateTimes;
+    while ((dynamicCache->GetNumQueuedDownloads() || dynamicCache->GetNumActiveDownloads()) &&
+        timer.GetUSec(false) < BENCHMARK_TIMEOUT * 1000LL) {
+        updateTimes.Push(RunUpdate());
+        Time::Sleep(1);
+    }
+    AddResult("download", corpus, corpus.names_.Size(), corpus.bytes_, timer.GetUSec(false), &updateTimes);
+}
+
+void DynamicResourceCacheBenchmark::BenchmarkRangedDownloads(const BenchmarkCorpus& corpus, LoopbackHttpServer& server)
+{
+    auto* dynamicCache = GetSubsystem<DynamicResourceCache>();
+    ResetCaches();
+    String baseUrl = ToString("http://127.0.0.1:%u/", (unsigned)server.GetPort());
+    Vector<PODVector<unsigned char>> payloads;
+    ReadCorpus(corpus, payloads);
+
+    // Every response is cut off before the chunk is complete, so each chunk has to be resumed at least once
+    unsigned retryDelay = dynamicCache->GetDownloadRetryDelay();
+    dynamicCache->SetRangeDownloads(true);
+    dynamicCache->SetDownloadChunkSize(256 * 1024);
+    dynamicCache->SetDownloadRetryDelay(1);
+    server.SetDropAfter(192 * 1024);
+    unsigned downloaded = dynamicCache->GetStats().numDownloaded_;
+
+    HiresTimer timer;
+    for (unsigned i = 0; i < corpus.names_.Size(); ++i) {
+        dynamicCache->LoadResourceFromUrl(baseUrl + corpus.names_[i], corpus.names_[i], payloads[i].Size());
+    }
+    PODVector<long long> updateTimes;
+    while ((dynamicCache->GetNumQueuedDownloads() || dynamicCache->GetNumActiveDownloads()) &&
+        timer.GetUSec(false) < BENCHMARK_TIMEOUT * 1000LL) {
+        updateTimes.Push(RunUpdate());
+        Time::Sleep(1);
+    }
+    AddResult("download_ranged", corpus, corpus.names_.Size(), corpus.bytes_, timer.GetUSec(false), &updateTimes);
+
+    server.SetDropAfter(0);
+    dynamicCache->SetDownloadRetryDelay(retryDelay);
+    dynamicCache->SetRangeDownloads(false);
+
+    // Downloaded payloads are not kept, the content hashes are compared instead
+    const HashMap<String, DynamicResourceInfo>& resources = dynamicCache->GetDynamicResources();
+    unsigned mismatches = corpus.names_.Size() - Min(dynamicCache->GetStats().numDownloaded_ - downloaded, corpus.names_.Size());
+    for (unsigned i = 0; i < corpus.names_.Size(); ++i) {
+        auto resource = resources.Find(corpus.names_[i]);
+        if (resource == resources.End() ||
+            resource->second_.hash_ != PersistentResourceStore::ComputeHash(payloads[i].Buffer(), payloads[i].Size())) {
+            ++mismatches;
+        }
+    }
+    if (mismatches) {
+        URHO3D_LOGERRORF("%u of %u files downloaded in ranges are missing or differ from the corpus", mismatches, corpus.names_.Size());
+    }
+}
+
+long long DynamicResourceCacheBenchmark::RunUpdate()
+{
+    using namespace Update;
+    VariantMap& eventData = GetEventDataMap();
+    eventData[P_TIMESTEP] = updateTimer_.GetUSec(true) / 1000000.0f;
+
+    HiresTimer timer;
+    SendEvent(E_UPDATE, eventData);
+    return timer.GetUSec(false);
+}
+
+void DynamicResourceCacheBenchmark::ResetCaches()
+{
+    GetSubsystem<ResourceCache>()->ReleaseAllResources(true);
+    updateTimer_.Reset();
+}
+
+void DynamicResourceCacheBenchmark::AddResult(const String& benchmark, const BenchmarkCorpus& corpus, unsigned files,
+    unsigned long long bytes, long long usec, const PODVector<long long>* updateTimes)
+{
+    double seconds = usec / 1000000.0;
+    double throughput = seconds > 0.0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0;
+    PrintLine(ToString("%-16s %-5s %-7s %5u files %10.2f ms %10.2f MB/s", benchmark.CString(), corpus.type_.CString(),
+        corpus.size_.CString(), files, usec / 1000.0, throughput));
+
+    JSONValue result;
+    result.Set("benchmark", benchmark);
+    result.Set("type", corpus.type_);
+    result.Set("size", corpus.size_);
+    result.Set("files", files);
+    result.Set("bytes", (double)bytes);
+    result.Set("timeMs", usec / 1000.0);
+    result.Set("throughputMBs", throughput);
+    result.Set("filesPerSecond", seconds > 0.0 ? files / seconds : 0.0);
+
+    // Update times show how much of the work lands on the main thread each frame
+    if (updateTimes && !updateTimes->Empty()) {
+        PODVector<long long> sorted = *updateTimes;
+        Sort(sorted.Begin(), sorted.End());
+        long long total = 0;
+        for (auto it = sorted.Begin(); it != sorted.End(); ++it) {
+            total += *it;
+        }
+        result.Set("updates", sorted.Size());
+        result.Set("updateMeanMs", total / 1000.0 / sorted.Size());
+        result.Set("updateP95Ms", sorted[sorted.Size() * 95 / 100] / 1000.0);
+        result.Set("updateMaxMs", sorted.Back() / 1000.0);
+    }
+    results_.Push(result);
+}
+
+void DynamicResourceCacheBenchmark::WriteResults()
+{
+    JSONFile output(context_);
+    JSONValue& root = output.GetRoot();
+    root.Set("results", results_);
+
+    JSONFile stats(context_);
+    if (stats.FromString(GetSubsystem<DynamicResourceCache>()->GetStatsJSON())) {
+        root.Set("stats", stats.GetRoot());
+    }
+
+    if (output.SaveFile(outputFile_)) {
+        PrintLine("Results written to " + outputFile_);
+    } else {
+        URHO3D_LOGERRORF("Could not write results to %s", outputFile_.CString());
+    }
+}
@@ -0,0 +1,120 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Engine/Application.h>
+#include <Urho3D/Resource/JSONValue.h>
+
+using namespace Urho3D;
+
+class LoopbackHttpServer;
+
+/// Generated resource files of one type and size class.
+struct BenchmarkCorpus
+{
+    /// Resource type label, e.g. "xml".
+    String type_;
+    /// Size class label, e.g. "small".
+    String size_;
+    /// Resource names.
+    Vector<String> names_;
+    /// Total size of the files in bytes.
+    unsigned long long bytes_{};
+};
+
+/// Headless benchmark of the Dynamic Resource Cache subsystem.
+class DynamicResourceCacheBenchmark : public Application
+{
+    URHO3D_OBJECT(DynamicResourceCacheBenchmark, Application);
+
+public:
+    /// Construct.
+    explicit DynamicResourceCacheBenchmark(Context* context);
+    /// Setup before engine initialization.
+    void Setup() override;
+    /// Run the benchmarks and exit.
+    void Start() override;
+
+private:
+    /// Write synthetic resources of every type and size class into the corpus directory.
+    void GenerateCorpus();
+    /// Write one corpus file and add it to the corpus.
+    void WriteCorpusFile(BenchmarkCorpus& corpus, const String& name, const void* data, unsigned size);
+    /// Return XML scene with a number of nodes.
+    String GenerateXML(unsigned nodes);
+    /// Return JSON document with a number of values.
+    String GenerateJSON(unsigned values);
+    /// Return GLSL shader with a number of helper functions.
+    String GenerateGLSL(unsigned functions);
+    /// Write PNG image of random pixels.
+    void GeneratePNG(BenchmarkCorpus& corpus, const String& name, int size);
+    /// Write single-geometry model of about a number of vertices, with duplicate vertices and shuffled triangles.
+    void GenerateModel(BenchmarkCorpus& corpus, const String& name, unsigned vertices);
+    /// Read corpus files into memory.
+    void ReadCorpus(const BenchmarkCorpus& corpus, Vector<PODVector<unsigned char>>& payloads);
+
+    /// Verify that XML root element names select the resource type regardless of their case.
+    void CheckXMLRootTypes();
+
+    /// Add a corpus with synchronous ProcessResource calls.
+    void BenchmarkIngest(const BenchmarkCorpus& corpus);
+    /// Process every file of a corpus several times in a row with changing content, like an editor saving repeatedly, with and
+    /// without ingest coalescing.
+    void BenchmarkIngestBurst(const BenchmarkCorpus& corpus);
+    /// Add a corpus with asynchronous ingest and measure the update time until everything is finished.
+    void BenchmarkAsyncIngest(const BenchmarkCorpus& corpus);
+    /// Add a model corpus with model optimisation and LOD generation, and verify the resulting buffers.
+    void BenchmarkModelOptimization(const BenchmarkCorpus& corpus);
+    /// Preprocess and validate shader variations of a GLSL corpus, first uncached and then from the preprocessed source cache.
+    void BenchmarkShaderVariants(const BenchmarkCorpus& corpus);
+    /// Read a corpus back through GetResourceContent() or GetResourceContentBinary().
+    void BenchmarkReadBack(const BenchmarkCorpus& corpus);
+    /// Export all resources to a package and add it back through a memory-mapped mount.
+    void BenchmarkPackage();
+    /// Download a corpus from the loopback HTTP server and measure the update time until everything is added.
+    void BenchmarkDownloads(const BenchmarkCorpus& corpus, unsigned short port);
+    /// Download a corpus in range requests from the loopback HTTP server cutting off every response, and verify the content.
+    void BenchmarkRangedDownloads(const BenchmarkCorpus& corpus, LoopbackHttpServer& server);
+
+    /// Send one update event and return the time it took in microseconds.
+    long long RunUpdate();
+    /// Release everything the previous benchmark loaded.
+    void ResetCaches();
+    /// Record benchmark result, optionally with update times.
+    void AddResult(const String& benchmark, const BenchmarkCorpus& corpus, unsigned files, unsigned long long bytes,
+        long long usec, const PODVector<long long>* updateTimes = nullptr);
+    /// Write all results and the pipeline statistics as JSON.
+    void WriteResults();
+
+    /// Directory holding the generated corpus.
+    String corpusDir_;
+    /// File receiving the JSON results.
+    String outputFile_;
+    /// Generated corpora.
+    Vector<BenchmarkCorpus> corpora_;
+    /// Recorded results.
+    JSONArray results_;
+    /// Measures time between update events.
+    HiresTimer updateTimer_;
+};
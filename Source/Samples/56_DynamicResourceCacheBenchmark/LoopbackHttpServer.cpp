@@ -0,0 +1,294 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/Math/MathDefs.h>
+
+#include "LoopbackHttpServer.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+typedef int socklen_t;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#define closesocket close
+#endif
+
+// A client closing the connection early must not raise SIGPIPE, which terminates the process. Apple platforms have no
+// MSG_NOSIGNAL and use the SO_NOSIGPIPE socket option instead
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#include <cstdio>
+#include <cstring>
+
+#include <Urho3D/DebugNew.h>
+
+/// Send whole buffer to a connection. Return false if the connection has failed.
+static bool SendAll(long long connection, const char* data, size_t size)
+{
+    while (size > 0) {
+        int sent = send(connection, data, (int)size, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+/// Thread serving a single connection of the loopback server.
+class LoopbackHttpConnection : public Thread
+{
+public:
+    /// Construct with the server and the accepted socket.
+    LoopbackHttpConnection(LoopbackHttpServer* server, long long socket) :
+        server_(server),
+        socket_(socket)
+    {
+    }
+
+    /// Serve the connection and close it.
+    void ThreadFunction() override
+    {
+        server_->ServeConnection(socket_);
+        closesocket(socket_);
+        finished_ = true;
+    }
+
+    /// Return whether the connection has been served and closed.
+    bool IsFinished() const { return finished_; }
+
+private:
+    /// Server.
+    LoopbackHttpServer* server_;
+    /// Accepted socket.
+    long long socket_;
+    /// Connection served flag.
+    volatile bool finished_{};
+};
+
+LoopbackHttpServer::LoopbackHttpServer(const String& rootDir) :
+    rootDir_(AddTrailingSlash(rootDir))
+{
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+}
+
+LoopbackHttpServer::~LoopbackHttpServer()
+{
+    Close();
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+bool LoopbackHttpServer::Start()
+{
+    auto listener = socket(AF_INET, SOCK_STREAM, 0);
+    if ((long long)listener < 0) {
+        return false;
+    }
+
+    // Port 0 lets the system pick a free port
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t addressLength = sizeof address;
+    if (bind(listener, (sockaddr*)&address, sizeof address) || listen(listener, 64) ||
+        getsockname(listener, (sockaddr*)&address, &addressLength)) {
+        closesocket(listener);
+        return false;
+    }
+
+    socket_ = (long long)listener;
+    port_ = ntohs(address.sin_port);
+    return Run();
+}
+
+void LoopbackHttpServer::Close()
+{
+    Stop();
+    ReapConnections(true);
+    if (socket_ >= 0) {
+        closesocket(socket_);
+        socket_ = -1;
+    }
+    port_ = 0;
+}
+
+void LoopbackHttpServer::ThreadFunction()
+{
+    while (shouldRun_) {
+        // Wake up regularly to notice the stop request
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(socket_, &readSet);
+        timeval timeout{0, 50000};
+        if (select((int)socket_ + 1, &readSet, nullptr, nullptr, &timeout) <= 0) {
+            continue;
+        }
+
+        ReapConnections(false);
+        auto connection = accept(socket_, nullptr, nullptr);
+        if ((long long)connection < 0) {
+            continue;
+        }
+
+        // A client that stops reading or writing can't keep the server from stopping
+#ifdef _WIN32
+        DWORD timeout = 5000;
+#else
+        timeval timeout{5, 0};
+#endif
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof timeout);
+        setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof timeout);
+#ifdef SO_NOSIGPIPE
+        int noSigPipe = 1;
+        setsockopt(connection, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&noSigPipe, sizeof noSigPipe);
+#endif
+
+        auto* thread = new LoopbackHttpConnection(this, (long long)connection);
+        if (thread->Run()) {
+            connections_.Push(thread);
+        } else {
+            delete thread;
+            closesocket(connection);
+        }
+    }
+}
+
+unsigned LoopbackHttpServer::GetNumRequests() const
+{
+    MutexLock lock(numRequestsMutex_);
+    return numRequests_;
+}
+
+void LoopbackHttpServer::ReapConnections(bool all)
+{
+    for (unsigned i = 0; i < connections_.Size();) {
+        if (all || connections_[i]->IsFinished()) {
+            // Destruction waits for the thread to exit
+            delete connections_[i];
+            connections_.Erase(i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+void LoopbackHttpServer::ServeConnection(long long connection)
+{
+    // Only the request line and the Range header matter, the rest of the headers is ignored
+    String request;
+    char buffer[4096];
+    while (!request.Contains("\r\n\r\n")) {
+        int received = recv(connection, buffer, sizeof buffer, 0);
+        if (received <= 0) {
+            return;
+        }
+        request.Append(buffer, received);
+    }
+
+    Vector<String> requestLine = request.Substring(0, request.Find("\r\n")).Split(' ');
+    String path = requestLine.Size() >= 2 ? requestLine[1].Substring(1) : String::EMPTY;
+    FILE* file = nullptr;
+    if (requestLine.Size() >= 2 && requestLine[0] == "GET" && !path.Contains("..")) {
+        file = fopen((rootDir_ + path).CString(), "rb");
+    }
+
+    if (!file) {
+        const char* notFound = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        SendAll(connection, notFound, strlen(notFound));
+        return;
+    }
+
+    long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    if (size < 0) {
+        const char* error = "HTTP/1.0 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        SendAll(connection, error, strlen(error));
+        fclose(file);
+        return;
+    }
+    long first = 0;
+    long last = size - 1;
+    String header;
+    unsigned rangeStart = request.ToLower().Find("\r\nrange: bytes=");
+    if (rangeStart != String::NPOS) {
+        // Open ended ranges ("bytes=100-") are served up to the end, suffix ranges ("bytes=-100") are not supported
+        String range = request.Substring(rangeStart + 15, request.Find("\r\n", rangeStart + 2) - rangeStart - 15).Trimmed();
+        unsigned dash = range.Find('-');
+        first = dash != String::NPOS && dash > 0 ? (long)ToUInt(range.Substring(0, dash)) : size;
+        if (dash != String::NPOS && dash + 1 < range.Length()) {
+            last = Min((long)ToUInt(range.Substring(dash + 1)), size - 1);
+        }
+        if (first > last) {
+            header = ToString("HTTP/1.0 416 Range Not Satisfiable\r\nContent-Range: bytes */%ld\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", size);
+            SendAll(connection, header.CString(), header.Length());
+            fclose(file);
+            return;
+        }
+        header = ToString("HTTP/1.0 206 Partial Content\r\nContent-Type: application/octet-stream\r\nContent-Range: bytes %ld-%ld/%ld\r\n"
+            "Content-Length: %ld\r\nConnection: close\r\n\r\n", first, last, size, last - first + 1);
+    } else {
+        header = ToString("HTTP/1.0 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %ld\r\nConnection: close\r\n\r\n", size);
+    }
+    if (fseek(file, first, SEEK_SET) != 0) {
+        const char* error = "HTTP/1.0 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        SendAll(connection, error, strlen(error));
+        fclose(file);
+        return;
+    }
+    if (!SendAll(connection, header.CString(), header.Length())) {
+        fclose(file);
+        return;
+    }
+
+    // The connection is closed early when responses are cut off, like a dropped connection
+    long remaining = last - first + 1;
+    if (dropAfter_ && remaining > (long)dropAfter_) {
+        remaining = dropAfter_;
+    }
+    size_t read;
+    while (remaining > 0 && (read = fread(buffer, 1, (size_t)Min(remaining, (long)sizeof buffer), file)) > 0) {
+        remaining -= (long)read;
+        if (!SendAll(connection, buffer, read)) {
+            fclose(file);
+            return;
+        }
+    }
+    fclose(file);
+
+    MutexLock lock(numRequestsMutex_);
+    ++numRequests_;
+}
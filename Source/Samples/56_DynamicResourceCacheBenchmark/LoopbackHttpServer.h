@@ -0,0 +1,82 @@
+//
+// Copyright (c) 2008-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/Thread.h>
+
+using namespace Urho3D;
+
+class LoopbackHttpConnection;
+
+/// Minimal HTTP/1.0 server on the loopback interface, serving files of a directory to GET requests. Every connection is
+/// served on its own thread. Single byte ranges are supported.
+class LoopbackHttpServer : public Thread
+{
+    friend class LoopbackHttpConnection;
+
+public:
+    /// Construct with the directory to serve.
+    explicit LoopbackHttpServer(const String& rootDir);
+    /// Destruct. Stop the server.
+    ~LoopbackHttpServer() override;
+
+    /// Listen on a free loopback port and start serving. Return true on success.
+    bool Start();
+    /// Stop serving, wait for the open connections and close the listening socket.
+    void Close();
+    /// Accept and serve connections until stopped.
+    void ThreadFunction() override;
+
+    /// Return listening port, 0 if not started.
+    unsigned short GetPort() const { return port_; }
+    /// Return number of served requests.
+    unsigned GetNumRequests() const;
+    /// Set number of body bytes after which every response is cut off to simulate a flaky connection, 0 to send whole responses.
+    void SetDropAfter(unsigned bytes) { dropAfter_ = bytes; }
+    /// Return number of body bytes after which responses are cut off.
+    unsigned GetDropAfter() const { return dropAfter_; }
+
+private:
+    /// Read request from a connection and send the file or an error response. Called on the connection thread.
+    void ServeConnection(long long connection);
+    /// Wait for the connection threads that have finished and delete them, or for all of them.
+    void ReapConnections(bool all);
+
+    /// Served directory with trailing slash.
+    String rootDir_;
+    /// Listening socket, -1 if closed.
+    long long socket_{-1};
+    /// Listening port.
+    unsigned short port_{};
+    /// Connection threads, only accessed by the accepting thread and after it has stopped.
+    Vector<LoopbackHttpConnection*> connections_;
+    /// Number of served requests.
+    unsigned numRequests_{};
+    /// Mutex for the request counter, which the connection threads update.
+    mutable Mutex numRequestsMutex_;
+    /// Number of body bytes after which responses are cut off, 0 if never.
+    volatile unsigned dropAfter_{};
+};